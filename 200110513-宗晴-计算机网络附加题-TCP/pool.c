@@ -0,0 +1,100 @@
+#include "pool.h"
+#include "ring.h"
+
+/**
+ * @brief 预先分配的buf_t，加上引用计数。
+ *        buf必须是第一个成员，这样buf_t*可以直接换算回所在的slab
+ */
+typedef struct buf_slab {
+    buf_t buf;
+    _Atomic uint32_t ref;
+} buf_slab_t;
+
+static buf_slab_t pool_slab[BUF_POOL_SIZE];
+
+/**
+ * @brief 所有线程共享的空闲链表
+ */
+static mpmc_ring_t pool_free;
+static void* pool_free_slot[BUF_POOL_SIZE];
+static int pool_inited = 0;
+
+/**
+ * @brief 线程本地的空闲缓存，大部分分配和释放不需要访问共享的空闲链表
+ */
+static _Thread_local void* pool_cache[BUF_POOL_CACHE];
+static _Thread_local size_t pool_cache_len;
+
+/**
+ * @brief 初始化缓冲池，可以重复调用
+ *
+ */
+void buf_pool_init() {
+    if (pool_inited)
+        return;
+    mpmc_ring_init(&pool_free, pool_free_slot, BUF_POOL_SIZE);
+    for (int i = 0; i < BUF_POOL_SIZE; i++) {
+        atomic_init(&pool_slab[i].ref, 0);
+        void* slab = &pool_slab[i];
+        mpmc_ring_enqueue(&pool_free, slab);
+    }
+    pool_inited = 1;
+}
+
+/**
+ * @brief 从缓冲池分配一个buf_t并用buf_init初始化，头部前留有buf_init默认的空间，
+ *        引用计数为1
+ *
+ * @param len 数据长度
+ * @return buf_t* 缓冲池用完时返回NULL
+ */
+buf_t* buf_pool_alloc(size_t len) {
+    if (pool_cache_len == 0)
+        pool_cache_len = mpmc_ring_dequeue_burst(&pool_free, pool_cache, BUF_POOL_CACHE / 2);
+    if (pool_cache_len == 0)
+        return NULL;
+    buf_slab_t* slab = pool_cache[--pool_cache_len];
+    atomic_store_explicit(&slab->ref, 1, memory_order_relaxed);
+    buf_init(&slab->buf, len);
+    return &slab->buf;
+}
+
+/**
+ * @brief 增加一个引用，多个队列可以共享同一个buf_t而不必拷贝
+ *
+ * @param buf 由buf_pool_alloc分配的buf_t
+ * @return buf_t* 就是buf
+ */
+buf_t* buf_pool_ref(buf_t* buf) {
+    buf_slab_t* slab = (buf_slab_t*)buf;
+    atomic_fetch_add_explicit(&slab->ref, 1, memory_order_relaxed);
+    return buf;
+}
+
+/**
+ * @brief 释放一个引用，最后一个引用释放时buf_t回到缓冲池
+ *
+ * @param buf 由buf_pool_alloc分配的buf_t，为NULL时不做处理
+ */
+void buf_pool_free(buf_t* buf) {
+    if (buf == NULL)
+        return;
+    buf_slab_t* slab = (buf_slab_t*)buf;
+    if (atomic_fetch_sub_explicit(&slab->ref, 1, memory_order_acq_rel) != 1)
+        return;
+    if (pool_cache_len == BUF_POOL_CACHE) {
+        // 本地缓存满了，把一半还给共享的空闲链表
+        size_t n = mpmc_ring_enqueue_burst(&pool_free, pool_cache + BUF_POOL_CACHE / 2, BUF_POOL_CACHE / 2);
+        pool_cache_len -= n;
+    }
+    pool_cache[pool_cache_len++] = slab;
+}
+
+/**
+ * @brief 当前线程还能分配的buf_t个数（共享空闲链表加上本线程的缓存）
+ *
+ * @return size_t
+ */
+size_t buf_pool_available() {
+    return mpmc_ring_count(&pool_free) + pool_cache_len;
+}
@@ -0,0 +1,23 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "buf.h"
+
+// 缓冲池中buf_t的个数，必须是2的幂。以太网的接收队列和发送队列、arp等待队列和TCP连接的缓冲区共用，
+// 要大于前三者的容量之和（4 * 64 + 64 + 96）
+#ifndef BUF_POOL_SIZE
+#define BUF_POOL_SIZE 512
+#endif
+
+// 每个线程本地缓存的空闲buf_t个数
+#ifndef BUF_POOL_CACHE
+#define BUF_POOL_CACHE 8
+#endif
+
+void buf_pool_init();
+buf_t* buf_pool_alloc(size_t len);
+buf_t* buf_pool_ref(buf_t* buf);
+void buf_pool_free(buf_t* buf);
+size_t buf_pool_available();
+
+#endif
@@ -1,7 +1,14 @@
 #include <assert.h>
+#include <time.h>
 #include "map.h"
 #include "tcp.h"
 #include "ip.h"
+#include "checksum.h"
+#include "pmtu.h"
+#include "pool.h"
+#include "tcp_cc.h"
+#include "tcp_poll.h"
+#include "tcp_ring.h"
 
 static void panic(const char* msg, int line) {
     printf("panic %s! at line %d\n", msg, line);
@@ -21,8 +28,15 @@ static void display_flags(tcp_flags_t flags) {
     );
 }
 
-// dst-port -> handler
-static map_t tcp_table; //tcp_table里面放了一个dst_port的回调函数
+// dst-port -> tcp_listener_t
+static map_t tcp_table; //tcp_table里面放了一个dst_port的回调函数和该端口使用的拥塞控制算法
+
+typedef struct tcp_listener {
+    tcp_handler_t handler;
+    const tcp_cc_ops_t* cc;
+    uint32_t rx_size;   // 新连接的接收、发送缓冲区大小
+    uint32_t tx_size;
+} tcp_listener_t;
 
 // tcp_key_t[IP, src port, dst port] -> tcp_connect_t
 
@@ -31,6 +45,296 @@ static map_t tcp_table; //tcp_table里面放了一个dst_port的回调函数
 */
 static map_t connect_table; 
 
+/**
+ * @brief 重传相关参数（RFC 6298），单位为毫秒
+ */
+#ifndef TCP_RTO_INIT
+#define TCP_RTO_INIT 1000
+#endif
+#ifndef TCP_RTO_MIN
+#define TCP_RTO_MIN 1000
+#endif
+#ifndef TCP_RTO_MAX
+#define TCP_RTO_MAX 60000
+#endif
+#define TCP_CLOCK_GRANULARITY 1
+
+/**
+ * @brief 连续超时重传超过这个次数就放弃连接
+ */
+#ifndef TCP_MAX_RETRIES
+#define TCP_MAX_RETRIES 8
+#endif
+
+/**
+ * @brief 主动打开时SYN最多重传的次数，RTO从1秒开始退避，默认约63秒后放弃连接
+ */
+#ifndef TCP_SYN_RETRIES
+#define TCP_SYN_RETRIES 5
+#endif
+
+/**
+ * @brief 主动打开时使用的临时端口范围（RFC 6335）
+ */
+#ifndef TCP_EPHEMERAL_MIN
+#define TCP_EPHEMERAL_MIN 49152
+#endif
+#ifndef TCP_EPHEMERAL_MAX
+#define TCP_EPHEMERAL_MAX 65535
+#endif
+
+/**
+ * @brief 半连接（SYN_RCVD）队列的长度，所有listener共用
+ */
+#ifndef TCP_SYN_BACKLOG
+#define TCP_SYN_BACKLOG 128
+#endif
+
+/**
+ * @brief SYN cookie（RFC 4987）：0不使用，半连接队列满时淘汰最老的半连接；
+ *        1半连接队列满时使用；2总是使用，收到SYN时不保存任何状态
+ */
+#ifndef TCP_SYN_COOKIES
+#define TCP_SYN_COOKIES 1
+#endif
+#define TCP_COOKIE_PERIOD_MS 64000  // cookie中的计数器每这么久加一，收到ACK时接受当前和上一个计数器
+#define TCP_COOKIE_TS_MASK 0x3F     // SYN+ACK的TSval中编码协商结果的低位
+
+/**
+ * @brief TIME_WAIT的时长（2MSL）
+ */
+#ifndef TCP_TIME_WAIT_MS
+#define TCP_TIME_WAIT_MS 60000
+#endif
+
+/**
+ * @brief TIME_WAIT表的容量，必须是2的幂，满了以后新的TIME_WAIT连接直接关闭
+ */
+#ifndef TCP_TW_SIZE
+#define TCP_TW_SIZE 4096
+#endif
+#define TCP_TW_TICK_MS 1000         // TIME_WAIT时间轮每个槽对应的时间
+#define TCP_TW_WHEEL_SLOTS 64       // TIME_WAIT时间轮的槽数，必须是2的幂，转一圈不短于TCP_TIME_WAIT_MS
+
+/**
+ * @brief 主动打开时发出SYN、等待SYN+ACK的状态。
+ *        tcp.h的tcp_state_t只有被动打开用到的状态，这个状态排在它们之后
+ */
+#define TCP_SYN_SENT ((tcp_state_t)(TCP_LAST_ACK + 1))
+
+static const tcp_flags_t tcp_flags_syn = { .syn = 1 };
+static const tcp_flags_t tcp_flags_rst = { .rst = 1 };
+
+/**
+ * @brief 延迟确认：按序收到的数据最多等这么久再确认，
+ *        其间每收到TCP_DELACK_SEGS个报文段立即确认一次（RFC 1122、RFC 5681）
+ */
+#ifndef TCP_DELACK_MS
+#define TCP_DELACK_MS 40
+#endif
+#define TCP_DELACK_SEGS 2
+
+/**
+ * @brief 连接的接收、发送缓冲区的默认大小和上限，都是2的幂。
+ *        放得进一个buf_t的缓冲区从缓冲池分配，更大的用malloc
+ */
+#ifndef TCP_RX_RING_SIZE
+#define TCP_RX_RING_SIZE 65536
+#endif
+#ifndef TCP_TX_RING_SIZE
+#define TCP_TX_RING_SIZE 65536
+#endif
+#ifndef TCP_RING_MAX_SIZE
+#define TCP_RING_MAX_SIZE (8 << 20)
+#endif
+#define TCP_RING_MIN_SIZE 4096
+
+/**
+ * @brief 一次tcp_poll最多回收的连接数，其余的留到下一次
+ */
+#define TCP_POLL_MAX_DEAD 16
+
+/**
+ * @brief 序号比较，考虑32位回绕
+ */
+#define TCP_SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+#define TCP_SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+
+/**
+ * @brief 是否协商SACK（RFC 2018）
+ */
+#ifndef TCP_SACK_ENABLE
+#define TCP_SACK_ENABLE 1
+#endif
+
+/**
+ * @brief 是否协商窗口缩放和时间戳（RFC 7323）
+ */
+#ifndef TCP_WSCALE_ENABLE
+#define TCP_WSCALE_ENABLE 1
+#endif
+
+#ifndef TCP_TIMESTAMP_ENABLE
+#define TCP_TIMESTAMP_ENABLE 1
+#endif
+
+/**
+ * @brief 窗口缩放因子的上限（RFC 7323），对端没有给出MSS时使用的默认值（RFC 9293）
+ */
+#define TCP_MAX_WSCALE 14
+#define TCP_DEFAULT_MSS 536
+
+/**
+ * @brief 我们在SYN中通告的MSS
+ */
+#define TCP_ADV_MSS (ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t))
+
+/**
+ * @brief 收到这么多个重复ACK就快速重传（RFC 5681）
+ */
+#define TCP_DUPACK_THRESHOLD 3
+
+/**
+ * @brief 一个报文段最多携带的SACK块数，以及发送端记录的SACK块数
+ */
+#define TCP_MAX_SACK_BLOCKS 4
+#define TCP_SACK_SCOREBOARD 8
+
+/**
+ * @brief 接收端最多记录的乱序区间数
+ */
+#ifndef TCP_OOO_MAX_RANGES
+#define TCP_OOO_MAX_RANGES 8
+#endif
+
+/**
+ * @brief TCP选项类型
+ */
+#define TCP_OPT_EOL 0
+#define TCP_OPT_NOP 1
+#define TCP_OPT_MSS 2
+#define TCP_OPT_WSCALE 3
+#define TCP_OPT_SACK_PERM 4
+#define TCP_OPT_SACK 5
+#define TCP_OPT_TIMESTAMP 8
+#define TCP_MAX_OPT_LEN 40
+#define TCP_TIMESTAMP_LEN 12    // NOP NOP 时间戳，数据报文段中每个都带
+
+/**
+ * @brief 从报文段中解析出的选项，没有出现的选项为0
+ */
+typedef struct tcp_options {
+    uint16_t mss;
+    uint8_t wscale_present;
+    uint8_t wscale;
+    uint8_t ts_present;
+    uint32_t ts_val;
+    uint32_t ts_ecr;
+    uint8_t sack_permitted;
+    uint8_t sack_count;
+    uint32_t sack[TCP_MAX_SACK_BLOCKS][2];  // [左边界, 右边界)
+} tcp_options_t;
+
+typedef enum tcp_timer {
+    TCP_TIMER_RTO,      // 重传定时器
+    TCP_TIMER_DELACK,   // 延迟确认定时器
+    TCP_TIMER_MAX
+} tcp_timer_t;
+
+/**
+ * @brief connect_table中实际存放的连接状态。
+ *        connect必须是第一个成员，回调函数拿到的tcp_connect_t*就是它，
+ *        tcp.c内部用TCP_SOCK()换算回tcp_sock_t*。
+ *        收发的数据放在rx、tx两个环形缓冲区中，connect->rx_buf、tx_buf是它们来自缓冲池时的存储空间，
+ *        用malloc分配时为NULL，应用层应该通过tcp_connect_read/write等函数访问数据
+ */
+typedef struct tcp_sock {
+    tcp_connect_t connect;
+    tcp_handler_t handler;          // 连接的回调函数，被动打开时来自listener，主动打开时由tcp_connect指定
+    uint16_t syn_slot;              // 在半连接队列中的槽位+1，不在队列中为0
+    uint32_t srtt;                  // 平滑RTT
+    uint32_t rttvar;                // RTT偏差
+    uint32_t rto;                   // 重传超时
+    uint32_t snd_max;               // 发送过的最大序号，超时后next_seq会退回unack_seq
+    uint32_t rtt_seq;               // 正在测量RTT的报文段的末尾序号
+    uint64_t rtt_start;             // 该报文段的发送时间，为0表示没有在测量
+    uint8_t retries;                // 连续超时重传的次数
+    uint8_t fin_queued;             // 数据发送完后要发送FIN
+    uint8_t fin_sent;               // FIN已经发送（占用一个序号）
+    uint8_t sack_ok;                // 双方都支持SACK
+    uint8_t wscale_ok;              // 双方都支持窗口缩放
+    uint8_t snd_wscale;             // 对端窗口的缩放因子
+    uint8_t rcv_wscale;             // 我们通告的窗口的缩放因子
+    uint8_t ts_ok;                  // 双方都支持时间戳
+    uint32_t ts_recent;             // 最近一个按序报文段的时间戳，在TSecr中回显（RFC 7323）
+    uint8_t cookie_ts;              // 非0时替换TSval的低6位，用SYN cookie回复时编码SACK和窗口缩放
+    uint32_t snd_wnd;               // 对端窗口，已经缩放；connect->remote_win只有16位
+    uint32_t last_ack_sent;         // 最近发出的报文段中的确认号，不等于connect->ack说明有确认没发
+    uint8_t delack_segs;            // 还没确认的按序报文段个数
+    uint32_t rcv_wnd_adv;           // 最近通告的接收窗口（字节）
+    uint8_t ooo_count;
+    uint32_t ooo[TCP_OOO_MAX_RANGES][2];  // 乱序收到的区间，按序号排序、互不重叠，数据在rx中
+    uint32_t ooo_recent;            // 最近收到的乱序报文段的序号，它所在的区间是第一个SACK块
+    uint8_t dupacks;                // 连续收到的重复ACK个数
+    uint8_t in_recovery;            // 正在快速恢复
+    uint32_t recover;               // 进入快速恢复时的snd_max，确认到这里才退出（NewReno）
+    uint32_t rexmit_next;           // 快速恢复中下一个要重传的序号
+    uint8_t sacked_count;
+    uint32_t sacked[TCP_SACK_SCOREBOARD][2];  // 对端已经SACK的区间，按序号排序、互不重叠
+    uint64_t timer[TCP_TIMER_MAX];  // 各定时器的到期时间，为0表示未启动
+    tcp_cc_t cc;                    // 拥塞控制
+    tcp_ring_t rx;                  // 接收缓冲区，connect->ack对应rx.tail
+    tcp_ring_t tx;                  // 发送缓冲区，connect->unack_seq对应tx.head
+} tcp_sock_t;
+
+#define TCP_SOCK(connect) ((tcp_sock_t*)(connect))
+
+/**
+ * @brief 确认统计，segs - quick - delayed就是延迟确认省掉的纯ACK个数
+ *
+ */
+static struct {
+    size_t segs;        // 按序收到的数据报文段数
+    size_t quick;       // 立即发出的纯ACK数
+    size_t delayed;     // 延迟确认定时器到期发出的纯ACK数
+    size_t piggybacked; // 搭载在数据上发出的确认数
+} tcp_ack_stats;
+
+/**
+ * @brief 打印确认统计
+ *
+ */
+void tcp_ack_print() {
+    printf("===TCP ACK===\n");
+    printf("segs: %zu | quick: %zu | delayed: %zu | piggybacked: %zu | saved: %zu\n",
+        tcp_ack_stats.segs, tcp_ack_stats.quick, tcp_ack_stats.delayed, tcp_ack_stats.piggybacked,
+        tcp_ack_stats.segs - tcp_ack_stats.quick - tcp_ack_stats.delayed);
+}
+
+/**
+ * @brief 半连接和SYN cookie统计
+ *
+ */
+static struct {
+    size_t syn;             // 收到的建立新连接的SYN数
+    size_t evicted;         // 半连接队列满时被淘汰的半连接数
+    size_t cookie_sent;     // 用SYN cookie回复的SYN数
+    size_t cookie_ok;       // 通过验证、建立了连接的cookie数
+    size_t cookie_bad;      // 没有通过验证的ACK数
+    size_t nomem;           // 握手完成时分配不到缓冲区、回复RST的连接数
+} tcp_syn_stats;
+
+/**
+ * @brief 打印半连接和SYN cookie统计
+ *
+ */
+void tcp_syn_print() {
+    printf("===TCP SYN===\n");
+    printf("syn: %zu | evicted: %zu | cookie sent: %zu | cookie ok: %zu | cookie bad: %zu | nomem: %zu\n",
+        tcp_syn_stats.syn, tcp_syn_stats.evicted, tcp_syn_stats.cookie_sent, tcp_syn_stats.cookie_ok,
+        tcp_syn_stats.cookie_bad, tcp_syn_stats.nomem);
+}
+
 /**
  * @brief 生成一个用于 connect_table 的 key
  *
@@ -48,233 +352,1669 @@ static tcp_key_t new_tcp_key(uint8_t ip[NET_IP_LEN], uint16_t src_port, uint16_t
 }
 
 /**
- * @brief 初始化tcp在静态区的map
+ * @brief 单调时钟，单位为毫秒
+ *
+ * @return uint64_t
+ */
+static uint64_t tcp_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 启动（或重新启动）一个定时器
+ *
+ * @param sock
+ * @param timer 哪个定时器
+ * @param ms 多少毫秒后到期
+ */
+static void tcp_timer_set(tcp_sock_t* sock, tcp_timer_t timer, uint32_t ms) {
+    sock->timer[timer] = tcp_now_ms() + ms;
+}
+
+static void tcp_timer_clear(tcp_sock_t* sock, tcp_timer_t timer) {
+    sock->timer[timer] = 0;
+}
+
+/**
+ * @brief 用一个RTT样本更新SRTT、RTTVAR和RTO（RFC 6298 第2节）
+ *
+ * @param sock
+ * @param rtt 样本，毫秒
+ */
+static void tcp_rtt_sample(tcp_sock_t* sock, uint32_t rtt) {
+    if (sock->srtt == 0) {
+        sock->srtt = rtt ? rtt : 1;
+        sock->rttvar = rtt / 2;
+    } else {
+        uint32_t delta = sock->srtt > rtt ? sock->srtt - rtt : rtt - sock->srtt;
+        sock->rttvar = (3 * sock->rttvar + delta) / 4;
+        sock->srtt = (7 * sock->srtt + rtt) / 8;
+        if (sock->srtt == 0)
+            sock->srtt = 1;
+    }
+    uint32_t var = 4 * sock->rttvar;
+    uint32_t rto = sock->srtt + (var > TCP_CLOCK_GRANULARITY ? var : TCP_CLOCK_GRANULARITY);
+    sock->rto = rto < TCP_RTO_MIN ? TCP_RTO_MIN : rto > TCP_RTO_MAX ? TCP_RTO_MAX : rto;
+    if (sock->cc.ops && sock->cc.ops->on_rtt)
+        sock->cc.ops->on_rtt(&sock->cc, rtt, tcp_now_ms());
+}
+
+/**
+ * @brief TIME_WAIT状态的连接，40字节：只保留回复ACK和判断新SYN所需的字段，
+ *        tcp_sock_t在进入TIME_WAIT时就释放了，不占用connect_table
+ */
+typedef struct tcp_tw {
+    tcp_key_t key;
+    uint32_t snd_nxt;       // 我们的FIN之后的序号
+    uint32_t rcv_nxt;       // 对方的FIN之后的序号
+    uint32_t ts_recent;     // 对方最近的时间戳
+    uint32_t expire;        // 到期时刻（tick）
+    int32_t hash_next;      // 哈希链中的下一个，空闲时是空闲链表中的下一个
+    int32_t wheel_next;     // 时间轮槽中的下一个
+    int32_t wheel_prev;     // 时间轮槽中的上一个，是槽中第一个时为-1
+    uint8_t wheel_slot;     // 挂在哪个时间轮槽上
+    uint8_t ts_ok;          // 使用了时间戳
+    uint8_t used;           // 在哈希表中
+} tcp_tw_t;
+
+/**
+ * @brief TIME_WAIT表：按下标链接的哈希表，加上和arp缓存一样的时间轮，链表都以-1结束。
+ *        时间轮槽中的链表是双向的，提前结束的连接可以马上摘下、放回空闲链表
+ */
+static tcp_tw_t tcp_tw[TCP_TW_SIZE];
+static int32_t tcp_tw_bucket[TCP_TW_SIZE];
+static int32_t tcp_tw_free;
+static int32_t tcp_tw_wheel[TCP_TW_WHEEL_SLOTS];
+static uint32_t tcp_tw_now;     // 时间轮已经处理到的tick
+
+/**
+ * @brief TIME_WAIT统计
+ *
+ */
+static struct {
+    size_t entered;     // 进入TIME_WAIT的连接数
+    size_t expired;     // 2MSL到期的
+    size_t reused;      // 被时间戳更新的SYN提前结束的
+    size_t overflow;    // 表满时直接关闭的
+    size_t acked;       // 在TIME_WAIT中回复的ACK数
+} tcp_tw_stats;
+
+/**
+ * @brief 打印TIME_WAIT统计
+ *
+ */
+void tcp_tw_print() {
+    printf("===TCP TIME_WAIT===\n");
+    printf("entered: %zu | expired: %zu | reused: %zu | overflow: %zu | acked: %zu\n",
+        tcp_tw_stats.entered, tcp_tw_stats.expired, tcp_tw_stats.reused, tcp_tw_stats.overflow,
+        tcp_tw_stats.acked);
+}
+
+/**
+ * @brief 整数混合函数，和arp_hash的一样
+ *
+ * @param h
+ * @return uint32_t
+ */
+static uint32_t tcp_hash_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x7feb352d;
+    h ^= h >> 15;
+    h *= 0x846ca68b;
+    h ^= h >> 16;
+    return h;
+}
+
+static size_t tcp_tw_hash(tcp_key_t* key) {
+    uint32_t ip;
+    memcpy(&ip, key->ip, sizeof(ip));
+    return tcp_hash_mix(ip ^ tcp_hash_mix((uint32_t)key->src_port << 16 | key->dst_port)) & (TCP_TW_SIZE - 1);
+}
+
+/**
+ * @brief 在TIME_WAIT表中查找连接
+ *
+ * @param key
+ * @return tcp_tw_t* 没有找到返回NULL
+ */
+static tcp_tw_t* tcp_tw_lookup(tcp_key_t* key) {
+    for (int32_t i = tcp_tw_bucket[tcp_tw_hash(key)]; i >= 0; i = tcp_tw[i].hash_next)
+        if (memcmp(&tcp_tw[i].key, key, sizeof(tcp_key_t)) == 0)
+            return &tcp_tw[i];
+    return NULL;
+}
+
+/**
+ * @brief 把连接从哈希表中摘下，之后查不到它，时间轮上的链接不动
+ *
+ * @param tw
+ */
+static void tcp_tw_unhash(tcp_tw_t* tw) {
+    int32_t* link = &tcp_tw_bucket[tcp_tw_hash(&tw->key)];
+    while (*link != tw - tcp_tw)
+        link = &tcp_tw[*link].hash_next;
+    *link = tw->hash_next;
+    tw->used = 0;
+}
+
+/**
+ * @brief 清空TIME_WAIT表和时间轮
+ *
+ */
+static void tcp_tw_clear() {
+    for (int32_t i = 0; i < TCP_TW_SIZE; i++) {
+        tcp_tw_bucket[i] = -1;
+        tcp_tw[i].used = 0;
+        tcp_tw[i].hash_next = i + 1 < TCP_TW_SIZE ? i + 1 : -1;
+    }
+    tcp_tw_free = 0;
+    for (int i = 0; i < TCP_TW_WHEEL_SLOTS; i++)
+        tcp_tw_wheel[i] = -1;
+    tcp_tw_now = tcp_now_ms() / TCP_TW_TICK_MS;
+}
+
+/**
+ * @brief 下一次分配临时端口时开始尝试的位置（相对TCP_EPHEMERAL_MIN，取模前）
+ */
+static uint32_t tcp_ephemeral_next;
+
+/**
+ * @brief SYN cookie的密钥，在tcp_init中设置；最近一次用cookie回复SYN的时间，之后一段时间内才检查ACK中的cookie
+ */
+static uint32_t tcp_cookie_secret[2];
+static uint64_t tcp_cookie_last;
+
+/**
+ * @brief tcp_init之后才为1。ethernet_poll总是调用tcp_poll，只用到以太网、arp、ip的程序不初始化tcp
+ */
+static int tcp_inited = 0;
+
+/**
+ * @brief 初始化tcp在静态区的map
+ *        供应用层使用
+ *
+ */
+void tcp_init() {
+    map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_listener_t), 0, 0, NULL);
+    map_init(&connect_table, sizeof(tcp_key_t), sizeof(tcp_sock_t), 0, 0, NULL);
+    tcp_ephemeral_next = time(NULL);    // 重启后不从同一个端口开始
+    tcp_cookie_secret[0] = time(NULL) ^ (uint32_t)clock();
+    tcp_cookie_secret[1] = (uint32_t)tcp_now_ms() ^ (uint32_t)(uintptr_t)&tcp_table;
+    tcp_tw_clear();
+    buf_pool_init();
+    net_add_protocol(NET_PROTOCOL_TCP, tcp_in);
+    tcp_inited = 1;
+}
+
+/**
+ * @brief 向 port 注册一个 TCP 连接以及关联的回调函数，并指定该端口上的连接使用的拥塞控制算法
+ *        供应用层使用
+ *
+ * @param port
+ * @param handler
+ * @param cc "reno"、"cubic"或"bbr"
+ * @return int 成功为0，不认识的算法为-1
+ */
+int tcp_open_cc(uint16_t port, tcp_handler_t handler, const char* cc) {
+    printf("tcp open\n");
+    tcp_listener_t listener = {
+        .handler = handler,
+        .cc = tcp_cc_find(cc),
+        .rx_size = TCP_RX_RING_SIZE,
+        .tx_size = TCP_TX_RING_SIZE,
+    };
+    if (listener.cc == NULL)
+        return -1;
+    return map_set(&tcp_table, &port, &listener);
+}
+
+/**
+ * @brief 向上取到2的幂，限制在[TCP_RING_MIN_SIZE, TCP_RING_MAX_SIZE]内
+ *
+ * @param size
+ * @return uint32_t
+ */
+static uint32_t tcp_ring_round(size_t size) {
+    uint32_t n = TCP_RING_MIN_SIZE;
+    while (n < size && n < TCP_RING_MAX_SIZE)
+        n <<= 1;
+    return n;
+}
+
+/**
+ * @brief 设置 port 上之后建立的连接的接收、发送缓冲区大小，会向上取到2的幂，最大TCP_RING_MAX_SIZE。
+ *        接收缓冲区的大小决定了通告窗口和窗口缩放因子，长肥管道需要把它设得比带宽时延积大
+ *        供应用层使用
+ *
+ * @param port 已经用tcp_open注册的端口
+ * @param rx_size
+ * @param tx_size
+ * @return int 成功为0，端口没有注册为-1
+ */
+int tcp_set_buffer_size(uint16_t port, size_t rx_size, size_t tx_size) {
+    tcp_listener_t* listener = map_get(&tcp_table, &port);
+    if (listener == NULL)
+        return -1;
+    listener->rx_size = tcp_ring_round(rx_size);
+    listener->tx_size = tcp_ring_round(tx_size);
+    return 0;
+}
+
+/**
+ * @brief 向 port 注册一个 TCP 连接以及关联的回调函数
+ *        供应用层使用
+ *
+ * @param port
+ * @param handler
+ * @return int
+ */
+int tcp_open(uint16_t port, tcp_handler_t handler) {
+    return tcp_open_cc(port, handler, TCP_CC_DEFAULT);
+}
+
+/**
+ * @brief 分配一个环形缓冲区的存储空间，放得进一个buf_t的优先从缓冲池分配，
+ *        缓冲池用完（只有BUF_POOL_SIZE个）或放不下时用malloc，连接数不受缓冲池大小限制
+ *
+ * @param ring
+ * @param backing 来自缓冲池时存放对应的buf_t，否则设为NULL
+ * @param size 2的幂
+ * @return int 成功为0，内存不足为-1
+ */
+static int tcp_ring_alloc(tcp_ring_t* ring, buf_t** backing, uint32_t size) {
+    uint8_t* mem = NULL;
+    *backing = NULL;
+    if (size <= BUF_MAX_LEN) {
+        *backing = buf_pool_alloc(0);
+        if (*backing)
+            mem = (*backing)->payload;
+    }
+    if (mem == NULL)
+        mem = malloc(size);
+    if (mem == NULL)
+        return -1;
+    tcp_ring_init(ring, mem, size);
+    return 0;
+}
+
+/**
+ * @brief 释放环形缓冲区的存储空间，大小保留
+ *
+ * @param ring
+ * @param backing 来自缓冲池时对应的buf_t，释放后设为NULL
+ */
+static void tcp_ring_release(tcp_ring_t* ring, buf_t** backing) {
+    if (*backing)
+        buf_pool_free(*backing);
+    else
+        free(ring->data);
+    *backing = NULL;
+    ring->data = NULL;
+}
+
+/**
+ * @brief 三次握手完成时才分配接收、发送缓冲区，半连接只占用tcp_sock_t本身
+ *
+ * @param connect
+ * @return int 成功为0，缓冲池或内存用完时为-1
+ */
+static int tcp_alloc_buffers(tcp_connect_t* connect) {
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    if (tcp_ring_alloc(&sock->rx, &connect->rx_buf, tcp_ring_size(&sock->rx)) < 0)
+        return -1;
+    if (tcp_ring_alloc(&sock->tx, &connect->tx_buf, tcp_ring_size(&sock->tx)) < 0) {
+        tcp_ring_release(&sock->rx, &connect->rx_buf);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 初始化连接，状态切换为TCP_SYN_RCVD
+ *        接收、发送缓冲区是按listener指定的大小分配的环形缓冲区，回绕时不需要搬移数据，
+ *        这里只记下大小，由tcp_alloc_buffers在握手完成时分配。
+ *        回调函数也从listener取，主动打开时listener是tcp_connect临时填写的参数
+ *
+ * @param connect
+ * @param listener
+ */
+static void init_tcp_connect_rcvd(tcp_connect_t* connect, tcp_listener_t* listener) {
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    tcp_ring_init(&sock->rx, NULL, listener->rx_size);
+    tcp_ring_init(&sock->tx, NULL, listener->tx_size);
+    connect->rx_buf = connect->tx_buf = NULL;
+    sock->handler = listener->handler;
+    sock->srtt = sock->rttvar = 0;
+    sock->rto = TCP_RTO_INIT;
+    sock->rtt_start = 0;
+    sock->retries = 0;
+    sock->fin_queued = sock->fin_sent = 0;
+    sock->sack_ok = sock->ts_ok = 0;
+    sock->wscale_ok = sock->snd_wscale = sock->rcv_wscale = 0;
+    sock->ts_recent = 0;
+    sock->delack_segs = 0;
+    sock->ooo_count = 0;
+    sock->dupacks = sock->in_recovery = 0;
+    sock->sacked_count = 0;
+    for (int i = 0; i < TCP_TIMER_MAX; i++)
+        tcp_timer_clear(sock, i);
+    connect->state = TCP_SYN_RCVD;
+}
+
+/**
+ * @brief 半连接队列：被动打开、还在SYN_RCVD状态的连接，长度有限，SYN洪泛时也只占用有限的连接表项。
+ *        连接握手完成或被释放时由tcp_syn_backlog_remove让出槽位
+ */
+static struct {
+    uint8_t used;
+    uint32_t lru;           // 加入队列的先后
+    tcp_key_t key;
+} tcp_syn_backlog[TCP_SYN_BACKLOG];
+static uint32_t tcp_syn_backlog_clock;
+
+/**
+ * @brief 连接离开半连接队列
+ *
+ * @param sock
+ */
+static void tcp_syn_backlog_remove(tcp_sock_t* sock) {
+    if (sock->syn_slot == 0)
+        return;
+    tcp_syn_backlog[sock->syn_slot - 1].used = 0;
+    sock->syn_slot = 0;
+}
+
+/**
+ * @brief 释放TCP连接，这会释放分配的空间，并把状态变回LISTEN。
+ *        一般这个后边都会跟个map_delete(&connect_table, &key)把状态变回CLOSED
+ *
+ * @param connect
+ */
+static void release_tcp_connect(tcp_connect_t* connect) {
+    if (connect->state == TCP_LISTEN)
+        return;
+    tcp_syn_backlog_remove(TCP_SOCK(connect));
+    tcp_ring_release(&TCP_SOCK(connect)->rx, &connect->rx_buf);
+    tcp_ring_release(&TCP_SOCK(connect)->tx, &connect->tx_buf);
+    connect->state = TCP_LISTEN;
+}
+
+/**
+ * @brief 为一个新的半连接在队列中占一个槽位。队列满时，使用SYN cookie就不占槽位，
+ *        否则淘汰最早加入的半连接
+ *
+ * @param key 新连接的key，调用时还没有加入connect_table
+ * @return int 槽位下标，队列满、应该改用SYN cookie时为-1
+ */
+static int tcp_syn_backlog_add(tcp_key_t* key) {
+    int index = -1;
+    for (int i = 0; i < TCP_SYN_BACKLOG; i++) {
+        if (!tcp_syn_backlog[i].used) {
+            index = i;
+            break;
+        }
+        if (index < 0 || (int32_t)(tcp_syn_backlog[i].lru - tcp_syn_backlog[index].lru) < 0)
+            index = i;
+    }
+    if (tcp_syn_backlog[index].used) {
+        if (TCP_SYN_COOKIES)
+            return -1;
+        tcp_key_t victim = tcp_syn_backlog[index].key;
+        release_tcp_connect(map_get(&connect_table, &victim));
+        map_delete(&connect_table, &victim);
+        tcp_syn_stats.evicted++;
+    }
+    tcp_syn_backlog[index].used = 1;
+    tcp_syn_backlog[index].lru = tcp_syn_backlog_clock++;
+    tcp_syn_backlog[index].key = *key;
+    return index;
+}
+
+static uint16_t tcp_checksum(buf_t* buf, uint8_t* src_ip, uint8_t* dst_ip) {
+    uint16_t len = (uint16_t)buf->len;
+    tcp_peso_hdr_t* peso_hdr = (tcp_peso_hdr_t*)(buf->data - sizeof(tcp_peso_hdr_t));
+    tcp_peso_hdr_t pre; //暂存被覆盖的IP头
+    memcpy(&pre, peso_hdr, sizeof(tcp_peso_hdr_t));
+    memcpy(peso_hdr->src_ip, src_ip, NET_IP_LEN);
+    memcpy(peso_hdr->dst_ip, dst_ip, NET_IP_LEN);
+    peso_hdr->placeholder = 0;
+    peso_hdr->protocol = NET_PROTOCOL_TCP;
+    peso_hdr->total_len16 = swap16(len);
+    uint16_t checksum = checksum16((uint16_t*)peso_hdr, len + sizeof(tcp_peso_hdr_t));
+    memcpy(peso_hdr, &pre, sizeof(tcp_peso_hdr_t));
+    return checksum;
+}
+
+static _Thread_local uint16_t delete_port;
+
+/**
+ * @brief tcp_close使用这个函数来查找可以关闭的连接，使用thread-local变量delete_port传递端口号。
+ *
+ * @param key,value,timestamp
+ */
+static void close_port_fn(void* key, void* value, time_t* timestamp) {
+    tcp_key_t* tcp_key = key;
+    tcp_connect_t* connect = value;
+    if (tcp_key->dst_port == delete_port) {
+        release_tcp_connect(connect);
+    }
+}
+
+/**
+ * @brief 关闭 port 上的 TCP 连接
+ *        供应用层使用
+ *
+ * @param port
+ */
+void tcp_close(uint16_t port) {
+    delete_port = port;
+    map_foreach(&connect_table, close_port_fn);
+    map_delete(&tcp_table, &port);
+}
+
+/**
+ * @brief 把区间[left, right)合并进按序号排序、互不重叠的区间数组，与已有区间重叠或相邻时合并，
+ *        放不下时丢弃序号最大的区间。发送端的SACK记分板和接收端的乱序队列都用它
+ *
+ * @param range 区间数组
+ * @param count 区间个数
+ * @param max 数组能放的区间个数
+ * @param left
+ * @param right
+ */
+static void tcp_range_insert(uint32_t range[][2], uint8_t* count, int max, uint32_t left, uint32_t right) {
+    int i = 0;
+    while (i < *count && TCP_SEQ_LT(range[i][1], left))
+        i++;
+    int j = i;
+    while (j < *count && !TCP_SEQ_LT(right, range[j][0])) {
+        if (TCP_SEQ_LT(range[j][0], left))
+            left = range[j][0];
+        if (TCP_SEQ_LT(right, range[j][1]))
+            right = range[j][1];
+        j++;
+    }
+    // range[i, j)和新区间合并成一个，放在i处
+    if (i == j) {
+        if (i == max)
+            return;
+        int n = *count < max ? *count : max - 1;
+        memmove(range + i + 1, range + i, (n - i) * sizeof(range[0]));
+        *count = n + 1;
+    } else {
+        memmove(range + i + 1, range + j, (*count - j) * sizeof(range[0]));
+        *count -= j - i - 1;
+    }
+    range[i][0] = left;
+    range[i][1] = right;
+}
+
+/**
+ * @brief 从 buf 中读取数据到接收缓冲区，超出接收窗口放不下的部分丢弃。
+ *        乱序到达的数据和IP分片重组一样，已经直接写在rx中tail之后对应的位置，
+ *        如果填上了空洞，只需推进tail，紧接着的乱序数据就一起变成按序的
+ *
+ * @param connect
+ * @param buf
+ * @return uint16_t 变成按序的字节数，大于buf->len说明填上了空洞
+ */
+static uint16_t tcp_read_from_buf(tcp_connect_t* connect, buf_t* buf) {
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    size_t size = min32(buf->len, tcp_ring_free(&sock->rx));
+    tcp_ring_write_at(&sock->rx, 0, buf->data, size);
+    sock->rx.tail += size;
+    connect->ack += size;
+    while (sock->ooo_count && TCP_SEQ_LEQ(sock->ooo[0][0], connect->ack)) {
+        if (TCP_SEQ_LT(connect->ack, sock->ooo[0][1])) {
+            uint32_t more = sock->ooo[0][1] - connect->ack;
+            sock->rx.tail += more;
+            connect->ack += more;
+            size += more;
+        }
+        memmove(sock->ooo, sock->ooo + 1, --sock->ooo_count * sizeof(sock->ooo[0]));
+    }
+    return size;
+}
+
+/**
+ * @brief 把乱序到达的报文段放进乱序队列，只保留接收窗口以内的部分，
+ *        与已经收到的数据重叠的部分直接覆盖（内容相同）
+ *
+ * @param sock
+ * @param seq 报文段的序号，在connect->ack之后
+ * @param buf 报文段的数据
+ */
+static void tcp_ooo_in(tcp_sock_t* sock, uint32_t seq, buf_t* buf) {
+    uint32_t offset = seq - sock->connect.ack;
+    uint32_t wnd = tcp_ring_free(&sock->rx);
+    if (buf->len == 0 || offset >= wnd)
+        return;
+    size_t size = min32(buf->len, wnd - offset);
+    tcp_ring_write_at(&sock->rx, offset, buf->data, size);
+    tcp_range_insert(sock->ooo, &sock->ooo_count, TCP_OOO_MAX_RANGES, seq, seq + size);
+    sock->ooo_recent = seq;
+}
+
+/**
+ * @brief 解析TCP选项，不认识的选项跳过，长度不对时停止解析
+ *
+ * @param opt 选项开始的位置
+ * @param len 选项总长度
+ * @param out 解析结果
+ */
+static void tcp_parse_options(uint8_t* opt, size_t len, tcp_options_t* out) {
+    memset(out, 0, sizeof(tcp_options_t));
+    size_t i = 0;
+    while (i < len) {
+        uint8_t kind = opt[i];
+        if (kind == TCP_OPT_EOL)
+            break;
+        if (kind == TCP_OPT_NOP) {
+            i++;
+            continue;
+        }
+        if (i + 1 >= len || opt[i + 1] < 2 || i + opt[i + 1] > len)
+            break;
+        uint8_t olen = opt[i + 1];
+        switch (kind) {
+            case TCP_OPT_MSS:
+                if (olen == 4)
+                    out->mss = opt[i + 2] << 8 | opt[i + 3];
+                break;
+            case TCP_OPT_WSCALE:
+                if (olen == 3) {
+                    out->wscale_present = 1;
+                    out->wscale = opt[i + 2];
+                }
+                break;
+            case TCP_OPT_TIMESTAMP:
+                if (olen == 10) {
+                    uint32_t ts[2];
+                    memcpy(ts, opt + i + 2, sizeof(ts));
+                    out->ts_present = 1;
+                    out->ts_val = swap32(ts[0]);
+                    out->ts_ecr = swap32(ts[1]);
+                }
+                break;
+            case TCP_OPT_SACK_PERM:
+                out->sack_permitted = olen == 2;
+                break;
+            case TCP_OPT_SACK:
+                for (size_t j = 2; j + 8 <= olen && out->sack_count < TCP_MAX_SACK_BLOCKS; j += 8) {
+                    uint32_t edge[2];
+                    memcpy(edge, opt + i + j, sizeof(edge));
+                    out->sack[out->sack_count][0] = swap32(edge[0]);
+                    out->sack[out->sack_count][1] = swap32(edge[1]);
+                    out->sack_count++;
+                }
+                break;
+            default:
+                break;
+        }
+        i += olen;
+    }
+}
+
+/**
+ * @brief 生成要发送的报文段的选项，长度补齐到4字节的倍数。
+ *        时间戳总是放在最前面（NOP NOP TS），这样TSval、TSecr的位置固定，
+ *        不带数据的报文段可以增量更新校验和；SYN还要带上MSS、窗口缩放和SACK许可。
+ *        乱序队列不空时，不带数据的ACK报文段带上SACK块（RFC 2018），
+ *        第一个块是最近收到的乱序报文段所在的区间，其余按序号排列，放不下的省略；
+ *        带数据的报文段不带SACK块，否则会超过MSS
+ *
+ * @param sock
+ * @param flags 要发送的报文段的标志
+ * @param data_len 报文段的数据长度
+ * @param opt 选项写到这里，至少TCP_MAX_OPT_LEN字节
+ * @return uint8_t 选项长度
+ */
+static uint8_t tcp_build_options(tcp_sock_t* sock, tcp_flags_t flags, size_t data_len, uint8_t* opt) {
+    uint8_t len = 0;
+    if (sock->ts_ok) {
+        uint32_t tsval = tcp_now_ms();
+        if (sock->cookie_ts)
+            tsval = (tsval & ~TCP_COOKIE_TS_MASK) | sock->cookie_ts;
+        uint32_t ts[2] = {swap32(tsval), swap32(sock->ts_recent)};
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_TIMESTAMP;
+        opt[len++] = 10;
+        memcpy(opt + len, ts, sizeof(ts));
+        len += sizeof(ts);
+    }
+    if (!flags.syn && sock->sack_ok && sock->ooo_count && data_len == 0) {
+        int first = 0;
+        while (first < sock->ooo_count - 1 && !TCP_SEQ_LT(sock->ooo_recent, sock->ooo[first][1]))
+            first++;
+        int blocks = min32(sock->ooo_count, (TCP_MAX_OPT_LEN - len - 4) / 8);
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_SACK;
+        opt[len++] = 2 + 8 * blocks;
+        for (int b = 0, i = -1; b < blocks; b++, i++) {
+            if (i == first)
+                i++;
+            uint32_t* range = sock->ooo[b == 0 ? first : i];
+            uint32_t edge[2] = {swap32(range[0]), swap32(range[1])};
+            memcpy(opt + len, edge, sizeof(edge));
+            len += sizeof(edge);
+        }
+    }
+    if (!flags.syn)
+        return len;
+    uint16_t mss = TCP_ADV_MSS;
+    opt[len++] = TCP_OPT_MSS;
+    opt[len++] = 4;
+    opt[len++] = mss >> 8;
+    opt[len++] = mss & 0xFF;
+    if (sock->wscale_ok) {
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_WSCALE;
+        opt[len++] = 3;
+        opt[len++] = sock->rcv_wscale;
+    }
+    if (sock->sack_ok) {
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_SACK_PERM;
+        opt[len++] = 2;
+    }
+    return len;
+}
+
+/**
+ * @brief 报文段最大长度：不超过对端通告的MSS，保证不需要IP分片，
+ *        并扣除每个报文段都要带的时间戳选项
+ *
+ * @param connect
+ * @return uint16_t
+ */
+static uint16_t tcp_mss(tcp_connect_t* connect) {
+    uint16_t mss = ip_pmtu_get(connect->ip) - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t);
+    if (connect->remote_mss && connect->remote_mss < mss)
+        mss = connect->remote_mss;
+    if (TCP_SOCK(connect)->ts_ok)
+        mss -= TCP_TIMESTAMP_LEN;
+    return mss;
+}
+
+/**
+ * @brief “需要分片”报文引用的报文段是否属于一个存在的连接：
+ *        连接表中有(ip, remote_port, local_port)的连接，并且seq在[unack_seq, snd_max]之间
+ *
+ * @param ip 对端ip
+ * @param local_port 报文段的源端口
+ * @param remote_port 报文段的目的端口
+ * @param seq 报文段的序号
+ * @return int 属于为1
+ */
+int tcp_pmtu_match(uint8_t* ip, uint16_t local_port, uint16_t remote_port, uint32_t seq) {
+    if (!tcp_inited)
+        return 0;
+    tcp_key_t key = new_tcp_key(ip, remote_port, local_port);
+    tcp_connect_t* connect = map_get(&connect_table, &key);
+    if (connect == NULL)
+        return 0;
+    return TCP_SEQ_LEQ(connect->unack_seq, seq) && TCP_SEQ_LEQ(seq, TCP_SOCK(connect)->snd_max);
+}
+
+/**
+ * @brief 接收窗口：接收缓冲区中还能放下的字节数。
+ *        握手完成前缓冲区还没有分配，是整个缓冲区的大小；没有初始化的连接（如回复RST时）为0
+ *
+ * @param connect
+ * @return uint32_t
+ */
+static uint32_t tcp_rcv_wnd(tcp_connect_t* connect) {
+    tcp_ring_t* rx = &TCP_SOCK(connect)->rx;
+    return rx->mask ? tcp_ring_free(rx) : 0;
+}
+
+/**
+ * @brief 通告窗口的缩放因子：让整个接收缓冲区能用16位的窗口字段表示的最小值
+ *
+ * @param size 接收缓冲区大小
+ * @return uint8_t
+ */
+static uint8_t tcp_rcv_wscale(uint32_t size) {
+    uint8_t shift = 0;
+    while (shift < TCP_MAX_WSCALE && (size >> shift) > UINT16_MAX)
+        shift++;
+    return shift;
+}
+
+/**
+ * @brief 记录对端窗口（已经缩放）。connect->remote_win只有16位，超出时截断，仅供应用层参考
+ *
+ * @param sock
+ * @param window
+ */
+static void tcp_set_snd_wnd(tcp_sock_t* sock, uint32_t window) {
+    sock->snd_wnd = window;
+    sock->connect.remote_win = min32(window, UINT16_MAX);
+}
+
+/**
+ * @brief 根据对端SYN中的选项协商MSS、窗口缩放、时间戳和SACK，只启用双方的SYN中都有的选项。
+ *        主动打开时我们的SYN带上了所有打开的选项，所以被动、主动打开的协商结果一样
+ *
+ * @param sock
+ * @param opt 对端SYN的选项
+ */
+static void tcp_syn_negotiate(tcp_sock_t* sock, tcp_options_t* opt) {
+    sock->sack_ok = TCP_SACK_ENABLE && opt->sack_permitted;
+    sock->ts_ok = TCP_TIMESTAMP_ENABLE && opt->ts_present;
+    sock->ts_recent = opt->ts_val;
+    sock->wscale_ok = TCP_WSCALE_ENABLE && opt->wscale_present;
+    sock->snd_wscale = sock->wscale_ok ? min32(opt->wscale, TCP_MAX_WSCALE) : 0;
+    sock->rcv_wscale = sock->wscale_ok ? tcp_rcv_wscale(tcp_ring_size(&sock->rx)) : 0;
+    sock->connect.remote_mss = opt->mss ? opt->mss : TCP_DEFAULT_MSS;
+}
+
+/**
+ * @brief 把发送缓冲区中还没发送的数据写入到buf里面供tcp_send使用，buf原来的内容会无效。
+ *        报文段大小不超过路径MTU，也不超过对端窗口和拥塞窗口中还没被占用的部分。
+ *        对端窗口为0且没有数据在途时允许发送1字节，作为零窗口探测。
+ *
+ * @param connect
+ * @param buf
+ * @return uint16_t 字节数
+ */
+static uint16_t tcp_write_to_buf(tcp_connect_t* connect, buf_t* buf) {
+    uint32_t sent = connect->next_seq - connect->unack_seq;
+    uint32_t limit = min32(TCP_SOCK(connect)->snd_wnd, TCP_SOCK(connect)->cc.cwnd);
+    uint32_t wnd = limit > sent ? limit - sent : 0;
+    if (TCP_SOCK(connect)->snd_wnd == 0 && sent == 0)
+        wnd = 1;
+    tcp_ring_t* tx = &TCP_SOCK(connect)->tx;
+    uint32_t unsent = tcp_ring_used(tx) - sent;
+    uint16_t size = min32(min32(unsent, wnd), tcp_mss(connect));
+    // 避免发送方的糊涂窗口综合症（RFC 1122 4.2.3.4）：数据够一个MSS而窗口不够时，
+    // 有在途数据就等ACK把窗口打开，否则CUBIC等每次只增加几个字节的窗口会被拆成大量小报文段
+    if (size < tcp_mss(connect) && size < unsent && sent > 0)
+        size = 0;
+    buf_init(buf, size);
+    tcp_ring_peek_at(tx, sent, buf->data, size);
+    connect->next_seq += size;
+    return size;
+}
+
+/**
+ * @brief 上一个不带数据的TCP报文（纯ACK等）的首部和目的ip。
+ *        同一连接的下一个不带数据的报文通常只有seq、ack、窗口和时间戳不同，
+ *        校验和可以在它的基础上增量更新，不必重新计算伪首部和整个首部
+ */
+static tcp_hdr_t bare_hdr_cache;
+static uint8_t bare_opt_cache[TCP_MAX_OPT_LEN];
+static uint8_t bare_ip_cache[NET_IP_LEN];
+static int bare_cache_valid = 0;
+
+/**
+ * @brief 选项是否以tcp_build_options生成的时间戳开头。
+ *        时间戳每个报文段都不同，和seq、ack一样增量更新，比较选项时跳过
+ *
+ * @param opt
+ * @param len
+ * @return int
+ */
+static int tcp_ts_cached(uint8_t* opt, size_t len) {
+    return len >= TCP_TIMESTAMP_LEN && opt[2] == TCP_OPT_TIMESTAMP;
+}
+
+/**
+ * @brief 判断hdr能否在bare_hdr_cache的基础上增量计算校验和
+ *
+ * @param hdr 已填好除校验和外所有字段的TCP首部，选项紧跟在后面
+ * @param ip 目的ip
+ * @return int 可以为1，否则为0
+ */
+static int tcp_bare_cache_match(tcp_hdr_t* hdr, uint8_t* ip) {
+    tcp_hdr_t* last = &bare_hdr_cache;
+    uint8_t* opt = (uint8_t*)(hdr + 1);
+    size_t opt_len = hdr->data_offset * 4 - sizeof(tcp_hdr_t);
+    int ts = tcp_ts_cached(opt, opt_len);
+    return bare_cache_valid &&
+        last->src_port16 == hdr->src_port16 &&
+        last->dst_port16 == hdr->dst_port16 &&
+        last->data_offset == hdr->data_offset &&
+        memcmp(&last->flags, &hdr->flags, sizeof(tcp_flags_t)) == 0 &&
+        memcmp(bare_opt_cache, opt, ts ? 4 : opt_len) == 0 &&
+        (!ts || memcmp(bare_opt_cache + TCP_TIMESTAMP_LEN, opt + TCP_TIMESTAMP_LEN,
+            opt_len - TCP_TIMESTAMP_LEN) == 0) &&
+        memcmp(bare_ip_cache, ip, NET_IP_LEN) == 0;
+}
+
+/**
+ * @brief 以指定的序号发送TCP包，不改变connect的发送状态，重传时使用
+ *
+ * @param buf
+ * @param connect
+ * @param flags
+ * @param seq 第一个字节（或SYN、FIN）的序号
+ */
+static void tcp_send_seq(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags, uint32_t seq) {
+    // printf("<< tcp send >> sz=%zu\n", buf->len);
+    display_flags(flags);
+    size_t prev_len = buf->len;
+    // 每个报文段都带着确认号，等待中的延迟确认不用再单独发了
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    if (prev_len > 0 && sock->last_ack_sent != connect->ack)
+        tcp_ack_stats.piggybacked++;
+    sock->last_ack_sent = connect->ack;
+    sock->delack_segs = 0;
+    tcp_timer_clear(sock, TCP_TIMER_DELACK);
+    uint8_t opt[TCP_MAX_OPT_LEN];
+    uint8_t opt_len = tcp_build_options(sock, flags, prev_len, opt);
+    buf_add_header(buf, sizeof(tcp_hdr_t) + opt_len);
+    tcp_hdr_t* hdr = (tcp_hdr_t*)buf->data;
+    memcpy(hdr + 1, opt, opt_len);
+    hdr->src_port16 = swap16(connect->local_port);
+    hdr->dst_port16 = swap16(connect->remote_port);
+    hdr->seq_number32 = swap32(seq);
+    hdr->ack_number32 = swap32(connect->ack);
+    hdr->data_offset = (sizeof(tcp_hdr_t) + opt_len) / sizeof(uint32_t);
+    hdr->reserved = 0;
+    hdr->flags = flags;
+    uint32_t wnd = tcp_rcv_wnd(connect);
+    uint8_t shift = flags.syn ? 0 : sock->rcv_wscale;  // SYN中的窗口不缩放
+    wnd = min32(wnd >> shift, UINT16_MAX);
+    hdr->window_size16 = swap16(wnd);
+    sock->rcv_wnd_adv = wnd << shift;
+    hdr->chunksum16 = 0;
+    hdr->urgent_pointer16 = 0;
+    if (prev_len == 0 && tcp_bare_cache_match(hdr, connect->ip)) {
+        tcp_hdr_t* last = &bare_hdr_cache;
+        uint16_t checksum = checksum16_update32(last->chunksum16, last->seq_number32, hdr->seq_number32);
+        checksum = checksum16_update32(checksum, last->ack_number32, hdr->ack_number32);
+        checksum = checksum16_update(checksum, last->window_size16, hdr->window_size16);
+        if (tcp_ts_cached(opt, opt_len)) {
+            uint32_t ts[4];
+            memcpy(ts, bare_opt_cache + 4, 8);
+            memcpy(ts + 2, opt + 4, 8);
+            checksum = checksum16_update32(checksum, ts[0], ts[2]);
+            checksum = checksum16_update32(checksum, ts[1], ts[3]);
+        }
+        hdr->chunksum16 = checksum;
+    } else {
+        hdr->chunksum16 = tcp_checksum(buf, connect->ip, net_if_ip);
+    }
+    if (prev_len == 0) {
+        bare_hdr_cache = *hdr;
+        memcpy(bare_opt_cache, opt, opt_len);
+        memcpy(bare_ip_cache, connect->ip, NET_IP_LEN);
+        bare_cache_valid = 1;
+    }
+    ip_out(buf, connect->ip, NET_PROTOCOL_TCP);
+}
+
+/**
+ * @brief 发送TCP包, seq_number32 = connect->next_seq - buf->len
+ *        buf里的数据将作为负载，加上tcp头发送出去。如果flags包含syn或fin，seq会递增。
+ *        占用序号的报文会启动重传定时器；发送的是新数据且没有正在测量的报文段时开始测量RTT，
+ *        超时后重发的数据不测量（Karn算法）。
+ *
+ * @param buf
+ * @param connect
+ * @param flags
+ */
+static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    int occupy = buf->len > 0 || flags.syn || flags.fin;
+    tcp_send_seq(buf, connect, flags, connect->next_seq - buf->len);
+    if (flags.syn || flags.fin) {
+        connect->next_seq += 1;
+    }
+    if (occupy && !flags.rst) {
+        if (sock->timer[TCP_TIMER_RTO] == 0)
+            tcp_timer_set(sock, TCP_TIMER_RTO, sock->rto);
+        if (TCP_SEQ_LT(sock->snd_max, connect->next_seq)) {
+            if (sock->rtt_start == 0) {
+                sock->rtt_start = tcp_now_ms();
+                sock->rtt_seq = connect->next_seq;
+            }
+            sock->snd_max = connect->next_seq;
+        }
+    }
+}
+
+/**
+ * @brief 按序收到数据后安排确认。已经有报文段带上了最新的确认号（如回调函数里发出的数据）就不用再发；
+ *        否则每TCP_DELACK_SEGS个报文段或需要立即确认时发送纯ACK，其余的交给延迟确认定时器
+ *
+ * @param sock
+ * @param quick 需要立即确认，如数据超出了接收窗口、填上了空洞
+ */
+static void tcp_ack_schedule(tcp_sock_t* sock, int quick) {
+    tcp_connect_t* connect = &sock->connect;
+    tcp_ack_stats.segs++;
+    if (sock->last_ack_sent == connect->ack)
+        return;
+    if (quick || ++sock->delack_segs >= TCP_DELACK_SEGS) {
+        tcp_ack_stats.quick++;
+        buf_init(&txbuf, 0);
+        tcp_send(&txbuf, connect, tcp_flags_ack);
+        return;
+    }
+    if (sock->timer[TCP_TIMER_DELACK] == 0)
+        tcp_timer_set(sock, TCP_TIMER_DELACK, TCP_DELACK_MS);
+}
+
+/**
+ * @brief 重传从unack_seq开始的第一个报文段。
+ *        SYN_SENT状态下重传SYN，SYN_RCVD状态下重传SYN+ACK；FIN已发送且落在这个报文段内时一起重传FIN
+ *
+ * @param sock
+ * @return uint16_t 重传的数据字节数
+ */
+static uint16_t tcp_retransmit(tcp_sock_t* sock) {
+    tcp_connect_t* connect = &sock->connect;
+    sock->rtt_start = 0;
+    if (connect->state == TCP_SYN_SENT || connect->state == TCP_SYN_RCVD) {
+        buf_init(&txbuf, 0);
+        tcp_flags_t flags = connect->state == TCP_SYN_SENT ? tcp_flags_syn : tcp_flags_ack_syn;
+        tcp_send_seq(&txbuf, connect, flags, connect->unack_seq);
+        return 0;
+    }
+    // FIN也已经被确认，没有要重传的；否则下面减去fin_sent会回绕成一个很大的长度
+    if (TCP_SEQ_LEQ(connect->next_seq, connect->unack_seq))
+        return 0;
+    uint32_t data = connect->next_seq - connect->unack_seq - sock->fin_sent;
+    uint16_t size = min32(data, tcp_mss(connect));
+    if (size == 0 && !sock->fin_sent)
+        return 0;
+    buf_init(&txbuf, size);
+    tcp_ring_peek_at(&sock->tx, 0, txbuf.data, size);
+    tcp_flags_t flags = sock->fin_sent && size == data ? tcp_flags_ack_fin : tcp_flags_ack;
+    tcp_send_seq(&txbuf, connect, flags, connect->unack_seq);
+    return size;
+}
+
+/**
+ * @brief 在对端窗口允许的范围内把发送缓冲区中还没发送的数据都发送出去，
+ *        数据发完并且需要关闭时再发送FIN
+ *
+ * @param sock
+ * @return int 发送的报文段个数
+ */
+static int tcp_output(tcp_sock_t* sock) {
+    tcp_connect_t* connect = &sock->connect;
+    if (connect->state != TCP_ESTABLISHED && connect->state != TCP_FIN_WAIT_1 &&
+        connect->state != TCP_LAST_ACK)
+        return 0;
+    int segs = 0;
+    while (!sock->fin_sent) {
+        uint16_t size = tcp_write_to_buf(connect, &txbuf);
+        int drained = connect->next_seq - connect->unack_seq == tcp_ring_used(&sock->tx);
+        if (size == 0 && !(drained && sock->fin_queued))
+            break;
+        tcp_flags_t flags = tcp_flags_ack;
+        if (drained && sock->fin_queued) {
+            flags = tcp_flags_ack_fin;
+            sock->fin_sent = 1;
+        }
+        tcp_send(&txbuf, connect, flags);
+        segs++;
+    }
+    return segs;
+}
+
+/**
+ * @brief 去掉SACK记分板中已经被累计确认的部分
+ *
+ * @param sock
+ */
+static void tcp_sack_trim(tcp_sock_t* sock) {
+    uint32_t una = sock->connect.unack_seq;
+    int k = 0;
+    for (int i = 0; i < sock->sacked_count; i++) {
+        if (TCP_SEQ_LEQ(sock->sacked[i][1], una))
+            continue;
+        sock->sacked[k][0] = TCP_SEQ_LT(sock->sacked[i][0], una) ? una : sock->sacked[i][0];
+        sock->sacked[k][1] = sock->sacked[i][1];
+        k++;
+    }
+    sock->sacked_count = k;
+}
+
+/**
+ * @brief 把收到的SACK块合并进记分板，记分板保持有序、互不重叠，
+ *        放不下时丢弃序号最大的区间（只会导致多重传一些数据）
+ *
+ * @param sock
+ * @param opt 收到的选项
+ */
+static void tcp_sack_update(tcp_sock_t* sock, tcp_options_t* opt) {
+    uint32_t una = sock->connect.unack_seq;
+    for (int b = 0; b < opt->sack_count; b++) {
+        uint32_t left = opt->sack[b][0], right = opt->sack[b][1];
+        // 不合法、已经被累计确认（D-SACK）或超出发送范围的块
+        if (!TCP_SEQ_LT(left, right) || !TCP_SEQ_LT(una, right) || TCP_SEQ_LT(sock->snd_max, right))
+            continue;
+        if (TCP_SEQ_LT(left, una))
+            left = una;
+        tcp_range_insert(sock->sacked, &sock->sacked_count, TCP_SACK_SCOREBOARD, left, right);
+    }
+}
+
+/**
+ * @brief 处理对端的确认号：去掉发送缓冲区中已被确认的数据，更新unack_seq，并维护重传定时器。
+ *        协商了时间戳时用回显的TSecr测量RTT，每个确认了新数据的ACK都是一个样本；
+ *        否则用被确认的测量报文段更新RTT（Karn算法：重传过的报文段不测量）
+ *
+ * @param sock
+ * @param ack_num 确认号
+ * @param opt 报文段的选项
+ * @return uint32_t 新确认的序号个数，为0表示没有确认新的序号
+ */
+static uint32_t tcp_ack_update(tcp_sock_t* sock, uint32_t ack_num, tcp_options_t* opt) {
+    tcp_connect_t* connect = &sock->connect;
+    if (!TCP_SEQ_LT(connect->unack_seq, ack_num) || TCP_SEQ_LT(sock->snd_max, ack_num))
+        return 0;
+    uint32_t acked = ack_num - connect->unack_seq;
+    tcp_ring_consume(&sock->tx, acked);
+    connect->unack_seq = ack_num;
+    tcp_sack_trim(sock);
+    // 超时退回后，对端确认了退回之前发出的数据
+    if (TCP_SEQ_LT(connect->next_seq, ack_num))
+        connect->next_seq = ack_num;
+    if (sock->ts_ok && opt->ts_present && opt->ts_ecr) {
+        tcp_rtt_sample(sock, (uint32_t)tcp_now_ms() - opt->ts_ecr);
+        sock->rtt_start = 0;
+    } else if (sock->rtt_start && TCP_SEQ_LEQ(sock->rtt_seq, ack_num)) {
+        tcp_rtt_sample(sock, tcp_now_ms() - sock->rtt_start);
+        sock->rtt_start = 0;
+    }
+    sock->retries = 0;
+    if (connect->unack_seq == sock->snd_max)
+        tcp_timer_clear(sock, TCP_TIMER_RTO);
+    else
+        tcp_timer_set(sock, TCP_TIMER_RTO, sock->rto);
+    return acked;
+}
+
+/**
+ * @brief 我们发出的FIN是否已经被确认
+ *
+ * @param sock
+ * @return int
+ */
+static int tcp_fin_acked(tcp_sock_t* sock) {
+    return sock->fin_sent && sock->connect.unack_seq == sock->snd_max;
+}
+
+/**
+ * @brief 快速恢复中重传下一个空洞：从rexmit_next开始跳过已被SACK的区间，
+ *        最多重传到下一个SACK块的左边界，且不超过一个MSS。
+ *        没有SACK信息时（NewReno）只重传unack_seq处的报文段，每次部分确认重传一次
+ *
+ * @param sock
+ * @return int 重传了报文段为1，没有空洞可重传为0
+ */
+static int tcp_retransmit_hole(tcp_sock_t* sock) {
+    tcp_connect_t* connect = &sock->connect;
+    if (TCP_SEQ_LT(sock->rexmit_next, connect->unack_seq))
+        sock->rexmit_next = connect->unack_seq;
+    if (sock->sacked_count == 0) {
+        if (sock->rexmit_next != connect->unack_seq)
+            return 0;
+        sock->rexmit_next = connect->unack_seq + tcp_retransmit(sock);
+        return 1;
+    }
+    uint32_t seq = sock->rexmit_next;
+    uint32_t end = sock->sacked[sock->sacked_count - 1][1];
+    for (int i = 0; i < sock->sacked_count; i++) {
+        if (TCP_SEQ_LT(seq, sock->sacked[i][0])) {
+            end = sock->sacked[i][0];
+            break;
+        }
+        if (TCP_SEQ_LT(seq, sock->sacked[i][1]))
+            seq = sock->sacked[i][1];
+    }
+    uint32_t offset = seq - connect->unack_seq;
+    if (!TCP_SEQ_LT(seq, end) || offset >= tcp_ring_used(&sock->tx))
+        return 0;
+    uint16_t size = min32(min32(end - seq, tcp_mss(connect)), tcp_ring_used(&sock->tx) - offset);
+    buf_init(&txbuf, size);
+    tcp_ring_peek_at(&sock->tx, offset, txbuf.data, size);
+    tcp_send_seq(&txbuf, connect, tcp_flags_ack, seq);
+    sock->rexmit_next = seq + size;
+    if (sock->rtt_start && TCP_SEQ_LT(seq, sock->rtt_seq))
+        sock->rtt_start = 0;
+    return 1;
+}
+
+/**
+ * @brief 处理收到的报文段中的ACK：更新unack_seq、SACK记分板和对端窗口，并识别重复ACK。
+ *        第TCP_DUPACK_THRESHOLD个重复ACK触发快速重传并进入快速恢复，
+ *        恢复期间每个部分确认（以及SACK时的每个重复ACK）重传下一个空洞，确认到recover时退出（RFC 6582）。
+ *        快速恢复期间的拥塞窗口膨胀和收缩在这里处理，其余时候新确认的数据交给拥塞控制算法
+ *
+ * @param sock
+ * @param ack_num 确认号
+ * @param window 对端窗口，已经缩放
+ * @param seg_len 报文段负载长度
+ * @param flags 报文段的标志
+ * @param opt 报文段的选项
+ */
+static void tcp_ack_in(tcp_sock_t* sock, uint32_t ack_num, uint32_t window, size_t seg_len,
+    tcp_flags_t flags, tcp_options_t* opt) {
+    tcp_connect_t* connect = &sock->connect;
+    tcp_cc_t* cc = &sock->cc;
+    uint32_t in_flight = sock->snd_max - connect->unack_seq;
+    int dup = ack_num == connect->unack_seq && connect->unack_seq != sock->snd_max &&
+        seg_len == 0 && !flags.syn && !flags.fin && window == sock->snd_wnd;
+    uint32_t acked = tcp_ack_update(sock, ack_num, opt);
+    if (sock->sack_ok)
+        tcp_sack_update(sock, opt);
+    tcp_set_snd_wnd(sock, window);
+    if (window == 0)
+        sock->retries = 0;  // 零窗口探测有回应，说明对端还在
+
+    if (acked) {
+        sock->dupacks = 0;
+        in_flight = sock->snd_max - connect->unack_seq;
+        if (!sock->in_recovery) {
+            cc->ops->on_ack(cc, acked, in_flight, tcp_now_ms());
+        } else if (TCP_SEQ_LT(ack_num, sock->recover)) {
+            // 部分确认：收回被确认的数据占用的窗口，再为重传留出一个报文段
+            cc->cwnd = (cc->cwnd > acked ? cc->cwnd - acked : 0) + cc->mss;
+            tcp_retransmit_hole(sock);
+        } else {
+            sock->in_recovery = 0;
+            cc->cwnd = min32(cc->ssthresh, in_flight + cc->mss);
+        }
+        return;
+    }
+    if (!dup)
+        return;
+    sock->dupacks++;
+    if (sock->in_recovery) {
+        // 每个重复ACK说明有一个报文段离开了网络
+        cc->cwnd += cc->mss;
+        if (sock->sack_ok)
+            tcp_retransmit_hole(sock);
+        return;
+    }
+    if (sock->dupacks == TCP_DUPACK_THRESHOLD) {
+        cc->ops->on_loss(cc, in_flight, 0, tcp_now_ms());
+        cc->cwnd = cc->ssthresh + TCP_DUPACK_THRESHOLD * cc->mss;
+        sock->in_recovery = 1;
+        sock->recover = sock->snd_max;
+        sock->rexmit_next = connect->unack_seq;
+        tcp_retransmit_hole(sock);
+    }
+}
+
+/**
+ * @brief 从外部关闭一个TCP连接, 会发送剩余数据
+ *        供应用层使用
+ *
+ * @param connect
+ */
+void tcp_connect_close(tcp_connect_t* connect) {
+    if (connect->state == TCP_ESTABLISHED) {
+        TCP_SOCK(connect)->fin_queued = 1;
+        connect->state = TCP_FIN_WAIT_1;
+        tcp_output(TCP_SOCK(connect));
+        return;
+    }
+    tcp_key_t key = new_tcp_key(connect->ip, connect->remote_port, connect->local_port);
+    release_tcp_connect(connect);
+    map_delete(&connect_table, &key);
+}
+
+/**
+ * @brief 应用层取走数据后接收窗口变大，变大到原来通告的两倍以上、且增加了至少一个MSS
+ *        （缓冲区较小时为一半缓冲区）时发送窗口更新，避免对端一直等待零窗口探测（RFC 1122 接收端糊涂窗口避免）
+ *
+ * @param sock
+ */
+static void tcp_rcv_wnd_update(tcp_sock_t* sock) {
+    tcp_connect_t* connect = &sock->connect;
+    if (connect->state != TCP_ESTABLISHED)
+        return;
+    uint32_t wnd = tcp_rcv_wnd(connect);
+    uint32_t step = min32(tcp_ring_size(&sock->rx) / 2, TCP_ADV_MSS);
+    if (wnd < 2 * sock->rcv_wnd_adv || wnd - sock->rcv_wnd_adv < step)
+        return;
+    buf_init(&txbuf, 0);
+    tcp_send(&txbuf, connect, tcp_flags_ack);
+}
+
+/**
+ * @brief 从 connect 中读取数据到 buf，返回成功的字节数。
+ *        供应用层使用
+ *
+ * @param connect
+ * @param data
+ * @param len
+ * @return size_t
+ */
+size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len) {
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    size_t size = tcp_ring_read(&sock->rx, data, len);
+    tcp_rcv_wnd_update(sock);
+    return size;
+}
+
+/**
+ * @brief 从 connect 中读取数据，依次填满iov中的各段，返回读取的字节数。
+ *        供应用层使用
+ *
+ * @param connect
+ * @param iov
+ * @param iovcnt
+ * @return size_t
+ */
+size_t tcp_connect_readv(tcp_connect_t* connect, const struct iovec* iov, int iovcnt) {
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    size_t size = 0;
+    for (int i = 0; i < iovcnt && tcp_ring_used(&sock->rx); i++)
+        size += tcp_ring_read(&sock->rx, iov[i].iov_base, iov[i].iov_len);
+    tcp_rcv_wnd_update(sock);
+    return size;
+}
+
+/**
+ * @brief 不拷贝地查看 connect 中已经收到的数据：iov指向接收缓冲区内部，
+ *        数据在缓冲区中回绕时分成两段。看完后用tcp_connect_consume丢弃用过的部分。
  *        供应用层使用
  *
+ * @param connect
+ * @param iov 至少2个元素
+ * @return int 段数，没有数据时为0
  */
-void tcp_init() {
-    map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_handler_t), 0, 0, NULL);
-    map_init(&connect_table, sizeof(tcp_key_t), sizeof(tcp_connect_t), 0, 0, NULL);
-    net_add_protocol(NET_PROTOCOL_TCP, tcp_in);
+int tcp_connect_peek(tcp_connect_t* connect, struct iovec* iov) {
+    tcp_ring_t* rx = &TCP_SOCK(connect)->rx;
+    return tcp_ring_iov(rx, rx->head, tcp_ring_used(rx), iov);
 }
 
 /**
- * @brief 向 port 注册一个 TCP 连接以及关联的回调函数
+ * @brief 丢弃 connect 中开头的len字节数据，一般在tcp_connect_peek之后调用。
  *        供应用层使用
  *
- * @param port
- * @param handler
- * @return int
+ * @param connect
+ * @param len
  */
-int tcp_open(uint16_t port, tcp_handler_t handler) {
-    printf("tcp open\n");
-    return map_set(&tcp_table, &port, &handler);
+void tcp_connect_consume(tcp_connect_t* connect, size_t len) {
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    tcp_ring_consume(&sock->rx, len);
+    tcp_rcv_wnd_update(sock);
 }
 
 /**
- * @brief 完成了缓存分配工作，状态也会切换为TCP_SYN_RCVD
- *        rx_buf和tx_buf在触及边界时会把数据重新移动到头部，防止溢出。
+ * @brief 往connect的发送缓冲区里面写东西，返回成功的字节数。
+ *        发送缓冲区放不下时只写入能放下的部分，实际发送受对端窗口限制，由tcp_output完成，
+ *        没被确认的数据一直留在发送缓冲区中，丢失时从unack_seq开始重传。
+ *        供应用层使用
  *
  * @param connect
+ * @param data
+ * @param len
  */
-static void init_tcp_connect_rcvd(tcp_connect_t* connect) {
-    if (connect->state == TCP_LISTEN) {
-        connect->rx_buf = malloc(sizeof(buf_t));
-        connect->tx_buf = malloc(sizeof(buf_t));
-    }
-    buf_init(connect->rx_buf, 0);
-    buf_init(connect->tx_buf, 0);
-    connect->state = TCP_SYN_RCVD;
+size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len) {
+    // printf("tcp_connect_write size: %zu\n", len);
+    size_t size = tcp_ring_write(&TCP_SOCK(connect)->tx, data, len);
+    tcp_output(TCP_SOCK(connect));
+    return size;
 }
 
 /**
- * @brief 释放TCP连接，这会释放分配的空间，并把状态变回LISTEN。
- *        一般这个后边都会跟个map_delete(&connect_table, &key)把状态变回CLOSED
+ * @brief 把iov中的各段依次写入connect的发送缓冲区，放不下时只写入能放下的部分，
+ *        所有数据写完后才调用一次tcp_output，小段不会各自成为一个报文段。
+ *        供应用层使用
  *
  * @param connect
+ * @param iov
+ * @param iovcnt
+ * @return size_t 写入的字节数
  */
-static void release_tcp_connect(tcp_connect_t* connect) {
-    if (connect->state == TCP_LISTEN)
-        return;
-    free(connect->rx_buf);
-    free(connect->tx_buf);
-    connect->state = TCP_LISTEN;
+size_t tcp_connect_writev(tcp_connect_t* connect, const struct iovec* iov, int iovcnt) {
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    size_t size = 0;
+    for (int i = 0; i < iovcnt && tcp_ring_free(&sock->tx); i++)
+        size += tcp_ring_write(&sock->tx, iov[i].iov_base, iov[i].iov_len);
+    tcp_output(sock);
+    return size;
 }
 
-static uint16_t tcp_checksum(buf_t* buf, uint8_t* src_ip, uint8_t* dst_ip) {
-    uint16_t len = (uint16_t)buf->len;
-    tcp_peso_hdr_t* peso_hdr = (tcp_peso_hdr_t*)(buf->data - sizeof(tcp_peso_hdr_t));
-    tcp_peso_hdr_t pre; //暂存被覆盖的IP头
-    memcpy(&pre, peso_hdr, sizeof(tcp_peso_hdr_t));
-    memcpy(peso_hdr->src_ip, src_ip, NET_IP_LEN);
-    memcpy(peso_hdr->dst_ip, dst_ip, NET_IP_LEN);
-    peso_hdr->placeholder = 0;
-    peso_hdr->protocol = NET_PROTOCOL_TCP;
-    peso_hdr->total_len16 = swap16(len);
-    uint16_t checksum = checksum16((uint16_t*)peso_hdr, len + sizeof(tcp_peso_hdr_t));
-    memcpy(peso_hdr, &pre, sizeof(tcp_peso_hdr_t));
-    return checksum;
+/**
+ * @brief 把连接挂到它到期时刻对应的时间轮槽上
+ *
+ * @param index 连接在tcp_tw中的下标
+ */
+static void tcp_tw_wheel_link(int32_t index) {
+    tcp_tw_t* tw = &tcp_tw[index];
+    tw->wheel_slot = tw->expire & (TCP_TW_WHEEL_SLOTS - 1);
+    tw->wheel_prev = -1;
+    tw->wheel_next = tcp_tw_wheel[tw->wheel_slot];
+    if (tw->wheel_next >= 0)
+        tcp_tw[tw->wheel_next].wheel_prev = index;
+    tcp_tw_wheel[tw->wheel_slot] = index;
 }
 
-static _Thread_local uint16_t delete_port;
+/**
+ * @brief 把提前结束的连接从时间轮上摘下并放回空闲链表，表项马上可以给新的TIME_WAIT连接用
+ *
+ * @param tw 已经从哈希表中摘下
+ */
+static void tcp_tw_release(tcp_tw_t* tw) {
+    if (tw->wheel_prev >= 0)
+        tcp_tw[tw->wheel_prev].wheel_next = tw->wheel_next;
+    else
+        tcp_tw_wheel[tw->wheel_slot] = tw->wheel_next;
+    if (tw->wheel_next >= 0)
+        tcp_tw[tw->wheel_next].wheel_prev = tw->wheel_prev;
+    tw->hash_next = tcp_tw_free;
+    tcp_tw_free = tw - tcp_tw;
+}
+
+static uint32_t tcp_tw_expire() {
+    return (tcp_now_ms() + TCP_TIME_WAIT_MS + TCP_TW_TICK_MS - 1) / TCP_TW_TICK_MS;
+}
 
 /**
- * @brief tcp_close使用这个函数来查找可以关闭的连接，使用thread-local变量delete_port传递端口号。
+ * @brief 连接进入TIME_WAIT：把回复ACK需要的字段存进TIME_WAIT表，之后由调用者释放连接。
+ *        表满时不保留，直接关闭
  *
- * @param key,value,timestamp
+ * @param sock 已经确认了对方的FIN
+ * @param key
  */
-static void close_port_fn(void* key, void* value, time_t* timestamp) {
-    tcp_key_t* tcp_key = key;
-    tcp_connect_t* connect = value;
-    if (tcp_key->dst_port == delete_port) {
-        release_tcp_connect(connect);
+static void tcp_tw_enter(tcp_sock_t* sock, tcp_key_t* key) {
+    if (tcp_tw_free < 0) {
+        tcp_tw_stats.overflow++;
+        return;
     }
+    int32_t index = tcp_tw_free;
+    tcp_tw_t* tw = &tcp_tw[index];
+    tcp_tw_free = tw->hash_next;
+    tw->key = *key;
+    tw->snd_nxt = sock->snd_max;
+    tw->rcv_nxt = sock->connect.ack;
+    tw->ts_recent = sock->ts_recent;
+    tw->ts_ok = sock->ts_ok;
+    tw->used = 1;
+    size_t bucket = tcp_tw_hash(key);
+    tw->hash_next = tcp_tw_bucket[bucket];
+    tcp_tw_bucket[bucket] = index;
+    tw->expire = tcp_tw_expire();
+    tcp_tw_wheel_link(index);
+    tcp_tw_stats.entered++;
 }
 
 /**
- * @brief 关闭 port 上的 TCP 连接
- *        供应用层使用
+ * @brief 处理发给TIME_WAIT连接的报文段（RFC 9293 3.10.7.4）：
+ *        （1）RST忽略，不让它提前结束TIME_WAIT（RFC 1337）
+ *        （2）SYN的时间戳比记录的新，不会是旧连接的报文段，提前结束TIME_WAIT，按新连接处理（RFC 6191）
+ *        （3）其他带SYN、FIN或数据的报文段回复ACK；对方重传FIN说明我们的ACK丢了，重新开始2MSL计时
  *
- * @param port
+ * @param tw
+ * @param flags
+ * @param opt
+ * @param len 数据长度
+ * @return int 提前结束了TIME_WAIT，报文段要按新连接处理时为1
  */
-void tcp_close(uint16_t port) {
-    delete_port = port;
-    map_foreach(&connect_table, close_port_fn);
-    map_delete(&tcp_table, &port);
+static int tcp_tw_in(tcp_tw_t* tw, tcp_flags_t flags, tcp_options_t* opt, size_t len) {
+    if (flags.rst)
+        return 0;
+    if (flags.syn && !flags.ack && tw->ts_ok && opt->ts_present && TCP_SEQ_LT(tw->ts_recent, opt->ts_val)) {
+        tcp_tw_unhash(tw);
+        tcp_tw_release(tw);
+        tcp_tw_stats.reused++;
+        return 1;
+    }
+    if (!flags.syn && !flags.fin && len == 0)
+        return 0;
+    if (flags.fin)
+        tw->expire = tcp_tw_expire();
+    if (tw->ts_ok && opt->ts_present && !TCP_SEQ_LT(opt->ts_val, tw->ts_recent))
+        tw->ts_recent = opt->ts_val;
+    tcp_sock_t tmp = { .connect = CONNECT_LISTEN };
+    tcp_connect_t* connect = &tmp.connect;
+    connect->local_port = tw->key.dst_port;
+    connect->remote_port = tw->key.src_port;
+    memcpy(connect->ip, tw->key.ip, NET_IP_LEN);
+    connect->ack = tw->rcv_nxt;
+    tmp.ts_ok = tw->ts_ok;
+    tmp.ts_recent = tw->ts_recent;
+    buf_init(&txbuf, 0);
+    tcp_send_seq(&txbuf, connect, tcp_flags_ack, tw->snd_nxt);
+    tcp_tw_stats.acked++;
+    return 0;
 }
 
 /**
- * @brief 从 buf 中读取数据到 connect->rx_buf
+ * @brief 推进TIME_WAIT的时间轮，回收到期的连接，在tcp_poll中调用。
+ *        重新开始计时的连接到期时刻变了，槽到期时按新的到期时刻重新挂上
  *
- * @param connect
- * @param buf
- * @return uint16_t 字节数
  */
-static uint16_t tcp_read_from_buf(tcp_connect_t* connect, buf_t* buf) {
-    uint8_t* dst = connect->rx_buf->data + connect->rx_buf->len;
-    buf_add_padding(connect->rx_buf, buf->len);
-    memcpy(dst, buf->data, buf->len);
-    connect->ack += buf->len;
-    return buf->len;
+static void tcp_tw_age() {
+    uint32_t now = tcp_now_ms() / TCP_TW_TICK_MS;
+    if ((int32_t)(now - tcp_tw_now) <= 0)
+        return;
+    uint32_t ticks = now - tcp_tw_now;
+    if (ticks > TCP_TW_WHEEL_SLOTS)
+        ticks = TCP_TW_WHEEL_SLOTS;
+    for (uint32_t t = now - ticks + 1; t != now + 1; t++) {
+        size_t slot = t & (TCP_TW_WHEEL_SLOTS - 1);
+        int32_t index = tcp_tw_wheel[slot];
+        tcp_tw_wheel[slot] = -1;
+        while (index >= 0) {
+            tcp_tw_t* tw = &tcp_tw[index];
+            int32_t next = tw->wheel_next;
+            if ((int32_t)(tw->expire - now) > 0) {
+                tcp_tw_wheel_link(index);
+            } else {
+                tcp_tw_unhash(tw);
+                tcp_tw_stats.expired++;
+                tw->hash_next = tcp_tw_free;
+                tcp_tw_free = index;
+            }
+            index = next;
+        }
+    }
+    tcp_tw_now = now;
 }
 
+// cookie中能编码的对端MSS，取不超过对端MSS的最大一个
+static const uint16_t tcp_cookie_mss[8] = {216, 536, 1024, 1200, 1300, 1400, 1440, 1460};
+
 /**
- * @brief 把connect内tx_buf的数据写入到buf里面供tcp_send使用，buf原来的内容会无效。
+ * @brief cookie中的校验值：连接、对方的初始序号和计数器的带密钥哈希，取低24位。
+ *        用的是和arp_hash一样的整数混合函数，能挡住伪造源地址的洪泛，但不是密码学强度的MAC
  *
- * @param connect
- * @param buf
- * @return uint16_t 字节数
+ * @param key
+ * @param isn 对方的初始序号
+ * @param count 计数器
+ * @return uint32_t
  */
-static uint16_t tcp_write_to_buf(tcp_connect_t* connect, buf_t* buf) {
-    uint16_t sent = connect->next_seq - connect->unack_seq;
-    uint16_t size = min32(connect->tx_buf->len - sent, connect->remote_win);
-    buf_init(buf, size);
-    memcpy(buf->data, connect->tx_buf->data + sent, size);
-    connect->next_seq += size;
-    return size;
+static uint32_t tcp_cookie_hash(tcp_key_t* key, uint32_t isn, uint32_t count) {
+    uint32_t ip;
+    memcpy(&ip, key->ip, sizeof(ip));
+    uint32_t h = tcp_cookie_secret[0];
+    h = tcp_hash_mix(h ^ ip);
+    h = tcp_hash_mix(h ^ ((uint32_t)key->src_port << 16 | key->dst_port));
+    h = tcp_hash_mix(h ^ isn);
+    h = tcp_hash_mix(h ^ count ^ tcp_cookie_secret[1]);
+    return h & 0xFFFFFF;
 }
 
 /**
- * @brief 发送TCP包, seq_number32 = connect->next_seq - buf->len
- *        buf里的数据将作为负载，加上tcp头发送出去。如果flags包含syn或fin，seq会递增。
+ * @brief 生成cookie，作为SYN+ACK的序号：高5位是计数器，接着3位是MSS在tcp_cookie_mss中的下标，低24位是校验值
  *
- * @param buf
- * @param connect
- * @param flags
+ * @param key
+ * @param isn 对方的初始序号
+ * @param mss 对方SYN中的MSS
+ * @return uint32_t
  */
-static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
-    // printf("<< tcp send >> sz=%zu\n", buf->len);
-    display_flags(flags);
-    size_t prev_len = buf->len;
-    buf_add_header(buf, sizeof(tcp_hdr_t));
-    tcp_hdr_t* hdr = (tcp_hdr_t*)buf->data;
-    hdr->src_port16 = swap16(connect->local_port);
-    hdr->dst_port16 = swap16(connect->remote_port);
-    hdr->seq_number32 = swap32(connect->next_seq - prev_len);
-    hdr->ack_number32 = swap32(connect->ack);
-    hdr->data_offset = sizeof(tcp_hdr_t) / sizeof(uint32_t);
-    hdr->reserved = 0;
-    hdr->flags = flags;
-    hdr->window_size16 = swap16(connect->remote_win);
-    hdr->chunksum16 = 0;
-    hdr->urgent_pointer16 = 0;
-    hdr->chunksum16 = tcp_checksum(buf, connect->ip, net_if_ip);
-    ip_out(buf, connect->ip, NET_PROTOCOL_TCP);
-    if (flags.syn || flags.fin) {
-        connect->next_seq += 1;
-    }
+static uint32_t tcp_cookie_make(tcp_key_t* key, uint32_t isn, uint16_t mss) {
+    uint32_t m = 7;
+    while (m > 0 && tcp_cookie_mss[m] > mss)
+        m--;
+    uint32_t count = tcp_now_ms() / TCP_COOKIE_PERIOD_MS;
+    return (count & 0x1F) << 27 | m << 24 | tcp_cookie_hash(key, isn, count);
 }
 
 /**
- * @brief 从外部关闭一个TCP连接, 会发送剩余数据
- *        供应用层使用
+ * @brief 检查ACK中的cookie，接受当前和上一个计数器生成的cookie，有效时恢复出对方SYN中的选项。
+ *        SACK和窗口缩放编码在我们的TSval的低位（见tcp_cookie_send），由ACK中的TSecr带回来；
+ *        这时TSecr不是时间，清零以免拿来测量RTT
  *
- * @param connect
+ * @param key
+ * @param seq ACK的序号，即对方的初始序号+1
+ * @param ack_num ACK的确认号，即cookie+1
+ * @param opt ACK中的选项
+ * @param syn 恢复出的SYN选项
+ * @return int 有效为1
  */
-void tcp_connect_close(tcp_connect_t* connect) {
-    if (connect->state == TCP_ESTABLISHED) {
-        tcp_write_to_buf(connect, &txbuf);
-        tcp_send(&txbuf, connect, tcp_flags_ack_fin);
-        connect->state = TCP_FIN_WAIT_1;
-        return;
+static int tcp_cookie_check(tcp_key_t* key, uint32_t seq, uint32_t ack_num, tcp_options_t* opt, tcp_options_t* syn) {
+    uint32_t cookie = ack_num - 1;
+    uint32_t count = tcp_now_ms() / TCP_COOKIE_PERIOD_MS;
+    uint32_t age = (count - (cookie >> 27)) & 0x1F;
+    if (age > 1 || (cookie & 0xFFFFFF) != tcp_cookie_hash(key, seq - 1, count - age))
+        return 0;
+    memset(syn, 0, sizeof(tcp_options_t));
+    syn->mss = tcp_cookie_mss[cookie >> 24 & 7];
+    if (opt->ts_present && (opt->ts_ecr & 0x20)) {
+        syn->ts_present = 1;
+        syn->ts_val = opt->ts_val;
+        syn->sack_permitted = opt->ts_ecr >> 4 & 1;
+        syn->wscale_present = (opt->ts_ecr & 0xF) != 0xF;
+        syn->wscale = opt->ts_ecr & 0xF;
+        opt->ts_ecr = 0;
     }
-    tcp_key_t key = new_tcp_key(connect->ip, connect->remote_port, connect->local_port);
-    release_tcp_connect(connect);
-    map_delete(&connect_table, &key);
+    return 1;
 }
 
 /**
- * @brief 从 connect 中读取数据到 buf，返回成功的字节数。
- *        供应用层使用
+ * @brief 用SYN cookie回复SYN：不在connect_table中保存任何状态，SYN+ACK的序号就是cookie。
+ *        对方带了时间戳时，TSval的低6位记录SACK和窗口缩放（0x20 | SACK << 4 | 对方的缩放因子，不缩放为0xF）；
+ *        没带时间戳就无处记录，只能不用这两个选项
  *
- * @param connect
- * @param data
- * @param len
- * @return size_t
+ * @param listener
+ * @param key
+ * @param seq 对方的初始序号
+ * @param opt 对方SYN中的选项
  */
-size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len) {
-    buf_t* rx_buf = connect->rx_buf;
-    size_t size = min32(rx_buf->len, len);
-    memcpy(data, rx_buf->data, size);
-    if (buf_remove_header(rx_buf, size) != 0) {
-        memmove(rx_buf->payload, rx_buf->data, rx_buf->len);
-        rx_buf->data = rx_buf->payload;
+static void tcp_cookie_send(tcp_listener_t* listener, tcp_key_t* key, uint32_t seq, tcp_options_t* opt) {
+    tcp_sock_t tmp = { .connect = CONNECT_LISTEN };
+    tcp_connect_t* connect = &tmp.connect;
+    init_tcp_connect_rcvd(connect, listener);
+    tcp_syn_negotiate(&tmp, opt);
+    if (tmp.ts_ok)
+        tmp.cookie_ts = 0x20 | tmp.sack_ok << 4 | (tmp.wscale_ok ? tmp.snd_wscale : 0xF);
+    else
+        tmp.sack_ok = tmp.wscale_ok = tmp.rcv_wscale = 0;
+    connect->local_port = key->dst_port;
+    connect->remote_port = key->src_port;
+    memcpy(connect->ip, key->ip, NET_IP_LEN);
+    connect->ack = seq + 1;
+    buf_init(&txbuf, 0);
+    tcp_send_seq(&txbuf, connect, tcp_flags_ack_syn, tcp_cookie_make(key, seq, connect->remote_mss));
+    tcp_cookie_last = tcp_now_ms();
+    tcp_syn_stats.cookie_sent++;
+}
+
+/**
+ * @brief 最近是否用cookie回复过SYN：两个计数器周期之后，发出去的cookie都已经失效
+ *
+ * @return int
+ */
+static int tcp_cookie_recent() {
+    return TCP_SYN_COOKIES == 2 ||
+        (TCP_SYN_COOKIES && tcp_cookie_last && tcp_now_ms() - tcp_cookie_last < 2 * TCP_COOKIE_PERIOD_MS);
+}
+
+/**
+ * @brief 为到ip:port的连接分配一个临时端口：从上次的位置往后找，
+ *        跳过有listener的端口和与同一个对端已经有连接（包括TIME_WAIT）的端口（RFC 6056 算法1的简化）
+ *
+ * @param ip 对端ip
+ * @param port 对端端口
+ * @return int 端口号，临时端口都被占用时为-1
+ */
+static int tcp_ephemeral_port(uint8_t* ip, uint16_t port) {
+    uint32_t range = TCP_EPHEMERAL_MAX - TCP_EPHEMERAL_MIN + 1;
+    for (uint32_t i = 0; i < range; i++) {
+        uint16_t local_port = TCP_EPHEMERAL_MIN + tcp_ephemeral_next++ % range;
+        tcp_key_t key = new_tcp_key(ip, port, local_port);
+        if (map_get(&tcp_table, &local_port) == NULL && map_get(&connect_table, &key) == NULL &&
+            tcp_tw_lookup(&key) == NULL)
+            return local_port;
     }
-    return size;
+    return -1;
 }
 
 /**
- * @brief 往connect的tx_buf里面写东西，返回成功的字节数，这里要判断窗口够不够，否则图片显示不全。
+ * @brief 主动打开一个到 ip:port 的 TCP 连接，并指定使用的拥塞控制算法。
+ *        只发出SYN，不等待握手完成：连接建立后以TCP_CONN_CONNECTED调用handler，
+ *        被拒绝（RST）或SYN重传TCP_SYN_RETRIES次仍没有回应时以TCP_CONN_CLOSED调用handler，
+ *        之后的数据收发、关闭和被动打开的连接一样。
  *        供应用层使用
  *
- * @param connect
- * @param data
- * @param len
+ * @param ip 对端ip
+ * @param port 对端端口
+ * @param handler 回调函数
+ * @param cc "reno"、"cubic"或"bbr"
+ * @return int 分配的本地端口，不认识的算法、没有空闲的临时端口或连接表满时为-1
  */
-size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len) {
-    // printf("tcp_connect_write size: %zu\n", len);
-    buf_t* tx_buf = connect->tx_buf;
-
-    uint8_t* dst = tx_buf->data + tx_buf->len;
-    size_t size = min32(&tx_buf->payload[BUF_MAX_LEN] - dst, len);
+int tcp_connect_cc(uint8_t* ip, uint16_t port, tcp_handler_t handler, const char* cc) {
+    tcp_listener_t params = {
+        .handler = handler,
+        .cc = tcp_cc_find(cc),
+        .rx_size = TCP_RX_RING_SIZE,
+        .tx_size = TCP_TX_RING_SIZE,
+    };
+    if (params.cc == NULL)
+        return -1;
+    int local_port = tcp_ephemeral_port(ip, port);
+    if (local_port < 0)
+        return -1;
+    tcp_key_t key = new_tcp_key(ip, port, local_port);
+    tcp_sock_t new_sock = { .connect = CONNECT_LISTEN };
+    if (map_set(&connect_table, &key, &new_sock) < 0)
+        return -1;
+    tcp_connect_t* connect = map_get(&connect_table, &key);
+    tcp_sock_t* sock = TCP_SOCK(connect);
+    init_tcp_connect_rcvd(connect, &params);
+    connect->state = TCP_SYN_SENT;
+    connect->local_port = local_port;
+    connect->remote_port = port;
+    memcpy(connect->ip, ip, NET_IP_LEN);
+    // SYN中带上所有打开的选项，收到SYN+ACK后由tcp_syn_negotiate确定实际使用的
+    sock->sack_ok = TCP_SACK_ENABLE;
+    sock->ts_ok = TCP_TIMESTAMP_ENABLE;
+    sock->wscale_ok = TCP_WSCALE_ENABLE;
+    sock->rcv_wscale = sock->wscale_ok ? tcp_rcv_wscale(params.rx_size) : 0;
+    tcp_cc_init(&sock->cc, params.cc, tcp_mss(connect));
+    srand(time(NULL) + local_port);
+    connect->unack_seq = rand() % UINT16_MAX;
+    connect->next_seq = connect->unack_seq;
+    sock->snd_max = connect->next_seq;
+    connect->ack = 0;
+    buf_init(&txbuf, 0);
+    tcp_send(&txbuf, connect, tcp_flags_syn);
+    return local_port;
+}
 
-    if (connect->next_seq - connect->unack_seq + len >= connect->remote_win) {
-        return 0;
-    }
-    if (buf_add_padding(tx_buf, size) != 0) {
-        memmove(tx_buf->payload, tx_buf->data, tx_buf->len);
-        tx_buf->data = tx_buf->payload;
-        if (tcp_write_to_buf(connect, &txbuf)) {
-            tcp_send(&txbuf, connect, tcp_flags_ack);
-        }
-        return 0;
-    }
-    memcpy(dst, data, size);
-    return size;
+/**
+ * @brief 主动打开一个到 ip:port 的 TCP 连接，使用默认的拥塞控制算法，见tcp_connect_cc
+ *        供应用层使用
+ *
+ * @param ip 对端ip
+ * @param port 对端端口
+ * @param handler 回调函数
+ * @return int 分配的本地端口，失败为-1
+ */
+int tcp_connect(uint8_t* ip, uint16_t port, tcp_handler_t handler) {
+    return tcp_connect_cc(ip, port, handler, TCP_CC_DEFAULT);
 }
 
 /**
- * @brief 服务器端TCP收包
+ * @brief TCP收包，被动打开和主动打开的连接都在这里处理
  *
  * @param buf
  * @param src_ip
@@ -297,6 +2037,14 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     if(checksum != tcp_checksum(buf, src_ip, net_if_ip)) return;
     tcp_hdr->chunksum16 = checksum;
 
+    /*
+    解析选项，首部长度由data_offset给出
+    */
+    size_t hdr_len = tcp_hdr->data_offset * sizeof(uint32_t);
+    if(hdr_len < sizeof(tcp_hdr_t) || hdr_len > buf->len) return;
+    tcp_options_t opt;
+    tcp_parse_options((uint8_t*)(tcp_hdr + 1), hdr_len - sizeof(tcp_hdr_t), &opt);
+
     /*
     3、从tcp头部字段中获取source port、destination port、
     sequence number、acknowledge number、flags，注意大小端转换
@@ -308,10 +2056,10 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     tcp_flags_t flags = tcp_hdr->flags;
 
     /*
-    4、调用map_get函数，根据destination port查找对应的handler函数
+    4、调用map_get函数，根据destination port查找监听该端口的listener，
+    主动打开的连接没有listener，回调函数保存在连接里
     */
-    tcp_handler_t* handler = map_get(&tcp_table, &dst_port);
-    if(handler == NULL) return;
+    tcp_listener_t* listener = map_get(&tcp_table, &dst_port);
 
     /*
     5、调用new_tcp_key函数，根据通信五元组中的源IP地址、目标IP地址、目标端口号确定一个tcp链接key
@@ -321,68 +2069,199 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     /*
     6、调用map_get函数，根据key查找一个tcp_connect_t* connect，
     如果没有找到，则调用map_set建立新的链接，并设置为CONNECT_LISTEN状态，然后调用mag_get获取到该链接。
+    map_set会拷贝value，所以新链接直接放在栈上。
+        （1）新连接的SYN先在半连接队列中占一个槽位，队列满（或TCP_SYN_COOKIES为2）时用SYN cookie回复，不建立连接
+        （2）最近发过cookie时，ACK中带着有效的cookie就从cookie中恢复出SYN_RCVD状态的连接，之后和普通的握手一样完成
+        （3）TIME_WAIT表中的连接由tcp_tw_in处理，被新的SYN提前结束时按新连接继续
     */
     tcp_connect_t* connect = map_get(&connect_table, &key);
     if(connect == NULL) {
-        tcp_connect_t* new_connect = (tcp_connect_t* )malloc(sizeof(tcp_connect_t));
-        *new_connect = CONNECT_LISTEN;
-        map_set(&connect_table, &key, new_connect);
+        tcp_tw_t* tw = tcp_tw_lookup(&key);
+        if(tw != NULL && !tcp_tw_in(tw, flags, &opt, buf->len - hdr_len)) return;
+        if(listener == NULL) return;
+        int slot = -1;
+        tcp_options_t syn_opt;
+        int cookie = 0;
+        if(flags.syn && !flags.ack && !flags.rst) {
+            tcp_syn_stats.syn++;
+            if(TCP_SYN_COOKIES == 2 || (slot = tcp_syn_backlog_add(&key)) < 0) {
+                tcp_cookie_send(listener, &key, get_seq, &opt);
+                return;
+            }
+        } else if(flags.ack && !flags.syn && !flags.rst && tcp_cookie_recent()) {
+            cookie = tcp_cookie_check(&key, get_seq, ack_num, &opt, &syn_opt);
+            if(!cookie) tcp_syn_stats.cookie_bad++;
+        }
+        tcp_sock_t new_sock = { .connect = CONNECT_LISTEN, .syn_slot = slot + 1 };
+        if(map_set(&connect_table, &key, &new_sock) < 0) {
+            if(slot >= 0) tcp_syn_backlog[slot].used = 0;
+            return;
+        }
         connect = map_get(&connect_table, &key);
+        // 先填好地址，LISTEN状态下回复的RST也要用
+        connect->local_port = dst_port;
+        connect->remote_port = src_port;
+        memcpy(connect->ip, src_ip, NET_IP_LEN);
+        if(cookie) {
+            tcp_sock_t* sock = TCP_SOCK(connect);
+            init_tcp_connect_rcvd(connect, listener);
+            tcp_syn_negotiate(sock, &syn_opt);
+            tcp_cc_init(&sock->cc, listener->cc, tcp_mss(connect));
+            connect->unack_seq = ack_num - 1;
+            connect->next_seq = ack_num;
+            sock->snd_max = ack_num;
+            connect->ack = get_seq;
+            tcp_syn_stats.cookie_ok++;
+        }
     }
+    tcp_sock_t* sock = TCP_SOCK(connect);
+
+    // 已经放弃、等待tcp_poll回收的连接
+    if(connect->state == TCP_CLOSED) return;
 
     /*
-    7、从TCP头部字段中获取对方的窗口大小，注意大小端转换
+    7、从TCP头部字段中获取对方的窗口大小，注意大小端转换；
+    协商了窗口缩放时左移snd_wscale位，SYN中的窗口不缩放
     */
-    uint16_t window_size = swap16(tcp_hdr->window_size16);
+    uint32_t window_size = swap16(tcp_hdr->window_size16);
+    if(!flags.syn) window_size <<= sock->snd_wscale;
 
     /*
     8、如果为TCP_LISTEN状态，则需要完成如下功能：
         （1）如果收到的flag带有rst，则close_tcp关闭tcp链接
         （2）如果收到的flag不是syn，则reset_tcp复位通知。因为收到的第一个包必须是syn
         （3）调用init_tcp_connect_rcvd函数，初始化connect，将状态设为TCP_SYN_RCVD
-        （4）填充connect字段，包括
-            local_port、remote_port、ip、
+        （4）填充connect字段（local_port、remote_port、ip在第6步已经填好），包括
             unack_seq（设为随机值）、由于是对syn的ack应答包，next_seq与unack_seq一致
             ack设为对方的sequence number+1
             设置remote_win为对方的窗口大小，注意大小端转换
+            根据SYN中的选项协商MSS、窗口缩放、时间戳和SACK
         （5）调用buf_init初始化txbuf
         （6）调用tcp_send将txbuf发送出去，也就是回复一个tcp_flags_ack_syn（SYN+ACK）报文
         （7）处理结束，返回。
     */
     if(connect->state == TCP_LISTEN) {
-        if(flags.rst) goto close_tcp;
+        if(flags.rst || listener == NULL) goto close_tcp;
 
         if(!flags.syn) goto reset_tcp;
 
-        init_tcp_connect_rcvd(connect);
-        connect->local_port = dst_port;
-        connect->remote_port = src_port;
-        memcpy(connect->ip, src_ip, NET_IP_LEN);
+        init_tcp_connect_rcvd(connect, listener);
+        tcp_syn_negotiate(sock, &opt);
+        tcp_cc_init(&sock->cc, listener->cc, tcp_mss(connect));
         srand(time(NULL) + dst_port);
         connect->unack_seq = rand() % UINT16_MAX;
         connect->next_seq = connect->unack_seq;
+        sock->snd_max = connect->next_seq;
         connect->ack = get_seq + 1;
-        connect->remote_win = window_size;
+        tcp_set_snd_wnd(sock, window_size);
         buf_init(&txbuf, 0);
         tcp_send(&txbuf, connect, tcp_flags_ack_syn);
 
         return;
     }
 
+    /*
+    主动打开，SYN_SENT状态（RFC 9293 3.10.7.3）：
+        （1）ACK没有正好确认我们的SYN，不是RST就回复一个序号为该确认号的RST，然后丢弃
+        （2）RST确认了我们的SYN，说明连接被拒绝，以TCP_CONN_CLOSED调用回调函数后close_tcp
+        （3）收到SYN，根据其中的选项协商MSS、窗口缩放、时间戳和SACK，ack设为对方的序号+1。
+            带有ACK时握手完成，状态转成ESTABLISHED，调用回调函数通知连接建立，
+            然后由tcp_output发送数据，确认没有搭载在数据上时单独回复ACK（SYN+ACK中的数据丢弃，对方会重传）；
+            分配不到缓冲区时回复RST并关闭；不带ACK是双方同时打开，转成SYN_RCVD并回复SYN+ACK
+        （4）其他报文丢弃
+    */
+    if(connect->state == TCP_SYN_SENT) {
+        int ack_ok = flags.ack && ack_num == sock->snd_max;
+        if(flags.ack && !ack_ok) {
+            if(!flags.rst) {
+                buf_init(&txbuf, 0);
+                tcp_send_seq(&txbuf, connect, tcp_flags_rst, ack_num);
+            }
+            return;
+        }
+        if(flags.rst) {
+            if(!ack_ok) return;
+            sock->handler(connect, TCP_CONN_CLOSED);
+            goto close_tcp;
+        }
+        if(!flags.syn) return;
+
+        tcp_syn_negotiate(sock, &opt);
+        tcp_cc_init(&sock->cc, sock->cc.ops, tcp_mss(connect));
+        connect->ack = get_seq + 1;
+        tcp_set_snd_wnd(sock, window_size);
+        if(!ack_ok) {
+            connect->state = TCP_SYN_RCVD;
+            tcp_retransmit(sock);
+            return;
+        }
+        if(tcp_alloc_buffers(connect) < 0) {
+            tcp_syn_stats.nomem++;
+            buf_init(&txbuf, 0);
+            tcp_send_seq(&txbuf, connect, tcp_flags_rst, ack_num);
+            sock->handler(connect, TCP_CONN_CLOSED);
+            goto close_tcp;
+        }
+        tcp_ack_update(sock, ack_num, &opt);
+        connect->state = TCP_ESTABLISHED;
+        sock->handler(connect, TCP_CONN_CONNECTED);
+        tcp_output(sock);
+        if(sock->last_ack_sent != connect->ack) {
+            buf_init(&txbuf, 0);
+            tcp_send(&txbuf, connect, tcp_flags_ack);
+        }
+        return;
+    }
+
+    /*
+    PAWS（RFC 7323）：时间戳比ts_recent还旧，是序号回绕后迟到的旧报文段，回复ACK后丢弃
+    */
+    if(sock->ts_ok && opt.ts_present && !flags.rst && TCP_SEQ_LT(opt.ts_val, sock->ts_recent)) {
+        if(connect->state != TCP_SYN_RCVD) {
+            buf_init(&txbuf, 0);
+            tcp_send(&txbuf, connect, tcp_flags_ack);
+        }
+        return;
+    }
+
     /* 
-    9、检查接收到的sequence number，如果与ack序号不一致,则reset_tcp复位通知。
+    9、检查接收到的sequence number，如果与ack序号不一致，说明是重复或者乱序的报文段：
+        （1）序号比期望的大，是乱序的报文段，ESTABLISHED状态下把数据放进乱序队列，并处理其中的ACK
+        （2）立即回复一个ACK告诉对方我们期望的序号，乱序队列不空时带上SACK块
+            （不延迟，对端靠重复ACK发现丢包），然后返回
+        （3）前一部分已经收到过、后一部分是新数据的重传报文段不算重复，在第11步去掉重复的部分
+    SYN_RCVD状态下对方重发SYN则重传SYN+ACK。
     */
-    if(get_seq != connect->ack) goto reset_tcp;
+    uint32_t seg_end = get_seq + (buf->len - hdr_len);
+    if(get_seq != connect->ack &&
+    !(TCP_SEQ_LT(get_seq, connect->ack) && TCP_SEQ_LT(connect->ack, seg_end))) {
+        if(flags.rst) return;
+        if(connect->state == TCP_SYN_RCVD) {
+            if(flags.syn) tcp_retransmit(sock);
+            return;
+        }
+        if(connect->state == TCP_ESTABLISHED && TCP_SEQ_LT(connect->ack, get_seq)) {
+            buf_remove_header(buf, hdr_len);
+            tcp_ooo_in(sock, get_seq, buf);
+            if(flags.ack) tcp_ack_in(sock, ack_num, window_size, buf->len, flags, &opt);
+        }
+        buf_init(&txbuf, 0);
+        tcp_send(&txbuf, connect, tcp_flags_ack);
+        return;
+    }
 
     /* 
     10、检查flags是否有rst标志，如果有，则close_tcp连接重置
     */
     if(flags.rst) goto close_tcp;
 
+    // 按序到达的报文段的时间戳由下一个发出的报文段回显
+    if(sock->ts_ok && opt.ts_present) sock->ts_recent = opt.ts_val;
+
     /*
-    11、序号相同时的处理，调用buf_remove_header去除头部后剩下的都是数据
+    11、序号相同时的处理，调用buf_remove_header去除头部和已经收到过的部分后剩下的都是数据
     */
-    buf_remove_header(buf, sizeof(tcp_hdr_t));
+    buf_remove_header(buf, hdr_len + (connect->ack - get_seq));
 
     /* 
     状态转换
@@ -401,13 +2280,23 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
 
             /*
             13、如果是ack包，需要完成如下功能：
-                （1）将unack_seq +1
-                （2）将状态转成ESTABLISHED
+                （1）确认号必须正好确认我们的SYN，由tcp_ack_update将unack_seq +1并停止重传定时器
+                （2）分配接收、发送缓冲区，内存不足时用对方的确认号作为序号回复RST，
+                     让对方立即关闭连接，再close_tcp；将状态转成ESTABLISHED
                 （3）调用回调函数，完成三次握手，进入连接状态TCP_CONN_CONNECTED。
             */
-            connect->unack_seq++;
+            if(!tcp_ack_update(sock, ack_num, &opt)) break;
+            if(tcp_alloc_buffers(connect) < 0) {
+                tcp_syn_stats.nomem++;
+                buf_init(&txbuf, 0);
+                tcp_send_seq(&txbuf, connect, tcp_flags_rst, ack_num);
+                goto close_tcp;
+            }
+            tcp_syn_backlog_remove(sock);
+            tcp_set_snd_wnd(sock, window_size);
             connect->state = TCP_ESTABLISHED;
-            (*handler)(connect, TCP_CONN_CONNECTED);
+            sock->handler(connect, TCP_CONN_CONNECTED);
+            tcp_output(sock);
             break;
 
 
@@ -422,40 +2311,50 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
             15、这里先处理ACK的值，
                 如果是ack包，
                 且unack_seq小于ack number（说明有部分数据被对端接收确认了，否则可能是之前重发的ack，可以不处理），
-                且next_seq大于ack number
-                则调用buf_remove_header函数，去掉被对端接收确认的部分数据，并更新unack_seq值
-                
+                且next_seq不小于ack number
+                则由tcp_ack_update去掉被对端接收确认的部分数据，更新unack_seq值和重传定时器。
+                同时更新对端的窗口大小和SACK记分板；
+                ack number等于unack_seq的纯ACK是重复ACK，连续3个则快速重传
             */
-            if(flags.ack && connect->unack_seq < ack_num && connect->next_seq > ack_num) {
-                    buf_remove_header(connect->tx_buf, ack_num - connect->unack_seq);
-                    connect->unack_seq = ack_num;
-            }
+            if(flags.ack) tcp_ack_in(sock, ack_num, window_size, buf->len, flags, &opt);
 
             /*
             16、然后接收数据
-                调用tcp_read_from_buf函数，把buf放入rx_buf中
+                调用tcp_read_from_buf函数，把buf放入接收缓冲区中，如果填上了空洞，乱序队列中接着的数据一起交付；
+                超出接收窗口的部分被丢弃，这时FIN也还没有收到
             */
-            tcp_read_from_buf(connect, buf);
+            size_t read_len = tcp_read_from_buf(connect, buf);
+            if(read_len < buf->len) flags.fin = 0;
 
             /*
             17、再然后，根据当前的标志位进一步处理
                 （1）首先调用buf_init初始化txbuf
-                （2）判断是否收到关闭请求（FIN），如果是，将状态改为TCP_LAST_ACK，ack +1，再发送一个ACK + FIN包，并退出，
+                （2）判断是否收到关闭请求（FIN），如果是，将状态改为TCP_LAST_ACK，ack +1，
+                    由tcp_output把剩下的数据和FIN一起发出去（没能发出任何报文时单独回复ACK），
                     这样就无需进入CLOSE_WAIT，直接等待对方的ACK
-                （3）如果不是FIN，则看看是否有数据，如果有，则发ACK相应，并调用handler回调函数进行处理
-                （4）调用tcp_write_to_buf函数，看看是否有数据需要发送，如果有，同时发数据和ACK
-                （5）没有收到数据，可能对方只发一个ACK，可以不响应
+                （3）如果不是FIN，则看看是否有数据，如果有，则调用handler回调函数进行处理
+                （4）调用tcp_output函数，看看是否有数据需要发送，如果有，确认搭载在数据上；
+                    没有则由tcp_ack_schedule决定立即发ACK还是延迟确认，
+                    填上了空洞或者还有乱序数据时立即确认（RFC 5681）
+                （5）没有收到数据，可能对方只发一个ACK，可以不响应，但窗口可能变大了，尝试继续发送
             */
             buf_init(&txbuf, 0);
             if(flags.fin) {
                 connect->state = TCP_LAST_ACK;
                 connect->ack++;
-                tcp_send(&txbuf, connect, tcp_flags_ack_fin);
+                sock->fin_queued = 1;
+                if(!tcp_output(sock)) {
+                    buf_init(&txbuf, 0);
+                    tcp_send(&txbuf, connect, tcp_flags_ack);
+                }
             }
             else if(buf->len > 0){
-                (*handler)(connect, TCP_CONN_DATA_RECV);
-                tcp_write_to_buf(connect, &txbuf);
-                tcp_send(&txbuf, connect, tcp_flags_ack);
+                sock->handler(connect, TCP_CONN_DATA_RECV);
+                tcp_output(sock);
+                tcp_ack_schedule(sock, read_len != buf->len || sock->ooo_count);
+            }
+            else {
+                tcp_output(sock);
             }
 
             break;
@@ -467,34 +2366,42 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
         case TCP_FIN_WAIT_1:
 
             /*
-            18、如果收到FIN && ACK，则close_tcp直接关闭TCP
-                如果只收到ACK，则将状态转为TCP_FIN_WAIT_2
+            18、先处理ACK，FIN之前可能还有数据没有发完或没被确认
+                如果我们的FIN已被确认且收到FIN，则回复ACK后进入TIME_WAIT
+                如果我们的FIN已被确认，则将状态转为TCP_FIN_WAIT_2
             */
-            if(flags.fin && flags.ack) goto close_tcp;
-            if(flags.ack) connect->state = TCP_FIN_WAIT_2;
+            if(!flags.ack) break;
+            tcp_ack_in(sock, ack_num, window_size, buf->len, flags, &opt);
+            if(!tcp_fin_acked(sock)) {
+                tcp_output(sock);
+                break;
+            }
+            if(flags.fin) goto time_wait;
+            connect->state = TCP_FIN_WAIT_2;
             break;
 
         case TCP_FIN_WAIT_2:
             /*
             19、如果不是FIN，则不做处理
-                如果是，则将ACK +1，调用buf_init初始化txbuf，调用tcp_send发送一个ACK数据包，再close_tcp关闭TCP
+                如果是，则回复ACK后进入TIME_WAIT
             */
-            if(flags.fin) {
-                connect->ack++;
-                buf_init(&txbuf, 0);
-                tcp_send(&txbuf, connect, tcp_flags_ack);
-                goto close_tcp;
-            }
+            if(flags.fin) goto time_wait;
             break;
 
         case TCP_LAST_ACK:
             /*
             20、如果不是ACK，则不做处理
-                如果是，则调用handler函数，进入TCP_CONN_CLOSED状态，再close_tcp关闭TCP
+                如果是，先处理ACK，我们的FIN还没被确认时继续发送剩下的数据
+                FIN被确认后调用handler函数，进入TCP_CONN_CLOSED状态，再close_tcp关闭TCP
             */
 
             if(flags.ack) {
-                (*handler)(connect, TCP_CONN_CLOSED);
+                tcp_ack_in(sock, ack_num, window_size, buf->len, flags, &opt);
+                if(!tcp_fin_acked(sock)) {
+                    tcp_output(sock);
+                    break;
+                }
+                sock->handler(connect, TCP_CONN_CLOSED);
                 goto close_tcp;
             }
             break;
@@ -505,6 +2412,17 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     }
     return;
 
+    /*
+    主动关闭时收到了对方的FIN：将ACK +1，调用tcp_send发送一个ACK数据包，
+    把连接存进TIME_WAIT表，再close_tcp释放连接，之后的报文段由tcp_tw_in处理
+    */
+time_wait:
+    connect->ack++;
+    buf_init(&txbuf, 0);
+    tcp_send(&txbuf, connect, tcp_flags_ack);
+    tcp_tw_enter(sock, &key);
+    goto close_tcp;
+
 reset_tcp:
     printf("!!! reset tcp !!!\n");
     connect->next_seq = 0;
@@ -517,3 +2435,100 @@ close_tcp:
     map_delete(&connect_table, &key);
     return;
 }
+
+/**
+ * @brief 重传定时器到期：退避RTO，SYN_SENT、SYN_RCVD状态下重传SYN或SYN+ACK，
+ *        其他状态把next_seq退回unack_seq，由tcp_output从第一个没被确认的字节开始重新发送。
+ *        连续超时太多次（主动打开的SYN为TCP_SYN_RETRIES次）则放弃连接，
+ *        把状态设为TCP_CLOSED，由tcp_poll回收
+ *
+ * @param sock
+ */
+static void tcp_rto_expired(tcp_sock_t* sock) {
+    tcp_connect_t* connect = &sock->connect;
+    int handshake = connect->state == TCP_SYN_SENT || connect->state == TCP_SYN_RCVD;
+    if (++sock->retries > (connect->state == TCP_SYN_SENT ? TCP_SYN_RETRIES : TCP_MAX_RETRIES)) {
+        printf("!!! tcp retransmit timeout !!!\n");
+        if (connect->state != TCP_SYN_RCVD)
+            sock->handler(connect, TCP_CONN_CLOSED);
+        connect->state = TCP_CLOSED;
+        return;
+    }
+    if (!handshake)
+        sock->cc.ops->on_loss(&sock->cc, sock->snd_max - connect->unack_seq, 1, tcp_now_ms());
+    sock->rto = min32(sock->rto * 2, TCP_RTO_MAX);
+    sock->rtt_start = 0;
+    tcp_timer_set(sock, TCP_TIMER_RTO, sock->rto);
+    if (handshake) {
+        tcp_retransmit(sock);
+        return;
+    }
+    connect->next_seq = connect->unack_seq;
+    sock->fin_sent = 0;
+    sock->in_recovery = 0;
+    sock->dupacks = 0;
+    sock->sacked_count = 0;
+    if (!tcp_output(sock))
+        tcp_retransmit(sock);
+}
+
+/**
+ * @brief 延迟确认定时器到期：发送还没发出的确认
+ *
+ * @param sock
+ */
+static void tcp_delack_expired(tcp_sock_t* sock) {
+    if (sock->last_ack_sent == sock->connect.ack)
+        return;
+    tcp_ack_stats.delayed++;
+    buf_init(&txbuf, 0);
+    tcp_send(&txbuf, &sock->connect, tcp_flags_ack);
+}
+
+typedef void (*tcp_timer_handler_t)(tcp_sock_t* sock);
+
+static const tcp_timer_handler_t tcp_timer_handler[TCP_TIMER_MAX] = {
+    [TCP_TIMER_RTO] = tcp_rto_expired,
+    [TCP_TIMER_DELACK] = tcp_delack_expired,
+};
+
+static tcp_key_t poll_dead[TCP_POLL_MAX_DEAD];
+static int poll_dead_count;
+
+/**
+ * @brief tcp_poll对每个连接调用：运行到期的定时器，记下已经放弃的连接
+ *
+ * @param key,value,timestamp
+ */
+static void tcp_poll_fn(void* key, void* value, time_t* timestamp) {
+    tcp_sock_t* sock = value;
+    uint64_t now = tcp_now_ms();
+    for (int i = 0; i < TCP_TIMER_MAX && sock->connect.state != TCP_CLOSED; i++) {
+        if (sock->timer[i] && sock->timer[i] <= now) {
+            sock->timer[i] = 0;
+            tcp_timer_handler[i](sock);
+        }
+    }
+    if (sock->connect.state == TCP_CLOSED && poll_dead_count < TCP_POLL_MAX_DEAD)
+        memcpy(&poll_dead[poll_dead_count++], key, sizeof(tcp_key_t));
+}
+
+/**
+ * @brief TCP定时处理，由ethernet_poll在arp_poll之后周期性调用，之后发送队列整体发送。
+ *        推进TIME_WAIT的时间轮，驱动各连接的定时器，回收已经放弃的连接（遍历时不能删除，所以放到遍历之后）
+ *
+ */
+void tcp_poll() {
+    if (!tcp_inited)
+        return;
+    tcp_tw_age();
+    poll_dead_count = 0;
+    map_foreach(&connect_table, tcp_poll_fn);
+    for (int i = 0; i < poll_dead_count; i++) {
+        tcp_connect_t* connect = map_get(&connect_table, &poll_dead[i]);
+        if (connect == NULL)
+            continue;
+        release_tcp_connect(connect);
+        map_delete(&connect_table, &poll_dead[i]);
+    }
+}
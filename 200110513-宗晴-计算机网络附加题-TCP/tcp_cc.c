@@ -0,0 +1,285 @@
+#include <string.h>
+#include "tcp_cc.h"
+
+/**
+ * @brief 初始窗口（RFC 6928）
+ *
+ * @param mss
+ * @return uint32_t
+ */
+static uint32_t tcp_cc_initial_window(uint32_t mss) {
+    uint32_t iw = 10 * mss;
+    uint32_t cap = 2 * mss > 14600 ? 2 * mss : 14600;
+    return iw < cap ? iw : cap;
+}
+
+/**
+ * @brief 丢包后的慢启动阈值：在途数据的一半，至少两个报文段（RFC 5681）
+ *
+ * @param cc
+ * @param in_flight
+ * @return uint32_t
+ */
+static uint32_t tcp_cc_half_flight(tcp_cc_t* cc, uint32_t in_flight) {
+    uint32_t half = in_flight / 2;
+    return half > 2 * cc->mss ? half : 2 * cc->mss;
+}
+
+/**
+ * @brief 慢启动：每确认一个报文段窗口增加一个报文段（RFC 3465，L=2）
+ *
+ * @param cc
+ * @param acked
+ */
+static void tcp_cc_slow_start(tcp_cc_t* cc, uint32_t acked) {
+    cc->cwnd += acked < 2 * cc->mss ? acked : 2 * cc->mss;
+}
+
+/**
+ * @brief 初始化一个连接的拥塞控制状态
+ *
+ * @param cc
+ * @param ops 拥塞控制算法，为NULL时使用TCP_CC_DEFAULT
+ * @param mss
+ */
+void tcp_cc_init(tcp_cc_t* cc, const tcp_cc_ops_t* ops, uint32_t mss) {
+    memset(cc, 0, sizeof(tcp_cc_t));
+    cc->ops = ops ? ops : tcp_cc_find(TCP_CC_DEFAULT);
+    cc->mss = mss;
+    cc->cwnd = tcp_cc_initial_window(mss);
+    cc->ssthresh = UINT32_MAX;
+    if (cc->ops->init)
+        cc->ops->init(cc);
+}
+
+/* Reno（RFC 5681）：慢启动，拥塞避免阶段每个RTT增加一个报文段，丢包时减半 */
+
+static void reno_on_ack(tcp_cc_t* cc, uint32_t acked, uint32_t in_flight, uint64_t now) {
+    if (cc->cwnd < cc->ssthresh) {
+        tcp_cc_slow_start(cc, acked);
+        return;
+    }
+    cc->priv.reno.acked += acked;
+    if (cc->priv.reno.acked >= cc->cwnd) {
+        cc->priv.reno.acked -= cc->cwnd;
+        cc->cwnd += cc->mss;
+    }
+}
+
+static void reno_on_loss(tcp_cc_t* cc, uint32_t in_flight, int timeout, uint64_t now) {
+    cc->ssthresh = tcp_cc_half_flight(cc, in_flight);
+    cc->cwnd = timeout ? cc->mss : cc->ssthresh;
+    cc->priv.reno.acked = 0;
+}
+
+const tcp_cc_ops_t tcp_cc_reno = {
+    .name = "reno",
+    .on_ack = reno_on_ack,
+    .on_loss = reno_on_loss,
+};
+
+/* CUBIC（RFC 9438）：窗口按到上次丢包时间的三次函数增长，不小于Reno估计的窗口 */
+
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+
+/**
+ * @brief 立方根，x >= 0，用牛顿迭代，避免依赖libm
+ *
+ * @param x
+ * @return double
+ */
+static double cubic_cbrt(double x) {
+    if (x <= 0)
+        return 0;
+    double y = x > 1 ? x / 3 : 1;
+    for (int i = 0; i < 64; i++) {
+        double next = y - (y * y * y - x) / (3 * y * y);
+        if (next == y)
+            break;
+        y = next;
+    }
+    return y;
+}
+
+static void cubic_on_ack(tcp_cc_t* cc, uint32_t acked, uint32_t in_flight, uint64_t now) {
+    if (cc->cwnd < cc->ssthresh) {
+        tcp_cc_slow_start(cc, acked);
+        return;
+    }
+    typeof(cc->priv.cubic)* c = &cc->priv.cubic;
+    double w = (double)cc->cwnd / cc->mss;
+    if (c->epoch == 0) {
+        c->epoch = now;
+        c->w_est = w;
+        if (w < c->w_max) {
+            c->k = cubic_cbrt((c->w_max - w) / CUBIC_C);
+        } else {
+            c->k = 0;
+            c->w_max = w;
+        }
+    }
+    double t = (double)(now - c->epoch + c->min_rtt) / 1000;
+    double target = c->w_max + CUBIC_C * (t - c->k) * (t - c->k) * (t - c->k);
+    if (target < w)
+        target = w;
+    if (target > 1.5 * w)
+        target = 1.5 * w;
+    // Reno友好区域
+    c->w_est += 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * acked / cc->cwnd;
+    if (c->w_est > target)
+        target = c->w_est;
+    c->frac += (target - w) / w * acked;
+    if (c->frac >= 1) {
+        cc->cwnd += (uint32_t)c->frac;
+        c->frac -= (uint32_t)c->frac;
+    }
+}
+
+static void cubic_on_loss(tcp_cc_t* cc, uint32_t in_flight, int timeout, uint64_t now) {
+    typeof(cc->priv.cubic)* c = &cc->priv.cubic;
+    double w = (double)cc->cwnd / cc->mss;
+    // 快速收敛：窗口比上次丢包时还小，说明有新的流加入，让出更多带宽
+    c->w_max = w < c->w_max ? w * (1 + CUBIC_BETA) / 2 : w;
+    c->epoch = 0;
+    c->frac = 0;
+    uint32_t ssthresh = cc->cwnd * CUBIC_BETA;
+    cc->ssthresh = ssthresh > 2 * cc->mss ? ssthresh : 2 * cc->mss;
+    cc->cwnd = timeout ? cc->mss : cc->ssthresh;
+}
+
+static void cubic_on_rtt(tcp_cc_t* cc, uint32_t rtt, uint64_t now) {
+    if (cc->priv.cubic.min_rtt == 0 || rtt < cc->priv.cubic.min_rtt)
+        cc->priv.cubic.min_rtt = rtt;
+}
+
+const tcp_cc_ops_t tcp_cc_cubic = {
+    .name = "cubic",
+    .on_ack = cubic_on_ack,
+    .on_loss = cubic_on_loss,
+    .on_rtt = cubic_on_rtt,
+};
+
+/* 简化的BBR：按轮估计瓶颈带宽和最小RTT，窗口设为增益乘以带宽时延积。
+   没有发送速率控制（pacing），PROBE_BW阶段的增益循环直接作用在窗口上 */
+
+#define BBR_STARTUP 0
+#define BBR_DRAIN 1
+#define BBR_PROBE_BW 2
+#define BBR_STARTUP_GAIN 2.89
+#define BBR_MIN_RTT_WINDOW 10000
+#define BBR_MIN_CWND_SEGS 4
+
+static const double bbr_cycle_gain[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+
+static uint32_t bbr_max_bw(tcp_cc_t* cc) {
+    uint32_t bw = 0;
+    for (int i = 0; i < TCP_CC_BBR_BW_ROUNDS; i++)
+        if (cc->priv.bbr.bw[i] > bw)
+            bw = cc->priv.bbr.bw[i];
+    return bw;
+}
+
+static uint32_t bbr_bdp(tcp_cc_t* cc) {
+    return (uint64_t)bbr_max_bw(cc) * cc->priv.bbr.min_rtt / 1000;
+}
+
+/**
+ * @brief 一轮（在途数据全部被确认）结束：记录投递速率，推进状态机
+ *
+ */
+static void bbr_round_end(tcp_cc_t* cc, uint32_t in_flight, uint64_t now) {
+    typeof(cc->priv.bbr)* b = &cc->priv.bbr;
+    if (now > b->round_start) {
+        uint64_t rate = (b->delivered - b->round_delivered) * 1000 / (now - b->round_start);
+        b->bw[b->round % TCP_CC_BBR_BW_ROUNDS] = rate > UINT32_MAX ? UINT32_MAX : rate;
+    }
+    b->round++;
+    b->round_start = now;
+    b->round_delivered = b->delivered;
+    b->round_end = b->delivered + (in_flight ? in_flight : cc->mss);
+
+    uint32_t bw = bbr_max_bw(cc);
+    switch (b->mode) {
+        case BBR_STARTUP:
+            // 连续3轮带宽增长不到25%，认为管道已满
+            if (bw >= b->full_bw + b->full_bw / 4) {
+                b->full_bw = bw;
+                b->full_bw_cnt = 0;
+            } else if (++b->full_bw_cnt >= 3) {
+                b->mode = BBR_DRAIN;
+            }
+            break;
+        case BBR_DRAIN:
+            if (in_flight <= bbr_bdp(cc))
+                b->mode = BBR_PROBE_BW;
+            break;
+        case BBR_PROBE_BW:
+            b->cycle = (b->cycle + 1) % (sizeof(bbr_cycle_gain) / sizeof(bbr_cycle_gain[0]));
+            break;
+    }
+}
+
+static void bbr_on_ack(tcp_cc_t* cc, uint32_t acked, uint32_t in_flight, uint64_t now) {
+    typeof(cc->priv.bbr)* b = &cc->priv.bbr;
+    if (b->round_start == 0) {
+        b->round_start = now;
+        b->round_end = in_flight;
+    }
+    b->delivered += acked;
+    if (b->delivered >= b->round_end)
+        bbr_round_end(cc, in_flight, now);
+
+    uint32_t bdp = bbr_bdp(cc);
+    uint32_t min_cwnd = BBR_MIN_CWND_SEGS * cc->mss;
+    if (bdp == 0) {
+        tcp_cc_slow_start(cc, acked);
+        return;
+    }
+    double gain = b->mode == BBR_STARTUP ? BBR_STARTUP_GAIN :
+        b->mode == BBR_DRAIN ? 1 : bbr_cycle_gain[b->cycle];
+    uint32_t target = bdp * gain;
+    if (target < min_cwnd)
+        target = min_cwnd;
+    if (cc->cwnd < target)
+        cc->cwnd = cc->cwnd + acked < target ? cc->cwnd + acked : target;
+    else
+        cc->cwnd = target;
+}
+
+static void bbr_on_loss(tcp_cc_t* cc, uint32_t in_flight, int timeout, uint64_t now) {
+    // BBR不把丢包当作拥塞信号，只有超时时从一个报文段重新开始，之后很快恢复到带宽时延积
+    cc->ssthresh = cc->cwnd;
+    if (timeout)
+        cc->cwnd = cc->mss;
+}
+
+static void bbr_on_rtt(tcp_cc_t* cc, uint32_t rtt, uint64_t now) {
+    typeof(cc->priv.bbr)* b = &cc->priv.bbr;
+    if (b->min_rtt == 0 || rtt <= b->min_rtt || now - b->min_rtt_stamp > BBR_MIN_RTT_WINDOW) {
+        b->min_rtt = rtt ? rtt : 1;
+        b->min_rtt_stamp = now;
+    }
+}
+
+const tcp_cc_ops_t tcp_cc_bbr = {
+    .name = "bbr",
+    .on_ack = bbr_on_ack,
+    .on_loss = bbr_on_loss,
+    .on_rtt = bbr_on_rtt,
+};
+
+static const tcp_cc_ops_t* const tcp_cc_list[] = {&tcp_cc_reno, &tcp_cc_cubic, &tcp_cc_bbr};
+
+/**
+ * @brief 按名字查找拥塞控制算法
+ *
+ * @param name "reno"、"cubic"或"bbr"
+ * @return const tcp_cc_ops_t* 没有找到返回NULL
+ */
+const tcp_cc_ops_t* tcp_cc_find(const char* name) {
+    for (size_t i = 0; i < sizeof(tcp_cc_list) / sizeof(tcp_cc_list[0]); i++)
+        if (strcmp(tcp_cc_list[i]->name, name) == 0)
+            return tcp_cc_list[i];
+    return NULL;
+}
@@ -0,0 +1,75 @@
+#ifndef TCP_CC_H
+#define TCP_CC_H
+
+#include <stdint.h>
+
+// 默认的拥塞控制算法
+#ifndef TCP_CC_DEFAULT
+#define TCP_CC_DEFAULT "cubic"
+#endif
+
+#define TCP_CC_BBR_BW_ROUNDS 10
+
+struct tcp_cc_ops;
+
+/**
+ * @brief 一个连接的拥塞控制状态，窗口单位为字节，时间单位为毫秒
+ *
+ */
+typedef struct tcp_cc {
+    const struct tcp_cc_ops* ops;
+    uint32_t cwnd;          // 拥塞窗口
+    uint32_t ssthresh;      // 慢启动阈值
+    uint32_t mss;
+    union {
+        struct {
+            uint32_t acked;         // 拥塞避免阶段累计确认的字节数
+        } reno;
+        struct {
+            double w_max;           // 上次丢包时的窗口（报文段数）
+            double k;               // 窗口增长回到w_max所需的时间（秒）
+            double w_est;           // 按Reno估计的窗口（报文段数）
+            double frac;            // 不足一字节的窗口增量
+            uint64_t epoch;         // 本轮拥塞避免开始的时间，为0表示还没开始
+            uint32_t min_rtt;
+        } cubic;
+        struct {
+            uint8_t mode;           // STARTUP、DRAIN或PROBE_BW
+            uint8_t cycle;          // PROBE_BW阶段增益循环的位置
+            uint8_t full_bw_cnt;    // 带宽没有明显增长的轮数
+            uint32_t full_bw;
+            uint32_t bw[TCP_CC_BBR_BW_ROUNDS];  // 最近各轮的投递速率（字节/秒）
+            uint32_t round;         // 轮数
+            uint64_t delivered;     // 累计被确认的字节数
+            uint64_t round_end;     // delivered到达这里时本轮结束
+            uint64_t round_delivered;
+            uint64_t round_start;   // 本轮开始的时间
+            uint32_t min_rtt;
+            uint64_t min_rtt_stamp;
+        } bbr;
+    } priv;
+} tcp_cc_t;
+
+/**
+ * @brief 拥塞控制算法的回调函数
+ *
+ */
+typedef struct tcp_cc_ops {
+    const char* name;
+    void (*init)(tcp_cc_t* cc);
+    // 新数据被确认，不在快速恢复中时调用
+    void (*on_ack)(tcp_cc_t* cc, uint32_t acked, uint32_t in_flight, uint64_t now);
+    // 检测到丢包：timeout为0表示快速重传，为1表示超时
+    void (*on_loss)(tcp_cc_t* cc, uint32_t in_flight, int timeout, uint64_t now);
+    // 新的RTT样本
+    void (*on_rtt)(tcp_cc_t* cc, uint32_t rtt, uint64_t now);
+} tcp_cc_ops_t;
+
+extern const tcp_cc_ops_t tcp_cc_reno;
+extern const tcp_cc_ops_t tcp_cc_cubic;
+extern const tcp_cc_ops_t tcp_cc_bbr;
+
+const tcp_cc_ops_t* tcp_cc_find(const char* name);
+void tcp_cc_init(tcp_cc_t* cc, const tcp_cc_ops_t* ops, uint32_t mss);
+
+#endif
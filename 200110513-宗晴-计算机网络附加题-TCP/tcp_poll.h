@@ -0,0 +1,7 @@
+#ifndef TCP_POLL_H
+#define TCP_POLL_H
+
+// TCP定时处理，定义在tcp.c，由ethernet_poll周期调用：推进TIME_WAIT的时间轮、运行各连接到期的定时器、回收已经放弃的连接
+void tcp_poll();
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef TCP_RING_H
+#define TCP_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+/**
+ * @brief 字节环形缓冲区，用作连接的发送和接收缓冲区。
+ *        容量是2的幂，head、tail只增不减，用mask取模，回绕时分两段拷贝，不需要搬移数据。
+ *        [head, tail)是缓冲区中的数据；接收端的乱序数据可以先写到tail之后，连起来后再推进tail
+ *
+ */
+typedef struct tcp_ring {
+    uint8_t* data;
+    uint32_t mask;      // 容量-1
+    uint32_t head;      // 第一个字节的位置
+    uint32_t tail;      // 最后一个字节之后的位置
+} tcp_ring_t;
+
+/**
+ * @brief 初始化环形缓冲区
+ *
+ * @param r
+ * @param mem 存储空间，至少size字节
+ * @param size 容量，必须是2的幂
+ */
+static inline void tcp_ring_init(tcp_ring_t* r, uint8_t* mem, uint32_t size) {
+    r->data = mem;
+    r->mask = size - 1;
+    r->head = r->tail = 0;
+}
+
+static inline uint32_t tcp_ring_size(const tcp_ring_t* r) {
+    return r->mask + 1;
+}
+
+static inline uint32_t tcp_ring_used(const tcp_ring_t* r) {
+    return r->tail - r->head;
+}
+
+static inline uint32_t tcp_ring_free(const tcp_ring_t* r) {
+    return tcp_ring_size(r) - tcp_ring_used(r);
+}
+
+/**
+ * @brief 从pos开始的len字节在存储空间中的位置，回绕时分成两段
+ *
+ * @param r
+ * @param pos 起始位置（没有取模）
+ * @param len 长度，不超过容量
+ * @param iov 至少2个元素
+ * @return int 段数，len为0时为0
+ */
+static inline int tcp_ring_iov(const tcp_ring_t* r, uint32_t pos, uint32_t len, struct iovec* iov) {
+    if (len == 0)
+        return 0;
+    uint32_t off = pos & r->mask;
+    uint32_t first = tcp_ring_size(r) - off;
+    iov[0].iov_base = r->data + off;
+    if (len <= first) {
+        iov[0].iov_len = len;
+        return 1;
+    }
+    iov[0].iov_len = first;
+    iov[1].iov_base = r->data;
+    iov[1].iov_len = len - first;
+    return 2;
+}
+
+/**
+ * @brief 把数据写到tail之后offset处，不移动tail，调用者保证不超过容量
+ *
+ * @param r
+ * @param offset
+ * @param src
+ * @param len
+ */
+static inline void tcp_ring_write_at(tcp_ring_t* r, uint32_t offset, const uint8_t* src, uint32_t len) {
+    struct iovec iov[2];
+    int n = tcp_ring_iov(r, r->tail + offset, len, iov);
+    for (int i = 0; i < n; i++) {
+        memcpy(iov[i].iov_base, src, iov[i].iov_len);
+        src += iov[i].iov_len;
+    }
+}
+
+/**
+ * @brief 从head之后offset处拷贝数据，不移动head，调用者保证不超过已有的数据
+ *
+ * @param r
+ * @param offset
+ * @param dst
+ * @param len
+ */
+static inline void tcp_ring_peek_at(const tcp_ring_t* r, uint32_t offset, uint8_t* dst, uint32_t len) {
+    struct iovec iov[2];
+    int n = tcp_ring_iov(r, r->head + offset, len, iov);
+    for (int i = 0; i < n; i++) {
+        memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+        dst += iov[i].iov_len;
+    }
+}
+
+/**
+ * @brief 在末尾追加数据，放不下时只写入能放下的部分
+ *
+ * @param r
+ * @param src
+ * @param len
+ * @return uint32_t 写入的字节数
+ */
+static inline uint32_t tcp_ring_write(tcp_ring_t* r, const uint8_t* src, size_t len) {
+    uint32_t n = tcp_ring_free(r);
+    if (len < n)
+        n = len;
+    tcp_ring_write_at(r, 0, src, n);
+    r->tail += n;
+    return n;
+}
+
+/**
+ * @brief 从开头取出数据
+ *
+ * @param r
+ * @param dst
+ * @param len
+ * @return uint32_t 取出的字节数
+ */
+static inline uint32_t tcp_ring_read(tcp_ring_t* r, uint8_t* dst, size_t len) {
+    uint32_t n = tcp_ring_used(r);
+    if (len < n)
+        n = len;
+    tcp_ring_peek_at(r, 0, dst, n);
+    r->head += n;
+    return n;
+}
+
+/**
+ * @brief 丢弃开头的数据，不超过已有的数据
+ *
+ * @param r
+ * @param len
+ */
+static inline void tcp_ring_consume(tcp_ring_t* r, size_t len) {
+    uint32_t used = tcp_ring_used(r);
+    r->head += len < used ? len : used;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_link.h"
+
+// 拥塞控制算法在瓶颈链路上的对比：10Mbit/s、往返20ms（带宽时延积25KB）的链路上传输4MB，
+// 分别用浅队列（16KB）、深队列（64KB）和有1%随机丢包的深队列，
+// 比较Reno、CUBIC、BBR的吞吐量、瓶颈队列中的平均排队时延、队列丢包和重传量。
+// 对端不协商窗口扩大，接收窗口为65535字节，拥塞窗口最多也只能用到这么多。
+//
+// 用法：tcp_cc_bench [每种情况运行的次数，默认3]
+// 协议栈的调试信息打印在stdout，结果打印在stderr，可以用 tcp_cc_bench > /dev/null 只看结果
+
+#define PORT 80
+
+int main(int argc, char **argv)
+{
+    static const char *algorithms[] = {"reno", "cubic", "bbr"};
+    static const struct {
+        size_t queue;
+        double loss;
+    } links[] = {{16 * 1024, 0}, {64 * 1024, 0}, {64 * 1024, 0.01}};
+    int runs = argc > 1 ? atoi(argv[1]) : 3;
+    if(runs < 1) runs = 1;
+    test_setup();
+    fprintf(stderr, "%6s %5s %6s %8s %9s %8s %7s\n", "queue", "loss", "cc", "Mbit/s", "queue ms", "q drops", "retx %");
+    for(size_t l = 0; l < sizeof(links) / sizeof(links[0]); l++) {
+        for(size_t a = 0; a < sizeof(algorithms) / sizeof(algorithms[0]); a++) {
+            test_link_config_t config = {
+                .rate = 1250,
+                .delay = 10,
+                .queue = links[l].queue,
+                .loss = links[l].loss,
+                .sack = 1,
+                .cc = algorithms[a],
+                .total = 4 << 20,
+            };
+            uint64_t ms = 0;
+            size_t drops = 0, sent = 0;
+            double queue_ms = 0;
+            for(int run = 0; run < runs; run++) {
+                test_link_result_t result;
+                config.seed = run + 1;
+                test_link_run(PORT, &config, &result);
+                ms += result.ms;
+                drops += result.queue_drops;
+                sent += result.sent;
+                queue_ms += result.queue_ms;
+            }
+            fprintf(stderr, "%5zuK %4.0f%% %6s %8.2f %9.1f %8.1f %6.1f%%\n", links[l].queue / 1024,
+                links[l].loss * 100, algorithms[a], config.total * 8.0 * runs / ms / 1000, queue_ms / runs,
+                (double)drops / runs, (sent - config.total * runs) * 100.0 / (config.total * runs));
+        }
+    }
+    fprintf(stderr, "ok\n");
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "tcp_test.h"
+#include "test_driver.h"
+
+// 丢包测试：对端是一个只接收按序报文段、每个报文段都回复累计确认的接收方，
+// 协议栈发出的帧经test_driver按给定概率丢弃。
+// 检查数据完整到达、FIN最终被发送，以及FIN被确认后重复ACK不会触发重传。
+//
+// 用法：tcp_loss_test [丢包率百分比，默认10] [随机数种子，默认1]
+
+#define PORT 80
+#define PEER_PORT 5555
+#define PEER_ISN 1000
+#define TOTAL (200 * 1024)
+#define MAX_STEPS 200000
+
+static uint8_t src[TOTAL], got[TOTAL];
+static size_t written;
+static tcp_connect_t *conn;
+
+static void handler(tcp_connect_t *connect, connect_state_t state)
+{
+    conn = state == TCP_CONN_CLOSED ? NULL : connect;
+    if(state == TCP_CONN_CONNECTED)
+        written += tcp_connect_write(connect, src, TOTAL);
+}
+
+static const tcp_flags_t flags_syn = {.syn = 1};
+static const tcp_flags_t flags_ack = {.ack = 1};
+static const tcp_flags_t flags_fin_ack = {.fin = 1, .ack = 1};
+
+int main(int argc, char **argv)
+{
+    int loss = argc > 1 ? atoi(argv[1]) : 10;
+    unsigned seed = argc > 2 ? atoi(argv[2]) : 1;
+    static test_seg_t segs[256];
+    for(size_t i = 0; i < TOTAL; i++)
+        src[i] = i * 131 + (i >> 8);
+
+    test_setup();
+    tcp_open(PORT, handler);
+
+    // 三次握手时不丢包
+    test_peer_send(PEER_PORT, PORT, flags_syn, PEER_ISN, 0, 65535, NULL, 0, NULL, 0);
+    int n = test_take(segs, 256);
+    TEST_CHECK(n == 1 && segs[0].flags.syn && segs[0].flags.ack);
+    uint32_t iss = segs[0].seq;
+    test_peer_send(PEER_PORT, PORT, flags_ack, PEER_ISN + 1, iss + 1, 65535, NULL, 0, NULL, 0);
+    TEST_CHECK(conn != NULL);
+    test_driver_set_loss(loss, seed);
+
+    uint32_t expect = iss + 1;
+    int fin = 0, steps = 0;
+    size_t segments = 0;
+    while(!fin && steps++ < MAX_STEPS) {
+        if(conn && written < TOTAL)
+            written += tcp_connect_write(conn, src + written, TOTAL - written);
+        if(conn && written == TOTAL && expect - iss - 1 == TOTAL) {
+            tcp_connect_close(conn);
+            written++;
+        }
+        n = test_take(segs, 256);
+        for(int i = 0; i < n; i++) {
+            segments++;
+            test_seg_t *seg = &segs[i];
+            if(seg->seq == expect) {
+                TEST_CHECK(expect - iss - 1 + seg->len <= TOTAL);
+                memcpy(got + (expect - iss - 1), seg->data, seg->len);
+                expect += seg->len;
+                if(seg->flags.fin) {
+                    expect++;
+                    fin = 1;
+                }
+            }
+            test_peer_send(PEER_PORT, PORT, flags_ack, PEER_ISN + 1, expect, 65535, NULL, 0, NULL, 0);
+        }
+        test_advance(10);
+    }
+    printf("loss %d%%: %zu segments, %zu dropped, %llu ms\n", loss, segments, test_driver_dropped(),
+        (unsigned long long)steps * 10);
+    TEST_CHECK(fin);
+    TEST_CHECK(expect - iss - 2 == TOTAL);
+    TEST_CHECK(memcmp(src, got, TOTAL) == 0);
+
+    // FIN已经被确认（FIN_WAIT_2），再收到重复ACK时没有可以重传的数据
+    test_driver_set_loss(0, 0);
+    test_take(segs, 256);
+    for(int i = 0; i < 4; i++)
+        test_peer_send(PEER_PORT, PORT, flags_ack, PEER_ISN + 1, expect, 65535, NULL, 0, NULL, 0);
+    for(int i = 0; i < 100; i++)
+        test_advance(100);
+    n = test_take(segs, 256);
+    for(int i = 0; i < n; i++)
+        TEST_CHECK(segs[i].len == 0 && !segs[i].flags.fin);
+
+    // 对端关闭，连接进入TIME_WAIT
+    test_peer_send(PEER_PORT, PORT, flags_fin_ack, PEER_ISN + 1, expect, 65535, NULL, 0, NULL, 0);
+    n = test_take(segs, 256);
+    TEST_CHECK(n == 1 && segs[0].flags.ack && segs[0].ack == PEER_ISN + 2);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_link.h"
+
+// 有随机丢包的链路上的传输时间：在10Mbit/s、往返40ms的链路上传输1MB，
+// 丢包率从0到5%，分别在对端允许和不允许SACK时运行，比较完成时间和重传量。
+// 不允许SACK时只有快速重传和NewReno，每个往返只能修复一个丢失的报文段。
+// 丢包位置对结果影响很大，每种情况用多个随机数种子运行，取平均。
+//
+// 用法：tcp_lossy_bench [每种情况运行的次数，默认10]
+// 协议栈的调试信息打印在stdout，结果打印在stderr，可以用 tcp_lossy_bench > /dev/null 只看结果
+
+#define PORT 80
+
+int main(int argc, char **argv)
+{
+    static const double losses[] = {0, 0.005, 0.01, 0.02, 0.05};
+    int runs = argc > 1 ? atoi(argv[1]) : 10;
+    if(runs < 1) runs = 1;
+    test_setup();
+    fprintf(stderr, "%6s %5s %10s %10s %8s %8s\n", "loss", "sack", "time ms", "Mbit/s", "drops", "retx %");
+    for(size_t i = 0; i < sizeof(losses) / sizeof(losses[0]); i++) {
+        for(int sack = 1; sack >= 0; sack--) {
+            test_link_config_t config = {
+                .rate = 1250,
+                .delay = 20,
+                .queue = 256 * 1024,
+                .loss = losses[i],
+                .sack = sack,
+                .total = 1 << 20,
+            };
+            uint64_t ms = 0;
+            size_t drops = 0, sent = 0;
+            for(int run = 0; run < runs; run++) {
+                test_link_result_t result;
+                config.seed = run + 1;
+                test_link_run(PORT, &config, &result);
+                ms += result.ms;
+                drops += result.random_drops + result.queue_drops;
+                sent += result.sent;
+            }
+            fprintf(stderr, "%5.1f%% %5s %10.0f %10.2f %8.1f %7.1f%%\n", losses[i] * 100, sack ? "on" : "off",
+                (double)ms / runs, config.total * 8.0 * runs / ms / 1000, (double)drops / runs,
+                (sent - config.total * runs) * 100.0 / (config.total * runs));
+        }
+    }
+    fprintf(stderr, "ok\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "tcp_test.h"
+#include "ip.h"
+#include "icmp.h"
+#include "utils.h"
+#include "pmtu.h"
+
+// 路径MTU测试：连接建立后，对端方向的路由器回复“需要分片”的目的不可达报文，报文段随之变小。
+// 引用的数据报不是本机这个连接发出的（协议不是TCP、没有DF、端口或序号对不上、目的地址不是对端）时，
+// 路径MTU不变；下一跳MTU小得离谱时只降到下限552。
+// 对端的SYN只带MSS选项，报文段长度就是路径MTU减去40字节的首部。
+
+#define PORT 80
+#define PEER_PORT 5555
+#define PEER_ISN 1000
+#define MTU 1000
+#define PMTU_MIN 552            // ip.c中IP_PMTU_MIN的默认值
+
+static tcp_connect_t *conn;
+static uint32_t acked;
+static uint8_t src[16 * 1024];
+static test_seg_t segs[64];
+
+static void handler(tcp_connect_t *connect, connect_state_t state)
+{
+    conn = state == TCP_CONN_CLOSED ? NULL : connect;
+}
+
+static const tcp_flags_t flags_syn = {.syn = 1};
+static const tcp_flags_t flags_ack = {.ack = 1};
+static const uint8_t opt_mss[] = {2, 4, 1460 >> 8, 1460 & 0xFF};
+
+/**
+ * @brief 路由器回复的“需要分片”报文，引用一个从本机发往dst的数据报
+ *
+ */
+static void frag_needed(uint16_t mtu, uint8_t protocol, int df, const uint8_t *dst, uint16_t sport, uint16_t dport,
+    uint32_t seq)
+{
+    static buf_t buf;
+    buf_init(&buf, sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8);
+    memset(buf.data, 0, buf.len);
+    icmp_hdr_t *icmp = (icmp_hdr_t *)buf.data;
+    icmp->type = ICMP_TYPE_UNREACH;
+    icmp->code = 4;
+    icmp->seq16 = swap16(mtu);
+    ip_hdr_t *ip = (ip_hdr_t *)(buf.data + sizeof(icmp_hdr_t));
+    ip->version = IP_VERSION_4;
+    ip->hdr_len = sizeof(ip_hdr_t) / 4;
+    ip->protocol = protocol;
+    ip->flags_fragment16 = swap16(df ? 1 << 14 : 0);
+    memcpy(ip->src_ip, net_if_ip, NET_IP_LEN);
+    memcpy(ip->dst_ip, dst, NET_IP_LEN);
+    uint16_t port[2] = {swap16(sport), swap16(dport)};
+    uint32_t seq32 = swap32(seq);
+    memcpy(buf.data + sizeof(icmp_hdr_t) + sizeof(ip_hdr_t), port, sizeof(port));
+    memcpy(buf.data + sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 4, &seq32, sizeof(seq32));
+    icmp->checksum16 = checksum16((uint16_t *)buf.data, buf.len);
+    icmp_in(&buf, test_peer_ip);
+}
+
+/**
+ * @brief 应用写入一批数据，返回这次发出的最长报文段，然后对端确认全部数据
+ *
+ */
+static int send_round()
+{
+    tcp_connect_write(conn, src, sizeof(src));
+    int n = test_take(segs, 64), max = 0;
+    for(int i = 0; i < n; i++) {
+        if(segs[i].len > max) max = segs[i].len;
+        if((int32_t)(segs[i].seq + segs[i].len - acked) > 0) acked = segs[i].seq + segs[i].len;
+    }
+    TEST_CHECK(max > 0);
+    test_peer_send(PEER_PORT, PORT, flags_ack, PEER_ISN + 1, acked, 65535, NULL, 0, NULL, 0);
+    // 确认之后发出的报文段也确认掉，下一轮之前没有未确认的数据
+    while((n = test_take(segs, 64)) > 0) {
+        for(int i = 0; i < n; i++)
+            if((int32_t)(segs[i].seq + segs[i].len - acked) > 0) acked = segs[i].seq + segs[i].len;
+        test_peer_send(PEER_PORT, PORT, flags_ack, PEER_ISN + 1, acked, 65535, NULL, 0, NULL, 0);
+    }
+    return max;
+}
+
+int main()
+{
+    test_setup();
+    tcp_open(PORT, handler);
+    test_peer_send(PEER_PORT, PORT, flags_syn, PEER_ISN, 0, 65535, NULL, 0, opt_mss, sizeof(opt_mss));
+    int n = test_take(segs, 64);
+    TEST_CHECK(n == 1 && segs[0].flags.syn && segs[0].flags.ack);
+    acked = segs[0].seq + 1;
+    test_peer_send(PEER_PORT, PORT, flags_ack, PEER_ISN + 1, acked, 65535, NULL, 0, NULL, 0);
+    TEST_CHECK(conn != NULL);
+    TEST_CHECK(send_round() == 1460);
+
+    // 伪造的报文：都不改变路径MTU
+    uint8_t other_ip[NET_IP_LEN];
+    memcpy(other_ip, test_peer_ip, NET_IP_LEN);
+    other_ip[3]++;
+    frag_needed(MTU, NET_PROTOCOL_UDP, 1, test_peer_ip, PORT, PEER_PORT, acked);
+    frag_needed(MTU, NET_PROTOCOL_TCP, 0, test_peer_ip, PORT, PEER_PORT, acked);
+    frag_needed(MTU, NET_PROTOCOL_TCP, 1, test_peer_ip, PORT, PEER_PORT + 1, acked);
+    frag_needed(MTU, NET_PROTOCOL_TCP, 1, test_peer_ip, PORT, PEER_PORT, acked + 100000);
+    frag_needed(MTU, NET_PROTOCOL_TCP, 1, other_ip, PORT, PEER_PORT, acked);
+    TEST_CHECK(ip_pmtu_get(test_peer_ip) == 1500);
+    TEST_CHECK(send_round() == 1460);
+    printf("spoofed: path MTU unchanged\n");
+
+    // 引用本机发出的报文段：报文段按新的路径MTU发送
+    frag_needed(MTU, NET_PROTOCOL_TCP, 1, test_peer_ip, PORT, PEER_PORT, acked);
+    TEST_CHECK(ip_pmtu_get(test_peer_ip) == MTU);
+    TEST_CHECK(send_round() == MTU - 40);
+    printf("valid: segments shrink to %d\n", MTU - 40);
+
+    // 下一跳MTU低于下限时只降到下限
+    frag_needed(68, NET_PROTOCOL_TCP, 1, test_peer_ip, PORT, PEER_PORT, acked);
+    TEST_CHECK(ip_pmtu_get(test_peer_ip) == PMTU_MIN);
+    TEST_CHECK(send_round() == PMTU_MIN - 40);
+    printf("tiny: clamped to %d\n", PMTU_MIN);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "tcp_test.h"
+#include "test_driver.h"
+
+// 乱序测试：对端发来乱序、重叠和重复的报文段，经tcp_in进入乱序队列。
+// 检查每个重复ACK中的SACK块（最近收到的区间在最前面），填上空洞后确认号一次推进到乱序队列的末尾，
+// 以及应用最终按顺序读到全部数据。
+//
+// 用法：tcp_reorder_test [随机数种子，默认1]
+
+#define PORT 80
+#define PEER_PORT 5555
+#define PEER_ISN 1000
+#define SEG 1000
+#define TOTAL (60 * SEG)
+
+static uint8_t src[TOTAL], got[TOTAL];
+static size_t received;
+
+static void handler(tcp_connect_t *connect, connect_state_t state)
+{
+    if(state == TCP_CONN_DATA_RECV)
+        received += tcp_connect_read(connect, got + received, TOTAL - received);
+}
+
+static const tcp_flags_t flags_syn = {.syn = 1};
+static const tcp_flags_t flags_ack = {.ack = 1};
+static const tcp_flags_t flags_psh_ack = {.psh = 1, .ack = 1};
+
+static uint32_t base, iss;
+static test_seg_t segs[256];
+
+/**
+ * @brief 对端发送src中[from, to)这一段数据
+ * 
+ */
+static void send_range(uint32_t from, uint32_t to)
+{
+    test_peer_send(PEER_PORT, PORT, flags_psh_ack, base + from, iss + 1, 65535, src + from, to - from, NULL, 0);
+}
+
+/**
+ * @brief 取出协议栈立即回复的唯一一个ACK，检查确认号和SACK块
+ * 
+ * @param ack 期望的确认号（相对base）
+ * @param sack 期望的SACK块（相对base），顺序和报文段中的一致
+ * @param count SACK块个数
+ */
+static void expect_ack(uint32_t ack, uint32_t sack[][2], int count)
+{
+    int n = test_take(segs, 256);
+    TEST_CHECK(n == 1 && segs[0].flags.ack && segs[0].len == 0);
+    TEST_CHECK(segs[0].ack == base + ack);
+    uint32_t blocks[4][2];
+    TEST_CHECK(test_sack_blocks(&segs[0], blocks) == count);
+    for(int i = 0; i < count; i++)
+        TEST_CHECK(blocks[i][0] == base + sack[i][0] && blocks[i][1] == base + sack[i][1]);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned seed = argc > 1 ? atoi(argv[1]) : 1;
+    srand(seed);
+    for(size_t i = 0; i < TOTAL; i++)
+        src[i] = rand();
+
+    test_setup();
+    tcp_open(PORT, handler);
+
+    // SYN中带SACK许可（NOP NOP SACK_PERM）
+    uint8_t sack_perm[4] = {1, 1, 4, 2};
+    test_peer_send(PEER_PORT, PORT, flags_syn, PEER_ISN, 0, 65535, NULL, 0, sack_perm, sizeof(sack_perm));
+    int n = test_take(segs, 256);
+    TEST_CHECK(n == 1 && segs[0].flags.syn && segs[0].flags.ack);
+    iss = segs[0].seq;
+    base = PEER_ISN + 1;
+    test_peer_send(PEER_PORT, PORT, flags_ack, base, iss + 1, 65535, NULL, 0, NULL, 0);
+    test_take(segs, 256);
+
+    // 第0段按序到达，跳过第1段。它的ACK被延迟，时钟前进后由同一次轮询中的tcp定时处理发出并交给驱动
+    static buf_t frame;
+    send_range(0, SEG);
+    TEST_CHECK(test_take(segs, 256) == 0);
+    test_advance(100);
+    TEST_CHECK(test_driver_take(&frame));
+    TEST_CHECK(received == SEG);
+
+    send_range(2 * SEG, 3 * SEG);
+    expect_ack(SEG, (uint32_t[][2]){{2 * SEG, 3 * SEG}}, 1);
+
+    // 最近收到的区间放在第一个SACK块
+    send_range(4 * SEG, 5 * SEG);
+    expect_ack(SEG, (uint32_t[][2]){{4 * SEG, 5 * SEG}, {2 * SEG, 3 * SEG}}, 2);
+
+    // 重复的乱序报文段不改变乱序队列
+    send_range(2 * SEG, 3 * SEG);
+    expect_ack(SEG, (uint32_t[][2]){{2 * SEG, 3 * SEG}, {4 * SEG, 5 * SEG}}, 2);
+    TEST_CHECK(received == SEG);
+
+    // 重叠的重传[SEG/2, 5SEG/2)填上第1段的空洞，确认号推进到第2段末尾，只剩[4SEG, 5SEG)
+    send_range(SEG / 2, 5 * SEG / 2);
+    expect_ack(3 * SEG, (uint32_t[][2]){{4 * SEG, 5 * SEG}}, 1);
+    TEST_CHECK(received == 3 * SEG);
+
+    send_range(3 * SEG, 4 * SEG);
+    expect_ack(5 * SEG, NULL, 0);
+    TEST_CHECK(received == 5 * SEG && memcmp(src, got, received) == 0);
+
+    // 剩下的数据每8段打乱一次顺序，并有10%的报文段重复
+    for(int next = 5; next < TOTAL / SEG;) {
+        int order[8], k = 0;
+        for(int i = next; i < TOTAL / SEG && k < 8; i++)
+            order[k++] = i;
+        for(int i = k - 1; i > 0; i--) {
+            int j = rand() % (i + 1);
+            int t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+        for(int i = 0; i < k; i++) {
+            send_range(order[i] * SEG, (order[i] + 1) * SEG);
+            if(rand() % 10 == 0)
+                send_range(order[i] * SEG, (order[i] + 1) * SEG);
+        }
+        next += k;
+        test_advance(5);
+        test_take(segs, 256);
+    }
+    test_advance(100);
+    n = test_take(segs, 256);
+    TEST_CHECK(n == 0 || segs[n - 1].ack == base + TOTAL);
+    TEST_CHECK(received == TOTAL && memcmp(src, got, TOTAL) == 0);
+    printf("ok\n");
+    return 0;
+}
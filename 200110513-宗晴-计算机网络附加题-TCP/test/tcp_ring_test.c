@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tcp_ring.h"
+
+// tcp_ring.h的正确性测试和吞吐量对比：
+// 随机地写入、读出、查看、丢弃和在tail之后写入乱序数据，每一步都和一个不回绕的参考队列比较，
+// 头尾位置从接近2^32的地方开始，覆盖下标溢出的情况。
+// 然后模拟发送缓冲区的用法（应用写入一块，被确认的数据从开头丢弃，缓冲区保持接近满），
+// 和原来用一个线性缓冲区、写到末尾放不下时把剩余数据memmove到开头的做法比较吞吐量。
+// 两者容量相同，都是64KB，测试环形缓冲区时再加上更大的容量。
+//
+// 只依赖tcp_ring.h，不需要实验框架
+// 编译：gcc -std=gnu11 -O2 -I.. tcp_ring_test.c -o tcp_ring_test
+// 用法：tcp_ring_test [每种情况经过缓冲区的字节数，单位MB，默认256]
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while(0)
+
+#define TEST_SIZE 4096
+#define TEST_STEPS 200000
+
+/**
+ * @brief 参考队列：ref[0, ref_len)是缓冲区中的数据
+ *
+ */
+static uint8_t ref[TEST_SIZE];
+static uint32_t ref_len;
+
+static void fill(uint8_t *p, uint32_t len)
+{
+    for(uint32_t i = 0; i < len; i++)
+        p[i] = rand();
+}
+
+static void check_contents(const tcp_ring_t *r)
+{
+    static uint8_t got[TEST_SIZE];
+    CHECK(tcp_ring_used(r) == ref_len && tcp_ring_free(r) == TEST_SIZE - ref_len);
+    tcp_ring_peek_at(r, 0, got, ref_len);
+    CHECK(memcmp(got, ref, ref_len) == 0);
+}
+
+/**
+ * @brief 随机操作，和参考队列比较
+ *
+ */
+static void test_random()
+{
+    static uint8_t mem[TEST_SIZE], src[TEST_SIZE], dst[TEST_SIZE];
+    tcp_ring_t r;
+    tcp_ring_init(&r, mem, TEST_SIZE);
+    r.head = r.tail = UINT32_MAX - 3 * TEST_SIZE;
+    ref_len = 0;
+    for(int step = 0; step < TEST_STEPS; step++) {
+        uint32_t len = rand() % (TEST_SIZE + TEST_SIZE / 4);
+        switch(rand() % 6) {
+            case 0: {
+                // 写入，放不下时只写入能放下的部分
+                if(len > TEST_SIZE) len = TEST_SIZE;
+                fill(src, len);
+                uint32_t n = tcp_ring_write(&r, src, len);
+                uint32_t expect = TEST_SIZE - ref_len;
+                if(len < expect) expect = len;
+                CHECK(n == expect);
+                memcpy(ref + ref_len, src, n);
+                ref_len += n;
+                break;
+            }
+            case 1: {
+                uint32_t n = tcp_ring_read(&r, dst, len);
+                CHECK(n == (len < ref_len ? len : ref_len));
+                CHECK(memcmp(dst, ref, n) == 0);
+                memmove(ref, ref + n, ref_len - n);
+                ref_len -= n;
+                break;
+            }
+            case 2: {
+                uint32_t n = len < ref_len ? len : ref_len;
+                tcp_ring_consume(&r, len);
+                memmove(ref, ref + n, ref_len - n);
+                ref_len -= n;
+                break;
+            }
+            case 3: {
+                // 不拷贝地查看：两段拼起来就是全部数据，回绕时第二段从存储空间开头开始
+                struct iovec iov[2];
+                int n = tcp_ring_iov(&r, r.head, ref_len, iov);
+                CHECK(n == (ref_len == 0 ? 0 : (r.head & r.mask) + ref_len > TEST_SIZE ? 2 : 1));
+                uint32_t off = 0;
+                for(int i = 0; i < n; i++) {
+                    CHECK(memcmp(iov[i].iov_base, ref + off, iov[i].iov_len) == 0);
+                    off += iov[i].iov_len;
+                }
+                CHECK(off == ref_len && (n < 2 || iov[1].iov_base == mem));
+                break;
+            }
+            case 4: {
+                // 乱序数据先写到tail之后，再推进tail把它连上
+                uint32_t space = TEST_SIZE - ref_len;
+                if(space == 0) break;
+                uint32_t offset = rand() % space;
+                uint32_t n = len % (space - offset + 1);
+                fill(src, offset + n);
+                tcp_ring_write_at(&r, offset, src + offset, n);
+                tcp_ring_write_at(&r, 0, src, offset);
+                r.tail += offset + n;
+                memcpy(ref + ref_len, src, offset + n);
+                ref_len += offset + n;
+                break;
+            }
+            default: {
+                uint32_t offset = ref_len ? rand() % ref_len : 0;
+                uint32_t n = len % (ref_len - offset + 1);
+                tcp_ring_peek_at(&r, offset, dst, n);
+                CHECK(memcmp(dst, ref + offset, n) == 0);
+                break;
+            }
+        }
+        check_contents(&r);
+    }
+}
+
+/**
+ * @brief 原来的发送缓冲区：数据在payload[data, data + len)，
+ *        写到末尾放不下时把剩余数据搬到开头（tcp_connect_write），读出时只移动data
+ *
+ */
+typedef struct linear_buf {
+    uint8_t *payload;
+    size_t size;
+    size_t data, len;
+} linear_buf_t;
+
+static size_t linear_write(linear_buf_t *b, const uint8_t *src, size_t len)
+{
+    if(b->size - (b->data + b->len) < len && b->data != 0) {
+        memmove(b->payload, b->payload + b->data, b->len);
+        b->data = 0;
+    }
+    size_t n = b->size - (b->data + b->len);
+    if(len < n) n = len;
+    memcpy(b->payload + b->data + b->len, src, n);
+    b->len += n;
+    return n;
+}
+
+static void linear_consume(linear_buf_t *b, size_t len)
+{
+    if(len > b->len) len = b->len;
+    b->data += len;
+    b->len -= len;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define CHUNK 1460
+
+/**
+ * @brief 发送缓冲区先填到容量减去backlog，之后每次写入一个CHUNK、丢弃一个CHUNK，
+ *        相当于在途数据保持不变，ACK每确认一个报文段应用就补充一个
+ *
+ * @param ring 为0时测试线性缓冲区
+ * @param size 缓冲区容量
+ * @param total 经过缓冲区的字节数
+ * @return double MB/s
+ */
+static double run_bench(int ring, uint32_t size, size_t total)
+{
+    uint8_t *mem = malloc(size);
+    static uint8_t src[CHUNK];
+    fill(src, CHUNK);
+    tcp_ring_t r;
+    tcp_ring_init(&r, mem, size);
+    linear_buf_t b = {.payload = mem, .size = size};
+    size_t backlog = size - 4 * CHUNK;
+    for(size_t n = 0; n < backlog; n += CHUNK) {
+        if(ring) tcp_ring_write(&r, src, CHUNK);
+        else linear_write(&b, src, CHUNK);
+    }
+    double start = now_sec();
+    for(size_t n = 0; n < total; n += CHUNK) {
+        if(ring) {
+            CHECK(tcp_ring_write(&r, src, CHUNK) == CHUNK);
+            tcp_ring_consume(&r, CHUNK);
+        } else {
+            CHECK(linear_write(&b, src, CHUNK) == CHUNK);
+            linear_consume(&b, CHUNK);
+        }
+    }
+    double elapsed = now_sec() - start;
+    free(mem);
+    return total / elapsed / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+    if(mb == 0) mb = 1;
+    srand(1);
+    test_random();
+    printf("random operations ok\n");
+
+    size_t total = mb << 20;
+    printf("%-7s %9s %10s\n", "buffer", "size", "MB/s");
+    printf("%-7s %8uK %10.0f\n", "linear", 64, run_bench(0, 64 * 1024, total));
+    for(uint32_t size = 64 * 1024; size <= 4 * 1024 * 1024; size *= 4)
+        printf("%-7s %8uK %10.0f\n", "ring", size / 1024, run_bench(1, size, total));
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <malloc.h>
+#include <time.h>
+#include "tcp_test.h"
+#include "test_driver.h"
+
+// SYN洪泛测试：对端从大量不同的端口发SYN、从不回复ACK，其中每隔一定数量夹着一个正常的客户端，
+// 它在又有lag个洪泛SYN到达之后才回复握手的ACK（相当于往返时间内到达的洪泛SYN数）。
+// 统计正常客户端建立连接的比例、洪泛期间堆内存的增长，以及处理SYN的速度；
+// 洪泛结束后对每个洪泛SYN都补上ACK，能建立连接的个数就是协议栈为它们保留下来的状态
+// （半连接队列中的连接，或者用cookie回复、不占状态的连接）。
+// 建立的连接随后由对端用RST关闭，每一轮结束时不留下任何连接。
+//
+// 半连接队列长度和SYN cookie模式是tcp.c中的编译期常量，分别用 -DTCP_SYN_COOKIES=0、1、2 编译运行：
+// 0时队列满了淘汰最老的半连接，lag超过队列长度的正常客户端就连不上；1、2时正常客户端都能连上。
+// 所有SYN都来自test_peer_ip，只有端口不同，和来自不同地址的洪泛对协议栈没有区别。
+// SYN的处理速度包含测试程序构造和解析报文段的开销，只用于比较不同模式。
+//
+// 用法：tcp_synflood_bench [每轮的洪泛SYN数，默认40000]
+// 协议栈的调试信息打印在stdout，结果打印在stderr，可以用 tcp_synflood_bench > /dev/null 只看结果
+
+#define PORT 80
+#define FIRST_PORT 1024
+#define LEGIT_EVERY 16
+#define PEER_ISN 1000
+
+static size_t connected;
+static uint32_t syn_ack_seq[65536];
+
+static void handler(tcp_connect_t *connect, connect_state_t state)
+{
+    if(state == TCP_CONN_CONNECTED)
+        connected++;
+}
+
+static const tcp_flags_t flags_syn = {.syn = 1};
+static const tcp_flags_t flags_ack = {.ack = 1};
+static const tcp_flags_t flags_rst = {.rst = 1};
+static const uint8_t opt_mss[] = {2, 4, 1460 >> 8, 1460 & 0xFF};
+
+/**
+ * @brief 取走协议栈发出的报文段，记下每个端口收到的SYN+ACK的序号
+ *
+ */
+static void drain()
+{
+    static test_seg_t segs[64];
+    int n;
+    while((n = test_take(segs, 64)) > 0) {
+        for(int i = 0; i < n; i++)
+            if(segs[i].flags.syn && segs[i].flags.ack)
+                syn_ack_seq[segs[i].dport] = segs[i].seq;
+    }
+}
+
+/**
+ * @brief 对端用ACK完成从sport发起的握手，连接建立后立即用RST关闭
+ *
+ * @return int 建立了连接为1
+ */
+static int complete(uint16_t sport, uint16_t port)
+{
+    size_t before = connected;
+    test_peer_send(sport, port, flags_ack, PEER_ISN + 1, syn_ack_seq[sport] + 1, 65535, NULL, 0, NULL, 0);
+    drain();
+    if(connected == before) return 0;
+    test_peer_send(sport, port, flags_rst, PEER_ISN + 1, 0, 0, NULL, 0, NULL, 0);
+    drain();
+    return 1;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    // tcp_test.c把clock_gettime换成了测试时钟，这里要真实时间
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 一轮洪泛
+ *
+ * @param port 监听的端口，每轮一个
+ * @param flood 洪泛SYN数
+ * @param lag 正常客户端的SYN之后，再到达这么多洪泛SYN它才回复ACK
+ */
+static void run(uint16_t port, size_t flood, size_t lag)
+{
+    static uint16_t pending[65536];
+    size_t pending_head = 0, pending_tail = 0, legit = 0, accepted = 0, sent = 0;
+    uint16_t sport = FIRST_PORT;
+    size_t heap = mallinfo2().uordblks;
+    tcp_open(port, handler);
+
+    double start = now_sec();
+    for(size_t i = 0; i < flood; i++, sport++) {
+        if(i % LEGIT_EVERY == 0) {
+            pending[pending_tail++] = sport++;
+            legit++;
+            test_peer_send(pending[pending_tail - 1], port, flags_syn, PEER_ISN, 0, 65535, NULL, 0, opt_mss, sizeof(opt_mss));
+        }
+        test_peer_send(sport, port, flags_syn, PEER_ISN, 0, 65535, NULL, 0, opt_mss, sizeof(opt_mss));
+        sent++;
+        drain();
+        while(pending_head < pending_tail && sent - (pending_head * LEGIT_EVERY) > lag)
+            accepted += complete(pending[pending_head++], port);
+    }
+    double elapsed = now_sec() - start;
+    size_t growth = mallinfo2().uordblks - heap;
+    while(pending_head < pending_tail)
+        accepted += complete(pending[pending_head++], port);
+
+    // 给每个洪泛SYN补上ACK，看协议栈还认得多少
+    size_t retained = 0;
+    for(uint16_t p = FIRST_PORT; p != sport; p++) {
+        if((p - FIRST_PORT) % (LEGIT_EVERY + 1) == 0) continue;
+        retained += complete(p, port);
+    }
+    tcp_close(port);
+    fprintf(stderr, "%6zu %6zu %8.1f%% %10zu %10zu %10.0f\n", flood, lag, accepted * 100.0 / legit, retained,
+        growth, (flood + legit) / elapsed);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t lags[] = {16, 256, 4096};
+    size_t flood = argc > 1 ? strtoul(argv[1], NULL, 10) : 40000;
+    // 端口不能超过65535，每LEGIT_EVERY个洪泛SYN还夹着一个正常客户端
+    size_t max = (65536 - FIRST_PORT) * LEGIT_EVERY / (LEGIT_EVERY + 1) - LEGIT_EVERY;
+    if(flood == 0 || flood > max) flood = max;
+    test_setup();
+    fprintf(stderr, "%6s %6s %9s %10s %10s %10s\n", "flood", "lag", "accepted", "retained", "heap B", "SYN/s");
+    for(size_t i = 0; i < sizeof(lags) / sizeof(lags[0]); i++)
+        run(PORT + i, flood, lags[i]);
+    fprintf(stderr, "ok\n");
+    return 0;
+}
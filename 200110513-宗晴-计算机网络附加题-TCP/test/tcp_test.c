@@ -0,0 +1,202 @@
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "tcp_test.h"
+#include "test_driver.h"
+
+uint64_t test_now_ms = 1000000;
+uint8_t test_peer_ip[NET_IP_LEN] = {192, 168, 163, 1};
+static uint8_t test_peer_mac[NET_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+/**
+ * @brief 测试时钟，代替系统时钟，tcp的定时器和arp的老化都按它走
+ * 
+ */
+int clock_gettime(clockid_t clk, struct timespec *ts)
+{
+    ts->tv_sec = test_now_ms / 1000;
+    ts->tv_nsec = (test_now_ms % 1000) * 1000000;
+    return 0;
+}
+
+time_t time(time_t *t)
+{
+    time_t now = test_now_ms / 1000;
+    if(t) *t = now;
+    return now;
+}
+
+/**
+ * @brief 计算tcp校验和，伪首部中的源、目的地址由调用者给出
+ * 
+ */
+static uint16_t test_checksum(const uint8_t *seg, size_t len, const uint8_t *src_ip, const uint8_t *dst_ip)
+{
+    static uint8_t tmp[sizeof(tcp_peso_hdr_t) + UINT16_MAX];
+    tcp_peso_hdr_t *peso = (tcp_peso_hdr_t *)tmp;
+    memcpy(peso->src_ip, src_ip, NET_IP_LEN);
+    memcpy(peso->dst_ip, dst_ip, NET_IP_LEN);
+    peso->placeholder = 0;
+    peso->protocol = NET_PROTOCOL_TCP;
+    peso->total_len16 = swap16(len);
+    memcpy(tmp + sizeof(tcp_peso_hdr_t), seg, len);
+    return checksum16((uint16_t *)tmp, sizeof(tcp_peso_hdr_t) + len);
+}
+
+/**
+ * @brief 以对端的身份回复一个ARP响应
+ * 
+ */
+static void test_peer_arp_reply()
+{
+    buf_t *buf = &rxbuf;
+    buf_init(buf, sizeof(arp_pkt_t));
+    arp_pkt_t *arp = (arp_pkt_t *)buf->data;
+    memset(arp, 0, sizeof(arp_pkt_t));
+    arp->hw_type16 = swap16(ARP_HW_ETHER);
+    arp->pro_type16 = swap16(NET_PROTOCOL_IP);
+    arp->hw_len = NET_MAC_LEN;
+    arp->pro_len = NET_IP_LEN;
+    arp->opcode16 = swap16(ARP_REPLY);
+    memcpy(arp->sender_ip, test_peer_ip, NET_IP_LEN);
+    memcpy(arp->sender_mac, test_peer_mac, NET_MAC_LEN);
+    memcpy(arp->target_ip, net_if_ip, NET_IP_LEN);
+    memcpy(arp->target_mac, net_if_mac, NET_MAC_LEN);
+    arp_in(buf, test_peer_mac);
+}
+
+/**
+ * @brief 初始化协议栈，并让它学到对端的mac地址，之后发出的报文段不用等ARP
+ * 
+ */
+void test_setup()
+{
+    driver_open();
+    ethernet_init();
+    arp_init();
+    ip_init();
+    icmp_init();
+    tcp_init();
+
+    test_peer_arp_reply();
+    ethernet_poll();
+    buf_t frame;
+    while(test_driver_take(&frame));
+}
+
+/**
+ * @brief 时钟前进ms毫秒，然后运行一次以太网轮询，其中包括tcp的定时处理，定时器发出的报文段随即交给驱动
+ * 
+ */
+void test_advance(uint64_t ms)
+{
+    test_now_ms += ms;
+    ethernet_poll();
+}
+
+/**
+ * @brief 取出协议栈到目前为止发出的所有tcp报文段，校验和不对时测试失败。
+ *        发给对端的ARP请求在这里回复
+ * 
+ * @param segs 存放解析出的报文段
+ * @param max 最多取出的个数，多出的丢弃
+ * @return int 取出的个数
+ */
+int test_take(test_seg_t *segs, int max)
+{
+    static buf_t frame;
+    int n = 0;
+    ethernet_poll();
+    while(test_driver_take(&frame)) {
+        ether_hdr_t *eth = (ether_hdr_t *)frame.data;
+        if(eth->protocol16 == swap16(NET_PROTOCOL_ARP)) {
+            // 测试时钟会让arp表项老化，对端要回复刷新和重新解析的ARP请求
+            arp_pkt_t *arp = (arp_pkt_t *)(frame.data + sizeof(ether_hdr_t));
+            if(arp->opcode16 == swap16(ARP_REQUEST) && memcmp(arp->target_ip, test_peer_ip, NET_IP_LEN) == 0)
+                test_peer_arp_reply();
+            continue;
+        }
+        if(eth->protocol16 != swap16(NET_PROTOCOL_IP)) continue;
+        ip_hdr_t *ip = (ip_hdr_t *)(frame.data + sizeof(ether_hdr_t));
+        if(ip->protocol != NET_PROTOCOL_TCP) continue;
+        size_t ip_hdr_len = ip->hdr_len * 4;
+        size_t tcp_len = swap16(ip->total_len16) - ip_hdr_len;
+        uint8_t *raw = (uint8_t *)ip + ip_hdr_len;
+        tcp_hdr_t *tcp = (tcp_hdr_t *)raw;
+        TEST_CHECK(test_checksum(raw, tcp_len, ip->src_ip, ip->dst_ip) == 0);
+        if(n == max) continue;
+
+        test_seg_t *seg = &segs[n++];
+        size_t tcp_hdr_len = tcp->data_offset * 4;
+        seg->sport = swap16(tcp->src_port16);
+        seg->dport = swap16(tcp->dst_port16);
+        seg->seq = swap32(tcp->seq_number32);
+        seg->ack = swap32(tcp->ack_number32);
+        seg->flags = tcp->flags;
+        seg->win = swap16(tcp->window_size16);
+        seg->opt_len = tcp_hdr_len - sizeof(tcp_hdr_t);
+        memcpy(seg->opt, raw + sizeof(tcp_hdr_t), seg->opt_len);
+        seg->len = tcp_len - tcp_hdr_len;
+        TEST_CHECK(seg->len <= TEST_MAX_DATA);
+        memcpy(seg->data, raw + tcp_hdr_len, seg->len);
+    }
+    return n;
+}
+
+/**
+ * @brief 以对端的身份向协议栈发送一个报文段
+ * 
+ */
+void test_peer_send(uint16_t sport, uint16_t dport, tcp_flags_t flags, uint32_t seq, uint32_t ack,
+    uint16_t win, const uint8_t *data, int len, const uint8_t *opt, int opt_len)
+{
+    buf_t *buf = &rxbuf;
+    buf_init(buf, sizeof(tcp_hdr_t) + opt_len + len);
+    tcp_hdr_t *tcp = (tcp_hdr_t *)buf->data;
+    memset(tcp, 0, sizeof(tcp_hdr_t));
+    tcp->src_port16 = swap16(sport);
+    tcp->dst_port16 = swap16(dport);
+    tcp->seq_number32 = swap32(seq);
+    tcp->ack_number32 = swap32(ack);
+    tcp->data_offset = (sizeof(tcp_hdr_t) + opt_len) / 4;
+    tcp->flags = flags;
+    tcp->window_size16 = swap16(win);
+    if(opt_len) memcpy(buf->data + sizeof(tcp_hdr_t), opt, opt_len);
+    if(len) memcpy(buf->data + sizeof(tcp_hdr_t) + opt_len, data, len);
+    tcp->chunksum16 = test_checksum(buf->data, buf->len, test_peer_ip, net_if_ip);
+    tcp_in(buf, test_peer_ip);
+}
+
+/**
+ * @brief 取出报文段中的SACK块
+ * 
+ * @param seg 报文段
+ * @param blocks 存放SACK块的左右边界，至少4个
+ * @return int SACK块个数，没有SACK选项时为0
+ */
+int test_sack_blocks(const test_seg_t *seg, uint32_t blocks[][2])
+{
+    int n = 0;
+    for(int i = 0; i < seg->opt_len;) {
+        uint8_t kind = seg->opt[i];
+        if(kind == 0) break;
+        if(kind == 1) {
+            i++;
+            continue;
+        }
+        uint8_t len = seg->opt[i + 1];
+        TEST_CHECK(len >= 2 && i + len <= seg->opt_len);
+        if(kind == 5) {
+            for(int j = 2; j + 8 <= len && n < 4; j += 8, n++) {
+                uint32_t edge[2];
+                memcpy(edge, seg->opt + i + j, sizeof(edge));
+                blocks[n][0] = swap32(edge[0]);
+                blocks[n][1] = swap32(edge[1]);
+            }
+        }
+        i += len;
+    }
+    return n;
+}
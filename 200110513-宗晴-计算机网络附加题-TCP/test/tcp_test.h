@@ -0,0 +1,59 @@
+#ifndef TCP_TEST_H
+#define TCP_TEST_H
+
+#include "net.h"
+#include "tcp.h"
+#include "tcp_poll.h"
+
+// TCP测试的公共部分。每个*_test.c是一个独立的测试程序，编译时和实验框架src目录下
+// 除driver.c、main.c之外的源文件，lab2、lab4中的协议实现，上一级目录的tcp.c、pool.c、tcp_cc.c，
+// 以及本目录的tcp_test.c、test_driver.c链接在一起。对端由测试程序模拟：
+// 它构造的报文段直接交给tcp_in()，协议栈发出的报文段经test_driver_take()取回
+//
+// 时钟也由测试控制：tcp_test.c中的clock_gettime()和time()返回test_now_ms
+
+#define TEST_MAX_DATA 1500
+#define TEST_MAX_OPT 40
+
+/**
+ * @brief 从协议栈发出的帧中解析出的报文段，数据和选项都拷贝出来
+ * 
+ */
+typedef struct test_seg {
+    uint16_t sport, dport;
+    uint32_t seq, ack;
+    tcp_flags_t flags;
+    uint16_t win;
+    int len;
+    uint8_t data[TEST_MAX_DATA];
+    int opt_len;
+    uint8_t opt[TEST_MAX_OPT];
+} test_seg_t;
+
+extern uint64_t test_now_ms;
+extern uint8_t test_peer_ip[NET_IP_LEN];
+
+// tcp.c中实验框架的tcp.h没有声明的接口
+int tcp_connect(uint8_t *ip, uint16_t port, tcp_handler_t handler);
+int tcp_open_cc(uint16_t port, tcp_handler_t handler, const char *cc);
+size_t tcp_connect_read(tcp_connect_t *connect, uint8_t *data, size_t len);
+size_t tcp_connect_write(tcp_connect_t *connect, const uint8_t *data, size_t len);
+void tcp_connect_close(tcp_connect_t *connect);
+void tcp_close(uint16_t port);
+
+void test_setup();
+void test_advance(uint64_t ms);
+int test_take(test_seg_t *segs, int max);
+void test_peer_send(uint16_t sport, uint16_t dport, tcp_flags_t flags, uint32_t seq, uint32_t ack,
+    uint16_t win, const uint8_t *data, int len, const uint8_t *opt, int opt_len);
+int test_sack_blocks(const test_seg_t *seg, uint32_t blocks[][2]);
+
+#define TEST_CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while(0)
+
+#endif
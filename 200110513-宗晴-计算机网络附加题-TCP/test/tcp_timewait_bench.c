@@ -0,0 +1,163 @@
+#include <time.h>
+#include "tcp_test.h"
+
+// TIME_WAIT的连接周转测试：对端不断地连接、协议栈在连接建立时主动关闭，
+// 对端回复FIN后连接进入TIME_WAIT。之后对端重传一次FIN，回复ACK说明TIME_WAIT表中保留着这个连接，
+// 回复RST说明表满了、连接直接关闭了。测试时钟按给定的连接速率前进，由时间轮回收到期的连接。
+//
+// 每轮默认周转100万个连接：
+//   （1）每秒50个连接、60000个端口：TIME_WAIT中最多约3000个连接，放得下，端口重用前早已到期
+//   （2）每秒1000个连接、60000个端口：TIME_WAIT中应有约60000个连接，超过TIME_WAIT表的容量
+//   （3）每秒1000个连接、1000个端口、带时间戳：端口1秒后就重用，新SYN的时间戳更新，提前结束TIME_WAIT
+//   （4）同（3）但不带时间戳：新SYN不能结束TIME_WAIT，只收到ACK，连接失败
+// 统计建立的连接、失败的连接、留在TIME_WAIT中的比例、被新SYN提前结束的TIME_WAIT数，以及实际时间中每秒周转的连接数
+// （包含测试程序构造和解析报文段的开销）。
+//
+// 用法：tcp_timewait_bench [每轮的连接数，默认1000000]
+// 协议栈的调试信息打印在stdout，结果打印在stderr，可以用 tcp_timewait_bench > /dev/null 只看结果
+
+#define PORT 80
+#define FIRST_PORT 1024
+#define PEER_ISN 1000
+#define TIME_WAIT_MS 60000      // tcp.c中TCP_TIME_WAIT_MS的默认值
+
+static const tcp_flags_t flags_syn = {.syn = 1};
+static const tcp_flags_t flags_ack = {.ack = 1};
+static const tcp_flags_t flags_fin_ack = {.fin = 1, .ack = 1};
+
+static void handler(tcp_connect_t *connect, connect_state_t state)
+{
+    if(state == TCP_CONN_CONNECTED)
+        tcp_connect_close(connect);
+}
+
+/**
+ * @brief 对端的选项：SYN带MSS和时间戳，其他报文段只带时间戳，时间戳是测试时钟的毫秒数
+ *
+ * @param opt 至少16字节
+ * @param syn
+ * @param ts 为0时不带时间戳
+ * @return int 选项长度
+ */
+static int peer_options(uint8_t *opt, int syn, int ts)
+{
+    int len = 0;
+    if(syn) {
+        static const uint8_t mss[] = {2, 4, 1460 >> 8, 1460 & 0xFF};
+        memcpy(opt, mss, sizeof(mss));
+        len += sizeof(mss);
+    }
+    if(ts) {
+        uint32_t val = swap32((uint32_t)test_now_ms), ecr = 0;
+        static const uint8_t head[] = {1, 1, 8, 10};
+        memcpy(opt + len, head, sizeof(head));
+        memcpy(opt + len + 4, &val, 4);
+        memcpy(opt + len + 8, &ecr, 4);
+        len += 12;
+    }
+    return len;
+}
+
+/**
+ * @brief 取走协议栈发出的报文段，返回发往sport的最后一个
+ *
+ * @return test_seg_t* 没有时为NULL
+ */
+static test_seg_t *reply(uint16_t sport)
+{
+    static test_seg_t segs[16];
+    test_seg_t *found = NULL;
+    int n = test_take(segs, 16);
+    for(int i = 0; i < n; i++)
+        if(segs[i].dport == sport) found = &segs[i];
+    return found;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    // tcp_test.c把clock_gettime换成了测试时钟，这里要真实时间
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 一轮测试
+ *
+ * @param port 监听的端口，每轮一个
+ * @param total 连接数
+ * @param rate 每秒（测试时钟）的连接数
+ * @param ports 对端轮流使用的端口数
+ * @param ts 对端是否使用时间戳
+ */
+static void run(uint16_t port, size_t total, unsigned rate, unsigned ports, int ts)
+{
+    static uint64_t closed_at[65536];
+    static uint8_t kept[65536];
+    size_t established = 0, refused = 0, in_tw = 0, reused = 0;
+    uint8_t opt[16];
+    uint64_t start_ms = test_now_ms;
+    memset(kept, 0, sizeof(kept));
+    tcp_open(port, handler);
+
+    double start = now_sec();
+    for(size_t i = 0; i < total; i++) {
+        uint16_t sport = FIRST_PORT + i % ports;
+        uint64_t at = start_ms + i * 1000 / rate;
+        if(at > test_now_ms) test_advance(at - test_now_ms);
+
+        test_peer_send(sport, port, flags_syn, PEER_ISN, 0, 65535, NULL, 0, opt, peer_options(opt, 1, ts));
+        test_seg_t *seg = reply(sport);
+        TEST_CHECK(seg != NULL);
+        if(!seg->flags.syn) {
+            // 端口还在TIME_WAIT中，协议栈只回复ACK
+            TEST_CHECK(seg->flags.ack && !seg->flags.rst && kept[sport]);
+            refused++;
+            continue;
+        }
+        if(kept[sport] && test_now_ms - closed_at[sport] < TIME_WAIT_MS) reused++;
+        uint32_t iss = seg->seq;
+
+        // 握手完成后协议栈立即关闭，发出FIN
+        test_peer_send(sport, port, flags_ack, PEER_ISN + 1, iss + 1, 65535, NULL, 0, opt, peer_options(opt, 0, ts));
+        seg = reply(sport);
+        TEST_CHECK(seg != NULL && seg->flags.fin && seg->seq == iss + 1);
+        established++;
+
+        test_peer_send(sport, port, flags_fin_ack, PEER_ISN + 1, iss + 2, 65535, NULL, 0, opt, peer_options(opt, 0, ts));
+        seg = reply(sport);
+        TEST_CHECK(seg != NULL && seg->flags.ack && !seg->flags.rst && seg->ack == PEER_ISN + 2);
+
+        // 重传FIN，TIME_WAIT中的连接回复ACK，已经关闭的连接回复RST
+        test_peer_send(sport, port, flags_fin_ack, PEER_ISN + 1, iss + 2, 65535, NULL, 0, opt, peer_options(opt, 0, ts));
+        seg = reply(sport);
+        TEST_CHECK(seg != NULL);
+        kept[sport] = !seg->flags.rst;
+        in_tw += kept[sport];
+        closed_at[sport] = test_now_ms;
+    }
+    double elapsed = now_sec() - start;
+    tcp_close(port);
+    fprintf(stderr, "%6u %6u %3s %10zu %10zu %8.1f%% %10zu %10.0f\n", rate, ports, ts ? "on" : "off",
+        established, refused, established ? in_tw * 100.0 / established : 0, reused, total / elapsed);
+
+    // 等这一轮的TIME_WAIT全部到期，不占下一轮的表项
+    test_advance(2 * TIME_WAIT_MS);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        unsigned rate, ports;
+        int ts;
+    } rounds[] = {{50, 60000, 1}, {1000, 60000, 1}, {1000, 1000, 1}, {1000, 1000, 0}};
+    size_t total = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    if(total == 0) total = 1;
+    test_setup();
+    fprintf(stderr, "%6s %6s %3s %10s %10s %9s %10s %10s\n", "conn/s", "ports", "ts", "connected", "refused",
+        "in TW", "reused", "real/s");
+    for(size_t i = 0; i < sizeof(rounds) / sizeof(rounds[0]); i++)
+        run(PORT + i, total, rounds[i].rate, rounds[i].ports, rounds[i].ts);
+    fprintf(stderr, "ok\n");
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "driver.h"
+#include "ethernet.h"
+#include "test_driver.h"
+
+/**
+ * @brief 已发出、还没有被测试程序取走的帧
+ * 
+ */
+static struct {
+    uint16_t len;
+    uint8_t data[ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t)];
+} frames[TEST_DRIVER_MAX_FRAMES];
+static size_t frames_head, frames_tail;
+
+/**
+ * @brief 丢包率（百分比）和丢包用的随机数状态
+ * 
+ */
+static int loss_percent;
+static unsigned loss_state;
+static size_t dropped;
+
+/**
+ * @brief 设置丢包率
+ * 
+ * @param percent 每个发出的帧被丢弃的概率（百分比），0为不丢包
+ * @param seed 随机数种子，相同的种子丢弃相同的帧，便于复现
+ */
+void test_driver_set_loss(int percent, unsigned seed)
+{
+    loss_percent = percent;
+    loss_state = seed ? seed : 1;
+}
+
+/**
+ * @brief 被丢弃的帧数
+ * 
+ */
+size_t test_driver_dropped()
+{
+    return dropped;
+}
+
+/**
+ * @brief 取走最早发出的一帧
+ * 
+ * @param buf 存放取出的帧
+ * @return int 取到为1，没有了为0
+ */
+int test_driver_take(buf_t *buf)
+{
+    if(frames_head == frames_tail) return 0;
+    size_t i = frames_head++ % TEST_DRIVER_MAX_FRAMES;
+    buf_init(buf, frames[i].len);
+    memcpy(buf->data, frames[i].data, frames[i].len);
+    return 1;
+}
+
+int driver_open()
+{
+    frames_head = frames_tail = 0;
+    return 0;
+}
+
+/**
+ * @brief 测试中的对端直接调用协议栈的输入函数，驱动没有要接收的帧
+ * 
+ */
+int driver_recv(buf_t *buf)
+{
+    return 0;
+}
+
+int driver_send(buf_t *buf)
+{
+    if(loss_percent) {
+        loss_state = loss_state * 1103515245 + 12345;
+        if((loss_state >> 16) % 100 < (unsigned)loss_percent) {
+            dropped++;
+            return 0;
+        }
+    }
+    if(frames_tail - frames_head == TEST_DRIVER_MAX_FRAMES || buf->len > sizeof(frames[0].data)) {
+        dropped++;
+        return 0;
+    }
+    size_t i = frames_tail++ % TEST_DRIVER_MAX_FRAMES;
+    frames[i].len = buf->len;
+    memcpy(frames[i].data, buf->data, buf->len);
+    return 0;
+}
+
+void driver_close()
+{
+}
@@ -0,0 +1,17 @@
+#ifndef TEST_DRIVER_H
+#define TEST_DRIVER_H
+
+#include "net.h"
+
+// 测试用驱动，代替实验框架中基于pcap的driver.c：
+// 协议栈发出的帧按顺序存起来，由测试程序用test_driver_take()取走检查，
+// 可以按给定的概率丢弃发出的帧，模拟有丢包的链路
+#ifndef TEST_DRIVER_MAX_FRAMES
+#define TEST_DRIVER_MAX_FRAMES 1024
+#endif
+
+void test_driver_set_loss(int percent, unsigned seed);
+size_t test_driver_dropped();
+int test_driver_take(buf_t *buf);
+
+#endif
@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include "test_link.h"
+
+#define LINK_MAX_PKTS 4096
+#define LINK_MAX_RANGES 64
+#define LINK_SACK_BLOCKS 3
+#define LINK_WIRE_OVERHEAD 54   // 以太网、ip、tcp首部
+#define LINK_MAX_MS 600000
+#define LINK_PEER_ISN 1000
+#define LINK_PEER_WIN 65535
+#define LINK_PEER_MSS 1460
+
+/**
+ * @brief 链路上的报文段，数据方向和ACK方向都用它
+ * 
+ */
+typedef struct link_pkt {
+    double arrival;         // 到达对端（或协议栈）的时刻
+    uint32_t seq, len;      // 数据方向：相对于起始序号的偏移和长度
+    uint32_t ack;           // ACK方向：累计确认到的偏移
+    int blocks;
+    uint32_t sack[LINK_SACK_BLOCKS][2];
+} link_pkt_t;
+
+typedef struct link_fifo {
+    link_pkt_t pkts[LINK_MAX_PKTS];
+    size_t head, tail;
+} link_fifo_t;
+
+static link_fifo_t data_fifo, ack_fifo;
+
+/**
+ * @brief 对端收到的、还没有按序交付的数据区间，按起点排序，互不相邻
+ * 
+ */
+static uint32_t ranges[LINK_MAX_RANGES][2];
+static int range_count;
+static uint32_t rcv_nxt;
+
+static tcp_connect_t *link_conn;
+static uint8_t *link_src;
+
+static void link_handler(tcp_connect_t *connect, connect_state_t state)
+{
+    link_conn = state == TCP_CONN_CLOSED ? NULL : connect;
+}
+
+static void fifo_push(link_fifo_t *fifo, const link_pkt_t *pkt)
+{
+    TEST_CHECK(fifo->tail - fifo->head < LINK_MAX_PKTS);
+    fifo->pkts[fifo->tail++ % LINK_MAX_PKTS] = *pkt;
+}
+
+static link_pkt_t *fifo_due(link_fifo_t *fifo, double now)
+{
+    if(fifo->head == fifo->tail) return NULL;
+    link_pkt_t *pkt = &fifo->pkts[fifo->head % LINK_MAX_PKTS];
+    if(pkt->arrival > now) return NULL;
+    fifo->head++;
+    return pkt;
+}
+
+/**
+ * @brief 对端收到[seq, seq + len)，合并进乱序区间，能按序交付时推进rcv_nxt。
+ *        回复的ACK中第一个SACK块包含刚收到的数据（RFC 2018）
+ * 
+ */
+static void peer_receive(uint32_t seq, uint32_t len, link_pkt_t *ack)
+{
+    uint32_t start = seq, end = seq + len;
+    if(end > rcv_nxt) {
+        if(start < rcv_nxt) start = rcv_nxt;
+        int i = 0;
+        while(i < range_count && ranges[i][1] < start) i++;
+        int j = i;
+        while(j < range_count && ranges[j][0] <= end) {
+            if(ranges[j][0] < start) start = ranges[j][0];
+            if(ranges[j][1] > end) end = ranges[j][1];
+            j++;
+        }
+        TEST_CHECK(range_count - (j - i) + 1 <= LINK_MAX_RANGES);
+        memmove(ranges[i + 1], ranges[j], (range_count - j) * sizeof(ranges[0]));
+        range_count -= j - i - 1;
+        ranges[i][0] = start;
+        ranges[i][1] = end;
+        if(ranges[0][0] == rcv_nxt) {
+            rcv_nxt = ranges[0][1];
+            memmove(ranges[0], ranges[1], (range_count - 1) * sizeof(ranges[0]));
+            range_count--;
+        }
+    }
+    ack->ack = rcv_nxt;
+    ack->blocks = 0;
+    int latest = -1;
+    for(int i = 0; i < range_count; i++) {
+        if(ranges[i][0] <= seq && seq < ranges[i][1]) {
+            latest = i;
+            ack->sack[ack->blocks][0] = ranges[i][0];
+            ack->sack[ack->blocks][1] = ranges[i][1];
+            ack->blocks++;
+        }
+    }
+    for(int i = range_count - 1; i >= 0 && ack->blocks < LINK_SACK_BLOCKS; i--) {
+        if(i == latest) continue;
+        ack->sack[ack->blocks][0] = ranges[i][0];
+        ack->sack[ack->blocks][1] = ranges[i][1];
+        ack->blocks++;
+    }
+}
+
+/**
+ * @brief 以对端的身份把ACK交给协议栈，序号从偏移换算成绝对序号
+ * 
+ */
+static void peer_send_ack(uint16_t port, uint16_t peer_port, uint32_t iss, const link_pkt_t *ack, int sack)
+{
+    static const tcp_flags_t flags_ack = {.ack = 1};
+    uint8_t opt[2 + 2 + 8 * LINK_SACK_BLOCKS];
+    int opt_len = 0;
+    if(sack && ack->blocks) {
+        opt[0] = opt[1] = 1;
+        opt[2] = 5;
+        opt[3] = 2 + 8 * ack->blocks;
+        for(int i = 0; i < ack->blocks; i++) {
+            uint32_t edge[2] = {swap32(iss + 1 + ack->sack[i][0]), swap32(iss + 1 + ack->sack[i][1])};
+            memcpy(opt + 4 + 8 * i, edge, sizeof(edge));
+        }
+        opt_len = 4 + 8 * ack->blocks;
+    }
+    test_peer_send(peer_port, port, flags_ack, LINK_PEER_ISN + 1, iss + 1 + ack->ack, LINK_PEER_WIN,
+        NULL, 0, opt, opt_len);
+}
+
+/**
+ * @brief 在port上监听，对端连接后经模拟链路传输config->total字节，检查数据完整后用RST结束连接
+ * 
+ * @param port 协议栈一侧的端口
+ * @param config 链路和对端参数
+ * @param result 结果
+ */
+void test_link_run(uint16_t port, const test_link_config_t *config, test_link_result_t *result)
+{
+    static uint16_t peer_port = 20000;
+    static const tcp_flags_t flags_syn = {.syn = 1};
+    static const tcp_flags_t flags_ack = {.ack = 1};
+    static const tcp_flags_t flags_rst = {.rst = 1};
+    static test_seg_t segs[256];
+    peer_port++;
+    memset(result, 0, sizeof(*result));
+    data_fifo.head = data_fifo.tail = 0;
+    ack_fifo.head = ack_fifo.tail = 0;
+    range_count = 0;
+    rcv_nxt = 0;
+    link_src = realloc(link_src, config->total);
+    for(size_t i = 0; i < config->total; i++)
+        link_src[i] = i * 131 + (i >> 8) + peer_port;
+    if(config->cc) TEST_CHECK(tcp_open_cc(port, link_handler, config->cc) == 0);
+    else tcp_open(port, link_handler);
+
+    // 三次握手不经过模拟链路，只让时钟走过一个往返，使第一个RTT样本正确
+    uint8_t syn_opt[8] = {2, 4, LINK_PEER_MSS >> 8, LINK_PEER_MSS & 0xFF, 1, 1, 4, 2};
+    test_peer_send(peer_port, port, flags_syn, LINK_PEER_ISN, 0, LINK_PEER_WIN, NULL, 0, syn_opt,
+        config->sack ? 8 : 4);
+    int n = test_take(segs, 256);
+    TEST_CHECK(n == 1 && segs[0].flags.syn && segs[0].flags.ack);
+    uint32_t iss = segs[0].seq;
+    test_now_ms += 2 * config->delay;
+    test_peer_send(peer_port, port, flags_ack, LINK_PEER_ISN + 1, iss + 1, LINK_PEER_WIN, NULL, 0, NULL, 0);
+    TEST_CHECK(link_conn != NULL);
+
+    unsigned rand_state = config->seed ? config->seed : 1;
+    double last_depart = 0, queue_total = 0;
+    size_t queued = 0, written = 0;
+    uint32_t acked = 0;
+    uint64_t start = test_now_ms;
+    while(acked < config->total) {
+        TEST_CHECK(test_now_ms - start < LINK_MAX_MS && link_conn != NULL);
+        double now = test_now_ms;
+        link_pkt_t *pkt;
+        while((pkt = fifo_due(&ack_fifo, now)) != NULL) {
+            if(pkt->ack > acked) acked = pkt->ack;
+            peer_send_ack(port, peer_port, iss, pkt, config->sack);
+        }
+        if(link_conn && written < config->total)
+            written += tcp_connect_write(link_conn, link_src + written, config->total - written);
+
+        n = test_take(segs, 256);
+        for(int i = 0; i < n; i++) {
+            test_seg_t *seg = &segs[i];
+            if(seg->len == 0) continue;
+            uint32_t seq = seg->seq - iss - 1;
+            TEST_CHECK(seq + seg->len <= config->total);
+            TEST_CHECK(memcmp(seg->data, link_src + seq, seg->len) == 0);
+            result->sent += seg->len;
+            rand_state = rand_state * 1103515245 + 12345;
+            if((rand_state >> 8) % 1000000 < config->loss * 1000000) {
+                result->random_drops++;
+                continue;
+            }
+            double wire = seg->len + LINK_WIRE_OVERHEAD;
+            double begin = last_depart > now ? last_depart : now;
+            if((begin - now) * config->rate + wire > config->queue) {
+                result->queue_drops++;
+                continue;
+            }
+            last_depart = begin + wire / config->rate;
+            queue_total += begin - now;
+            queued++;
+            link_pkt_t data = {.arrival = last_depart + config->delay, .seq = seq, .len = seg->len};
+            fifo_push(&data_fifo, &data);
+        }
+
+        while((pkt = fifo_due(&data_fifo, now)) != NULL) {
+            link_pkt_t ack = {.arrival = now + config->delay};
+            peer_receive(pkt->seq, pkt->len, &ack);
+            fifo_push(&ack_fifo, &ack);
+        }
+        test_advance(1);
+    }
+    result->ms = test_now_ms - start;
+    result->queue_ms = queued ? queue_total / queued : 0;
+    TEST_CHECK(rcv_nxt == config->total);
+
+    // 收到RST时连接直接释放，不会再回调handler
+    test_peer_send(peer_port, port, flags_rst, LINK_PEER_ISN + 1, 0, 0, NULL, 0, NULL, 0);
+    link_conn = NULL;
+    test_take(segs, 256);
+}
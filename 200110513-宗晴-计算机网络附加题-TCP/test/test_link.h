@@ -0,0 +1,41 @@
+#ifndef TEST_LINK_H
+#define TEST_LINK_H
+
+#include "tcp_test.h"
+
+// 模拟一条有瓶颈的链路，协议栈作为发送方经它向对端传输数据：
+// 数据方向先按给定概率随机丢包，再进入有限长的瓶颈队列，按瓶颈带宽发出，经过单向时延到达对端；
+// 对端按序接收并缓存乱序数据，每收到一个报文段回复一个累计确认（允许时带SACK块），
+// ACK经过同样的单向时延、不经过瓶颈回到协议栈。时钟每次前进1毫秒。
+// 用到它的*_bench.c在tcp_test.h所说的源文件之外再链接test_link.c
+
+/**
+ * @brief 一次传输的链路和对端参数
+ * 
+ */
+typedef struct test_link_config {
+    double rate;            // 瓶颈带宽（字节/毫秒）
+    uint32_t delay;         // 单向传播时延（毫秒）
+    size_t queue;           // 瓶颈队列长度（字节）
+    double loss;            // 数据方向的随机丢包率
+    int sack;               // 对端是否在SYN中允许SACK
+    const char *cc;         // 拥塞控制算法，NULL为默认算法
+    size_t total;           // 传输的字节数
+    unsigned seed;          // 随机丢包的种子
+} test_link_config_t;
+
+/**
+ * @brief 一次传输的结果
+ * 
+ */
+typedef struct test_link_result {
+    uint64_t ms;            // 从连接建立到全部数据被确认的时间
+    size_t sent;            // 协议栈发出的数据字节数，包括重传
+    size_t random_drops;    // 随机丢弃的报文段数
+    size_t queue_drops;     // 瓶颈队列满而丢弃的报文段数
+    double queue_ms;        // 报文段在瓶颈队列中的平均等待时间
+} test_link_result_t;
+
+void test_link_run(uint16_t port, const test_link_config_t *config, test_link_result_t *result);
+
+#endif
@@ -3,6 +3,9 @@
 #include "net.h"
 #include "arp.h"
 #include "ethernet.h"
+#include "arp_buf.h"
+#include "ethernet_queue.h"
+#include "pool.h"
 /**
  * @brief 初始的arp包
  * 
@@ -17,16 +20,557 @@ static const arp_pkt_t arp_init_pkt = {
     .target_mac = {0}};
 
 /**
- * @brief arp地址转换表，<ip,mac>的容器
+ * @brief arp缓存的表项数，必须是2的幂
  * 
  */
-map_t arp_table;
+#ifndef ARP_CACHE_SIZE
+#define ARP_CACHE_SIZE 1024
+#endif
 
 /**
- * @brief arp buffer，<ip,buf_t>的容器
+ * @brief 时间轮的槽数，必须是2的幂，每个槽对应1秒
  * 
  */
-map_t arp_buf;
+#ifndef ARP_WHEEL_SLOTS
+#define ARP_WHEEL_SLOTS 512
+#endif
+
+/**
+ * @brief 表项过期前这么多秒内被使用时，用单播ARP请求提前刷新
+ * 
+ */
+#ifndef ARP_REFRESH_SEC
+#define ARP_REFRESH_SEC 30
+#endif
+
+/**
+ * @brief 表项过期后继续使用原来的mac（stale）的时间，期间用单播ARP请求重新确认
+ * 
+ */
+#ifndef ARP_STALE_SEC
+#define ARP_STALE_SEC 60
+#endif
+
+#define ARP_BUCKET_ENTRIES 4
+#define ARP_BUCKETS (ARP_CACHE_SIZE / ARP_BUCKET_ENTRIES)
+
+/**
+ * @brief arp缓存表项的状态
+ * 
+ */
+typedef enum arp_entry_state {
+    ARP_ENTRY_EMPTY,    // 从未使用，探测到这里即可停止
+    ARP_ENTRY_VALID,
+    ARP_ENTRY_STALE,    // 已过期但仍可使用，等待重新确认
+    ARP_ENTRY_DELETED,  // 已老化删除，探测时需要跳过
+} arp_entry_state_t;
+
+#define ARP_FLAG_LINKED 0x1     // 挂在时间轮上
+#define ARP_FLAG_PROBING 0x2    // 已经发出单播ARP请求，等待响应
+#define ARP_FLAG_PROBE_DUE 0x4  // 查找时发现需要刷新，单播ARP请求还没有发出
+
+/**
+ * @brief arp缓存表项，16字节，4个表项正好组成一个64字节的桶
+ * 
+ */
+typedef struct arp_entry {
+    uint32_t ip;                // ip地址，按内存中的字节序直接作为key
+    uint8_t mac[NET_MAC_LEN];
+    uint8_t state;
+    uint8_t flags;
+    uint32_t expire;            // 过期时刻（秒），stale状态下为删除时刻
+} arp_entry_t;
+
+/**
+ * @brief 桶，大小和对齐都是一个cache line，一次探测只访问一个cache line
+ * 
+ */
+typedef struct arp_bucket {
+    arp_entry_t entries[ARP_BUCKET_ENTRIES];
+} __attribute__((aligned(64))) arp_bucket_t;
+
+/**
+ * @brief arp地址转换表，以ip为key的开放定址哈希表，按桶线性探测
+ * 
+ */
+static arp_bucket_t arp_table[ARP_BUCKETS];
+
+/**
+ * @brief 时间轮，每个槽是一条按表项下标链接的单链表，
+ *        链表指针单独存放，不占用桶里的空间
+ * 
+ */
+static int32_t arp_wheel[ARP_WHEEL_SLOTS];
+static int32_t arp_wheel_next[ARP_CACHE_SIZE];
+static time_t arp_wheel_now;
+
+/**
+ * @brief 上一次查找命中的表项，只有一个网关时几乎每次都命中
+ * 
+ */
+static arp_entry_t *arp_last_hit;
+
+/**
+ * @brief 已删除的表项数，太多时重建整个表
+ * 
+ */
+static size_t arp_deleted;
+
+/**
+ * @brief 同时等待ARP响应的目的ip个数上限
+ * 
+ */
+#ifndef ARP_PENDING_MAX_DESTS
+#define ARP_PENDING_MAX_DESTS 16
+#endif
+
+/**
+ * @brief 所有等待队列中缓存的数据包个数上限，至少能放下两个最大的IP数据报的全部分片
+ * 
+ */
+#ifndef ARP_PENDING_MAX_PKTS
+#define ARP_PENDING_MAX_PKTS 96
+#endif
+
+/**
+ * @brief 每个目的ip最多缓存的数据包个数
+ * 
+ */
+#ifndef ARP_PENDING_PER_DEST
+#define ARP_PENDING_PER_DEST 48
+#endif
+
+/**
+ * @brief 每个目的ip最多缓存的字节数。
+ *        最大的IP数据报（65535字节）按1500字节的MTU分片后是45个分片，共66415字节，要能整个放下
+ * 
+ */
+#ifndef ARP_PENDING_DEST_BYTES
+#define ARP_PENDING_DEST_BYTES (45 * ETHERNET_MAX_TRANSPORT_UNIT)
+#endif
+
+/**
+ * @brief 所有等待队列中缓存的字节数上限
+ * 
+ */
+#ifndef ARP_PENDING_MAX_BYTES
+#define ARP_PENDING_MAX_BYTES (2 * ARP_PENDING_DEST_BYTES)
+#endif
+
+/**
+ * @brief 第一次ARP请求之后最多重发的次数，重发间隔从ARP_MIN_INTERVAL开始每次加倍
+ * 
+ */
+#ifndef ARP_REQ_RETRIES
+#define ARP_REQ_RETRIES 3
+#endif
+
+/**
+ * @brief 缓存的数据包，数据放在缓冲池的buf_t中，收到响应后直接交给发送队列，不再拷贝。
+ *        按下标链接成队列，空闲的也链接成一个空闲链表
+ * 
+ */
+typedef struct arp_pending_pkt {
+    int32_t next;
+    buf_t *buf;
+} arp_pending_pkt_t;
+
+/**
+ * @brief 一个等待ARP响应的目的ip，以及发往它的数据包队列
+ * 
+ */
+typedef struct arp_pending {
+    int used;
+    uint8_t ip[NET_IP_LEN];
+    int32_t head;
+    int32_t tail;
+    size_t count;
+    size_t bytes;       // 队列中数据包的字节数
+    int retries;        // 已经重发ARP请求的次数
+    time_t interval;    // 当前的重发间隔
+    time_t next_req;    // 下次重发ARP请求的时刻
+} arp_pending_t;
+
+/**
+ * @brief arp buffer，等待ARP响应的目的ip和数据包队列
+ * 
+ */
+static arp_pending_t arp_buf[ARP_PENDING_MAX_DESTS];
+static arp_pending_pkt_t arp_buf_pkts[ARP_PENDING_MAX_PKTS];
+static int32_t arp_buf_free;
+static size_t arp_buf_bytes;
+
+/**
+ * @brief arp buffer统计
+ * 
+ */
+static struct {
+    size_t queued;      // 缓存过的数据包数
+    size_t flushed;     // 收到响应后发送出去的数据包数
+    size_t dropped;     // 因队列或内存上限、缓冲池用完丢弃的数据包数
+    size_t unresolved;  // 重发用完仍没有响应而丢弃的数据包数
+} arp_buf_stats;
+
+/**
+ * @brief 根据下标取arp缓存表项
+ * 
+ * @param index 表项下标
+ * @return arp_entry_t* 表项
+ */
+static inline arp_entry_t *arp_entry_at(int32_t index)
+{
+    return &arp_table[index / ARP_BUCKET_ENTRIES].entries[index % ARP_BUCKET_ENTRIES];
+}
+
+/**
+ * @brief 计算ip对应的起始桶
+ * 
+ * @param key ip地址
+ * @return size_t 桶下标
+ */
+static inline size_t arp_hash(uint32_t key)
+{
+    key ^= key >> 16;
+    key *= 0x7feb352d;
+    key ^= key >> 15;
+    key *= 0x846ca68b;
+    key ^= key >> 16;
+    return key & (ARP_BUCKETS - 1);
+}
+
+/**
+ * @brief 把表项挂到它过期时刻对应的时间轮槽上
+ * 
+ * @param index 表项下标
+ */
+static void arp_wheel_link(int32_t index)
+{
+    arp_entry_t *entry = arp_entry_at(index);
+    size_t slot = entry->expire & (ARP_WHEEL_SLOTS - 1);
+    arp_wheel_next[index] = arp_wheel[slot];
+    arp_wheel[slot] = index;
+    entry->flags |= ARP_FLAG_LINKED;
+}
+
+/**
+ * @brief 表项是否可以使用（有效或stale）
+ * 
+ * @param entry 表项
+ * @return int 可以使用为1
+ */
+static inline int arp_entry_usable(const arp_entry_t *entry)
+{
+    return entry->state == ARP_ENTRY_VALID || entry->state == ARP_ENTRY_STALE;
+}
+
+/**
+ * @brief 清空arp缓存和时间轮
+ * 
+ */
+static void arp_cache_clear()
+{
+    memset(arp_table, 0, sizeof(arp_table));
+    for(int i = 0; i < ARP_WHEEL_SLOTS; i++)
+        arp_wheel[i] = -1;
+    arp_last_hit = NULL;
+    arp_deleted = 0;
+}
+
+/**
+ * @brief 查找ip对应的表项
+ * 
+ * @param key ip地址
+ * @return arp_entry_t* 找不到返回NULL
+ */
+static arp_entry_t *arp_cache_find(uint32_t key)
+{
+    size_t b = arp_hash(key);
+    for(size_t probes = 0; probes < ARP_BUCKETS; probes++, b = (b + 1) & (ARP_BUCKETS - 1)) {
+        arp_entry_t *entries = arp_table[b].entries;
+        for(int i = 0; i < ARP_BUCKET_ENTRIES; i++) {
+            if(arp_entry_usable(&entries[i]) && entries[i].ip == key)
+                return &entries[i];
+            if(entries[i].state == ARP_ENTRY_EMPTY)
+                return NULL;
+        }
+    }
+    return NULL;
+}
+
+static void arp_req_to(uint8_t *target_ip, const uint8_t *target_mac);
+
+/**
+ * @brief 根据ip查找mac，先检查上一次命中的表项
+ *        查找时不检查时间戳，过期表项由时间轮统一处理。
+ *        表项快要过期或已经是stale状态时只做标记，单播ARP请求由arp_cache_probe()发出，
+ *        在收到响应之前继续使用原来的mac，数据包不会因此等待
+ * 
+ * @param ip ip地址
+ * @return uint8_t* mac地址，找不到返回NULL
+ */
+static uint8_t *arp_cache_get(uint8_t *ip)
+{
+    uint32_t key;
+    memcpy(&key, ip, NET_IP_LEN);
+    arp_entry_t *entry = arp_last_hit;
+    if(!(entry && arp_entry_usable(entry) && entry->ip == key)) {
+        entry = arp_cache_find(key);
+        if(entry == NULL) return NULL;
+        arp_last_hit = entry;
+    }
+    if(!(entry->flags & ARP_FLAG_PROBING) && (entry->state == ARP_ENTRY_STALE ||
+    (int32_t)(entry->expire - (uint32_t)arp_wheel_now) <= ARP_REFRESH_SEC)) {
+        entry->flags |= ARP_FLAG_PROBING | ARP_FLAG_PROBE_DUE;
+    }
+    return entry->mac;
+}
+
+/**
+ * @brief 如果上一次arp_cache_get()标记了需要刷新，向原来的mac发出单播ARP请求。
+ *        arp_req_to()会重新初始化txbuf，必须在数据包交给ethernet_out()之后调用
+ * 
+ * @param ip ip地址
+ */
+static void arp_cache_probe(uint8_t *ip)
+{
+    arp_entry_t *entry = arp_last_hit;
+    if(!(entry && (entry->flags & ARP_FLAG_PROBE_DUE))) return;
+    entry->flags &= ~ARP_FLAG_PROBE_DUE;
+    arp_req_to(ip, entry->mac);
+}
+
+/**
+ * @brief 找到ip对应的表项，没有则占用探测链上第一个空闲位置，
+ *        表满时替换起始桶中最早过期的表项
+ * 
+ * @param key ip地址
+ * @return arp_entry_t* 表项
+ */
+static arp_entry_t *arp_cache_slot(uint32_t key)
+{
+    arp_entry_t *entry = arp_cache_find(key);
+    if(entry) return entry;
+
+    size_t b = arp_hash(key);
+    for(size_t probes = 0; probes < ARP_BUCKETS && entry == NULL; probes++, b = (b + 1) & (ARP_BUCKETS - 1)) {
+        arp_entry_t *entries = arp_table[b].entries;
+        for(int i = 0; i < ARP_BUCKET_ENTRIES && entry == NULL; i++)
+            if(!arp_entry_usable(&entries[i])) entry = &entries[i];
+    }
+    if(entry == NULL) {
+        arp_entry_t *entries = arp_table[arp_hash(key)].entries;
+        entry = &entries[0];
+        for(int i = 1; i < ARP_BUCKET_ENTRIES; i++)
+            if((int32_t)(entries[i].expire - entry->expire) < 0) entry = &entries[i];
+    }
+    if(entry->state == ARP_ENTRY_DELETED) arp_deleted--;
+    entry->ip = key;
+    entry->state = ARP_ENTRY_VALID;
+    return entry;
+}
+
+/**
+ * @brief 设置表项的mac和过期时刻，挂到时间轮上
+ *        已经挂在时间轮上的表项不移动，到时间后再按新的过期时刻重新挂上
+ * 
+ * @param entry 表项
+ * @param mac mac地址
+ * @param expire 过期时刻
+ */
+static void arp_cache_fill(arp_entry_t *entry, const uint8_t *mac, uint32_t expire)
+{
+    memcpy(entry->mac, mac, NET_MAC_LEN);
+    entry->expire = expire;
+    if(!(entry->flags & ARP_FLAG_LINKED))
+        arp_wheel_link((int32_t)(entry - &arp_table[0].entries[0]));
+}
+
+/**
+ * @brief 插入或更新一个表项，状态变为有效，过期时刻为现在加ARP_TIMEOUT_SEC
+ * 
+ * @param ip ip地址
+ * @param mac mac地址
+ */
+static void arp_cache_set(uint8_t *ip, uint8_t *mac)
+{
+    uint32_t key;
+    memcpy(&key, ip, NET_IP_LEN);
+    arp_entry_t *entry = arp_cache_slot(key);
+    entry->state = ARP_ENTRY_VALID;
+    entry->flags &= ~(ARP_FLAG_PROBING | ARP_FLAG_PROBE_DUE);
+    arp_cache_fill(entry, mac, (uint32_t)time(NULL) + ARP_TIMEOUT_SEC);
+}
+
+/**
+ * @brief 查询ip是否已经在arp缓存中（有效或stale）
+ * 
+ * @param ip ip地址
+ * @return int 在为1
+ */
+static int arp_cache_has(uint8_t *ip)
+{
+    uint32_t key;
+    memcpy(&key, ip, NET_IP_LEN);
+    return arp_cache_find(key) != NULL;
+}
+
+/**
+ * @brief 已删除的表项太多时探测链会变长，把有效表项重新插入一遍
+ * 
+ */
+static void arp_cache_rehash()
+{
+    static arp_entry_t valid[ARP_CACHE_SIZE];
+    size_t n = 0;
+    for(int32_t i = 0; i < ARP_CACHE_SIZE; i++)
+        if(arp_entry_usable(arp_entry_at(i))) valid[n++] = *arp_entry_at(i);
+    arp_cache_clear();
+    for(size_t i = 0; i < n; i++) {
+        arp_entry_t *entry = arp_cache_slot(valid[i].ip);
+        entry->state = valid[i].state;
+        entry->flags = valid[i].flags & ARP_FLAG_PROBING;
+        arp_cache_fill(entry, valid[i].mac, valid[i].expire);
+    }
+}
+
+/**
+ * @brief 推进时间轮，处理到期的表项，一秒内的多次调用只检查一次时间。
+ *        有效的表项到期后变为stale，再过ARP_STALE_SEC仍没有被确认才删除
+ * 
+ */
+static void arp_cache_age()
+{
+    time_t now = time(NULL);
+    if(now <= arp_wheel_now) return;
+    time_t ticks = now - arp_wheel_now;
+    if(ticks > ARP_WHEEL_SLOTS) ticks = ARP_WHEEL_SLOTS;
+    for(time_t t = now - ticks + 1; t <= now; t++) {
+        size_t slot = t & (ARP_WHEEL_SLOTS - 1);
+        int32_t index = arp_wheel[slot];
+        arp_wheel[slot] = -1;
+        while(index >= 0) {
+            int32_t next = arp_wheel_next[index];
+            arp_entry_t *entry = arp_entry_at(index);
+            entry->flags &= ~ARP_FLAG_LINKED;
+            if(arp_entry_usable(entry)) {
+                if((int32_t)(entry->expire - (uint32_t)now) > 0) {
+                    arp_wheel_link(index);
+                } else if(entry->state == ARP_ENTRY_VALID) {
+                    entry->state = ARP_ENTRY_STALE;
+                    entry->flags &= ~ARP_FLAG_PROBING;
+                    entry->expire = (uint32_t)now + ARP_STALE_SEC;
+                    arp_wheel_link(index);
+                } else {
+                    entry->state = ARP_ENTRY_DELETED;
+                    arp_deleted++;
+                }
+            }
+            index = next;
+        }
+    }
+    arp_wheel_now = now;
+    if(arp_deleted > ARP_CACHE_SIZE / 4)
+        arp_cache_rehash();
+}
+
+/**
+ * @brief 初始化arp buffer
+ * 
+ */
+static void arp_buf_init()
+{
+    memset(arp_buf, 0, sizeof(arp_buf));
+    for(int32_t i = 0; i < ARP_PENDING_MAX_PKTS; i++)
+        arp_buf_pkts[i].next = i + 1 < ARP_PENDING_MAX_PKTS ? i + 1 : -1;
+    arp_buf_free = 0;
+    arp_buf_bytes = 0;
+    buf_pool_init();
+}
+
+/**
+ * @brief 查找发往ip的等待队列
+ * 
+ * @param ip 目的ip地址
+ * @return arp_pending_t* 找不到返回NULL
+ */
+static arp_pending_t *arp_buf_find(uint8_t *ip)
+{
+    for(int i = 0; i < ARP_PENDING_MAX_DESTS; i++)
+        if(arp_buf[i].used && memcmp(arp_buf[i].ip, ip, NET_IP_LEN) == 0) return &arp_buf[i];
+    return NULL;
+}
+
+/**
+ * @brief 把数据包拷贝到缓冲池中，加到等待队列末尾，超过上限或缓冲池用完时丢弃
+ * 
+ * @param pending 等待队列
+ * @param buf 数据包
+ */
+static void arp_buf_enqueue(arp_pending_t *pending, buf_t *buf)
+{
+    if(pending->count >= ARP_PENDING_PER_DEST || arp_buf_free < 0 || buf->len > ETHERNET_MAX_TRANSPORT_UNIT ||
+    pending->bytes + buf->len > ARP_PENDING_DEST_BYTES || arp_buf_bytes + buf->len > ARP_PENDING_MAX_BYTES) {
+        arp_buf_stats.dropped++;
+        return;
+    }
+    buf_t *copy = buf_pool_alloc(buf->len);
+    if(copy == NULL) {
+        arp_buf_stats.dropped++;
+        return;
+    }
+    memcpy(copy->data, buf->data, buf->len);
+    int32_t index = arp_buf_free;
+    arp_pending_pkt_t *pkt = &arp_buf_pkts[index];
+    arp_buf_free = pkt->next;
+    pkt->next = -1;
+    pkt->buf = copy;
+    if(pending->tail >= 0) arp_buf_pkts[pending->tail].next = index;
+    else pending->head = index;
+    pending->tail = index;
+    pending->count++;
+    pending->bytes += buf->len;
+    arp_buf_bytes += buf->len;
+    arp_buf_stats.queued++;
+}
+
+/**
+ * @brief 释放等待队列，mac不为NULL时按顺序把缓存的数据包交给发送队列，否则丢弃
+ * 
+ * @param pending 等待队列
+ * @param mac 目的mac地址
+ */
+static void arp_buf_release(arp_pending_t *pending, uint8_t *mac)
+{
+    int32_t index = pending->head;
+    while(index >= 0) {
+        arp_pending_pkt_t *pkt = &arp_buf_pkts[index];
+        int32_t next = pkt->next;
+        arp_buf_bytes -= pkt->buf->len;
+        if(mac) {
+            ethernet_out_pool(pkt->buf, mac, NET_PROTOCOL_IP);
+            arp_buf_stats.flushed++;
+        } else {
+            buf_pool_free(pkt->buf);
+            arp_buf_stats.unresolved++;
+        }
+        pkt->buf = NULL;
+        pkt->next = arp_buf_free;
+        arp_buf_free = index;
+        index = next;
+    }
+    pending->used = 0;
+}
+
+/**
+ * @brief 打印arp buffer统计
+ * 
+ */
+void arp_buf_print()
+{
+    printf("===ARP BUFFER===\n");
+    printf("queued: %zu | flushed: %zu | dropped: %zu | unresolved: %zu | bytes: %zu\n",
+    arp_buf_stats.queued, arp_buf_stats.flushed, arp_buf_stats.dropped, arp_buf_stats.unresolved, arp_buf_bytes);
+}
 
 /**
  * @brief 打印一条arp表项
@@ -47,7 +591,12 @@ void arp_entry_print(void *ip, void *mac, time_t *timestamp)
 void arp_print()
 {
     printf("===ARP TABLE BEGIN===\n");
-    map_foreach(&arp_table, arp_entry_print);
+    for(int32_t i = 0; i < ARP_CACHE_SIZE; i++) {
+        arp_entry_t *entry = arp_entry_at(i);
+        if(!arp_entry_usable(entry)) continue;
+        time_t timestamp = (time_t)entry->expire - ARP_TIMEOUT_SEC;
+        arp_entry_print(&entry->ip, entry->mac, &timestamp);
+    }
     printf("===ARP TABLE  END ===\n");
 }
 
@@ -55,8 +604,9 @@ void arp_print()
  * @brief 发送一个arp请求
  * 
  * @param target_ip 想要知道的目标的ip地址
+ * @param target_mac 请求发往的mac地址，刷新已知表项时是单播，否则是广播
  */
-void arp_req(uint8_t *target_ip)
+static void arp_req_to(uint8_t *target_ip, const uint8_t *target_mac)
 {
     // TO-DO
     // Step1 ：调用buf_init()对txbuf进行初始化。
@@ -71,10 +621,20 @@ void arp_req(uint8_t *target_ip)
     arp->opcode16 = swap16(ARP_REQUEST);
 
     // Step4 ：调用ethernet_out函数将ARP报文发送出去。
+    ethernet_out(&txbuf, target_mac, NET_PROTOCOL_ARP);
+}
+
+/**
+ * @brief 发送一个arp请求
+ * 
+ * @param target_ip 想要知道的目标的ip地址
+ */
+void arp_req(uint8_t *target_ip)
+{
     // 注意：ARP announcement或ARP请求报文都是广播报文，其目标MAC地址应该是广播地址：FF-FF-FF-FF-FF-FF。
     uint8_t broadcast_mac[NET_MAC_LEN];
     for(int i = 0; i < NET_MAC_LEN; i ++ ) broadcast_mac[i] = 0xFF;
-    ethernet_out(&txbuf, broadcast_mac, NET_PROTOCOL_ARP);
+    arp_req_to(target_ip, broadcast_mac);
 }
 
 /**
@@ -121,27 +681,30 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
     (swap16(arp->opcode16) != ARP_REQUEST &&     // 操作类型
     swap16(arp->opcode16) != ARP_REPLY)) return;
 
-    // Step3 ：调用map_set()函数更新ARP表项。
-    map_set(&arp_table, arp->sender_ip, arp->sender_mac);
-    
-    // Step4 ：调用map_get()函数查看该接收报文的IP地址是否有对应的arp_buf缓存。
-    buf_t *arp_buf_item = map_get(&arp_buf, arp->sender_ip);
+    // Step3 ：推进时间轮，学习发送方的地址（RFC 826）：
+    // 发送方已经在表中、ARP是发给本机的、是免费ARP（sender_ip == target_ip）
+    // 或者本机正在等待它的响应时，调用arp_cache_set()函数更新ARP表项。
+    // 发送方ip为0（地址探测）或与本机相同时不学习。
+    arp_cache_age();
+    uint8_t zero_ip[NET_IP_LEN] = {0};
+    int to_us = memcmp(arp->target_ip, net_if_ip, NET_IP_LEN) == 0;
+    int gratuitous = memcmp(arp->sender_ip, arp->target_ip, NET_IP_LEN) == 0;
+    int learnable = memcmp(arp->sender_ip, zero_ip, NET_IP_LEN) != 0 &&
+    memcmp(arp->sender_ip, net_if_ip, NET_IP_LEN) != 0;
+    arp_pending_t *pending = arp_buf_find(arp->sender_ip);
+    if(learnable && (to_us || gratuitous || pending || arp_cache_has(arp->sender_ip)))
+        arp_cache_set(arp->sender_ip, arp->sender_mac);
     
+    // Step4 ：查看该接收报文的IP地址是否有对应的arp_buf缓存。
     // 如果有，则说明ARP分组队列里面有待发送的数据包。
-    if (arp_buf_item) {
-        // 将缓存的数据包arp_buf再发送给以太网层
-        ethernet_out(arp_buf_item, arp->sender_mac, NET_PROTOCOL_IP);
-        // 将这个缓存的数据包删除掉
-        map_delete(&arp_buf, arp->sender_ip);
-    }
-
-    // 否则，还需要判断是否是请求本主机MAC地址的ARP请求报文
-    else{
-        if (swap16(arp->opcode16) == ARP_REQUEST && 
-        memcmp(arp->target_ip, net_if_ip, NET_IP_LEN) == 0) {
-            // 回应一个响应报文
-            arp_resp(arp->sender_ip, arp->sender_mac);
-        }
+    if (pending) {
+        // 将缓存的数据包按顺序一起发送给以太网层，并释放这个等待队列
+        arp_buf_release(pending, arp->sender_mac);
+    }
+
+    // Step5 ：判断是否是请求本主机MAC地址的ARP请求报文，如果是则回应一个响应报文
+    if (swap16(arp->opcode16) == ARP_REQUEST && to_us) {
+        arp_resp(arp->sender_ip, arp->sender_mac);
     }
 }
 
@@ -155,22 +718,66 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
 void arp_out(buf_t *buf, uint8_t *ip)
 {
     // TO-DO
-    // Step1 ：调用map_get()函数，根据IP地址来查找ARP表(arp_table)。
-    uint8_t *mac = map_get(&arp_table, ip);
+    // Step1 ：推进时间轮，调用arp_cache_get()函数，根据IP地址来查找ARP表(arp_table)。
+    arp_cache_age();
+    uint8_t *mac = arp_cache_get(ip);
 
-    // Step2 ：如果能找到该IP地址对应的MAC地址，则将数据包直接发送给以太网层
-    if(mac) ethernet_out(buf, mac, NET_PROTOCOL_IP);
+    // Step2 ：如果能找到该IP地址对应的MAC地址，则将数据包直接发送给以太网层，
+    // ethernet_out()拷贝完数据包之后再发出需要的单播刷新请求
+    if(mac) {
+        ethernet_out(buf, mac, NET_PROTOCOL_IP);
+        arp_cache_probe(ip);
+    }
 
-    // Step3 ：如果没有找到对应的MAC地址，则需要进一步判断arp_buf是否已经有包了
+    // Step3 ：如果没有找到对应的MAC地址，则需要进一步判断arp_buf是否已经有等待队列了
     else {
-        // 如果有，则说明正在等待该ip回应ARP请求，此时不能再发送arp请求
-        if(map_get(&arp_buf,ip)) return; 
-        else {
-            // 如果没有包，则调用map_set()函数将来自IP层的数据包缓存到arp_buf
-            map_set(&arp_buf, ip, buf);
-            // 调用arp_req()函数，发一个请求目标IP地址对应的MAC地址的ARP request报文
-            arp_req(ip);
+        arp_pending_t *pending = arp_buf_find(ip);
+        // 如果没有，则分配一个等待队列，并调用arp_req()函数，发一个请求目标IP地址对应的MAC地址的ARP request报文
+        // 如果有，则说明正在等待该ip回应ARP请求，此时不再发送arp请求，重发由arp_poll()负责
+        int new_pending = pending == NULL;
+        if(new_pending) {
+            for(int i = 0; i < ARP_PENDING_MAX_DESTS && pending == NULL; i++)
+                if(!arp_buf[i].used) pending = &arp_buf[i];
+            if(pending == NULL) {
+                arp_buf_stats.dropped++;
+                return;
+            }
+            pending->used = 1;
+            memcpy(pending->ip, ip, NET_IP_LEN);
+            pending->head = pending->tail = -1;
+            pending->count = 0;
+            pending->bytes = 0;
+            pending->retries = 0;
+            pending->interval = ARP_MIN_INTERVAL;
+            pending->next_req = time(NULL) + pending->interval;
+        }
+        // 将来自IP层的数据包缓存到等待队列末尾
+        // 必须先缓存再发ARP请求：arp_req()会重新初始化txbuf，而调用者传进来的buf往往就是txbuf
+        arp_buf_enqueue(pending, buf);
+        if(new_pending) arp_req(ip);
+    }
+}
+
+/**
+ * @brief arp定时处理：推进时间轮，对还没有响应的ip按指数退避重发ARP请求，
+ *        重发次数用完后丢弃发往它的数据包
+ * 
+ */
+void arp_poll()
+{
+    arp_cache_age();
+    time_t now = time(NULL);
+    for(int i = 0; i < ARP_PENDING_MAX_DESTS; i++) {
+        arp_pending_t *pending = &arp_buf[i];
+        if(!pending->used || now < pending->next_req) continue;
+        if(pending->retries == ARP_REQ_RETRIES) {
+            arp_buf_release(pending, NULL);
+            continue;
         }
+        pending->retries++;
+        pending->interval *= 2;
+        pending->next_req = now + pending->interval;
+        arp_req(pending->ip);
     }
 }
 
@@ -180,8 +787,9 @@ void arp_out(buf_t *buf, uint8_t *ip)
  */
 void arp_init()
 {
-    map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
-    map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy);
+    arp_cache_clear();
+    arp_wheel_now = time(NULL);
+    arp_buf_init();
     net_add_protocol(NET_PROTOCOL_ARP, arp_in);
     arp_req(net_if_ip);
 }
\ No newline at end of file
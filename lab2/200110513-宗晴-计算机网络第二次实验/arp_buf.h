@@ -0,0 +1,11 @@
+#ifndef ARP_BUF_H
+#define ARP_BUF_H
+
+#include "net.h"
+
+// arp定时处理，定义在arp.c，由ethernet_poll周期调用：推进时间轮、按指数退避重发ARP请求
+void arp_poll();
+// 打印arp buffer（等待ARP响应的数据包队列）统计
+void arp_buf_print();
+
+#endif
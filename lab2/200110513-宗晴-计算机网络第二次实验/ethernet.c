@@ -2,7 +2,241 @@
 #include "utils.h"
 #include "driver.h"
 #include "arp.h"
+#include "arp_buf.h"
 #include "ip.h"
+#include "ring.h"
+#include "pool.h"
+#include "ethernet_queue.h"
+#include "tcp_poll.h"
+
+/**
+ * @brief 每次轮询最多交给协议处理的数据帧数（接收预算），
+ *        限制一次突发的处理时间，保证ping/UDP等的时延有界
+ * 
+ */
+#ifndef ETHERNET_RX_BUDGET
+#define ETHERNET_RX_BUDGET 16
+#endif
+
+/**
+ * @brief 每次轮询最多从驱动收取的数据帧数。比接收预算大，突发的数据帧先在接收队列中排队，
+ *        之后的轮询再处理；持续超过处理能力时接收队列会满，由背压和丢弃限制
+ * 
+ */
+#ifndef ETHERNET_RX_BURST
+#define ETHERNET_RX_BURST 32
+#endif
+
+/**
+ * @brief 轮流处理各接收队列时，每个队列每轮最多处理的数据帧数
+ * 
+ */
+#define ETHERNET_RX_QUANTUM 4
+
+/**
+ * @brief 接收队列数，数据帧按流哈希分到各个队列，同一条流总是在同一个队列中。
+ *        协议栈的状态（txbuf、arp表、连接表、分片重组等）不是线程安全的，各队列都在ethernet_poll()中
+ *        由同一个线程处理，队列用来在流之间隔离：一条流的突发只会占满自己的队列，处理时各队列轮流
+ * 
+ */
+#ifndef ETHERNET_RX_QUEUES
+#define ETHERNET_RX_QUEUES 4
+#endif
+
+/**
+ * @brief RSS间接表的大小，流哈希的低位作为下标查表得到队列号
+ * 
+ */
+#define ETHERNET_RETA_SIZE 128
+
+/**
+ * @brief Toeplitz哈希的密钥（Microsoft RSS规范中的默认密钥）
+ * 
+ */
+static const uint8_t rss_key[40] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+    0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+    0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+    0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa};
+
+/**
+ * @brief RSS间接表
+ * 
+ */
+static uint8_t rss_reta[ETHERNET_RETA_SIZE];
+
+/**
+ * @brief Toeplitz哈希对异或是线性的，输入的每个字节各自贡献的哈希值预先算好，
+ *        rss_table[i][v]是只有第i个字节为v、其余为0的输入的哈希值，计算时每个字节查一次表
+ * 
+ */
+static uint32_t rss_table[8][256];
+
+/**
+ * @brief 各接收队列的长度，必须是2的幂。比ETHERNET_RX_BURST大，
+ *        处理跟不上时先越过高水位产生背压，之后才因为队列满而丢弃
+ * 
+ */
+#ifndef ETHERNET_RX_QUEUE_LEN
+#define ETHERNET_RX_QUEUE_LEN 64
+#endif
+
+/**
+ * @brief 各接收队列，驱动侧生产、协议处理侧消费。
+ *        数据帧放在缓冲池的buf_t中，入队后归队列所有，可以跨越多次轮询，处理完才还给缓冲池
+ * 
+ */
+static spsc_ring_t rx_queue[ETHERNET_RX_QUEUES];
+static void *rx_queue_slot[ETHERNET_RX_QUEUES][ETHERNET_RX_QUEUE_LEN];
+
+/**
+ * @brief 下一次处理从哪个接收队列开始，每次轮询轮换
+ * 
+ */
+static int rx_queue_next;
+
+/**
+ * @brief 因接收队列满而丢弃的数据帧数
+ * 
+ */
+static size_t rx_queue_drops;
+
+/**
+ * @brief 发送队列长度，队列满时立即整体发送
+ * 
+ */
+#ifndef ETHERNET_TX_QUEUE_LEN
+#define ETHERNET_TX_QUEUE_LEN 64
+#endif
+
+/**
+ * @brief 发送队列，存放缓冲池中数据帧的引用，由ethernet_flush()成批交给驱动后释放
+ * 
+ */
+static buf_t *tx_queue[ETHERNET_TX_QUEUE_LEN];
+static int tx_queue_len;
+
+/**
+ * @brief 因缓冲池用完而丢弃的待发送数据帧数
+ * 
+ */
+static size_t tx_queue_drops;
+
+/**
+ * @brief Toeplitz哈希，逐位计算，只用于生成rss_table
+ * 
+ * @param input 输入，按网络字节序排列
+ * @param len 输入长度，不超过36字节
+ * @return uint32_t 哈希值
+ */
+static uint32_t rss_hash(const uint8_t *input, size_t len)
+{
+    uint32_t result = 0;
+    uint32_t window = ((uint32_t)rss_key[0] << 24) | ((uint32_t)rss_key[1] << 16) |
+    ((uint32_t)rss_key[2] << 8) | rss_key[3];
+    for(size_t i = 0; i < len; i++) {
+        for(int b = 7; b >= 0; b--) {
+            if(input[i] & (1 << b)) result ^= window;
+            window = (window << 1) | ((rss_key[i + 4] >> b) & 1);
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief 计算一个数据帧的流哈希：所有IP数据帧都按(源ip, 目的ip)，
+ *        同一条流的分片和未分片的数据包、同一数据包的所有分片都在同一个队列。
+ *        非IP的数据帧（如ARP）哈希为0
+ * 
+ * @param buf 数据帧，包含以太网头部
+ * @return uint32_t 哈希值
+ */
+static uint32_t ethernet_flow_hash(buf_t *buf)
+{
+    if(buf->len < sizeof(ether_hdr_t) + 20) return 0;
+    ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
+    if(swap16(hdr->protocol16) != NET_PROTOCOL_IP) return 0;
+
+    const uint8_t *addr = buf->data + sizeof(ether_hdr_t) + 12;    // 源ip和目的ip
+    uint32_t result = 0;
+    for(int i = 0; i < 8; i++)
+        result ^= rss_table[i][addr[i]];
+    return result;
+}
+
+/**
+ * @brief 从驱动收取最多ETHERNET_RX_BURST个数据帧，按流哈希放进各个接收队列，队列满时丢弃。
+ *        pcap驱动没有原生的批量接口，这里循环调用driver_recv()；
+ *        缓冲池用完时停止收取，剩下的数据帧留在驱动中
+ * 
+ */
+static void ethernet_rx()
+{
+    for(int n = 0; n < ETHERNET_RX_BURST; n++) {
+        buf_t *buf = buf_pool_alloc(ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+        if(buf == NULL) return;
+        if(driver_recv(buf) <= 0) {
+            buf_pool_free(buf);
+            return;
+        }
+        int q = rss_reta[ethernet_flow_hash(buf) % ETHERNET_RETA_SIZE];
+        if(spsc_ring_enqueue(&rx_queue[q], buf) < 0) {
+            rx_queue_drops++;
+            buf_pool_free(buf);
+        }
+    }
+}
+
+/**
+ * @brief 轮流从各接收队列取出数据帧交给ethernet_in()，每个队列每轮最多ETHERNET_RX_QUANTUM个，
+ *        一共最多ETHERNET_RX_BUDGET个。一条流占满自己的队列时，其他队列中的流照样按份额处理
+ * 
+ */
+static void ethernet_rx_drain()
+{
+    void *burst[ETHERNET_RX_QUANTUM];
+    size_t budget = ETHERNET_RX_BUDGET;
+    int idle = 0;
+    while(budget > 0 && idle < ETHERNET_RX_QUEUES) {
+        int q = rx_queue_next;
+        rx_queue_next = (rx_queue_next + 1) % ETHERNET_RX_QUEUES;
+        size_t m = spsc_ring_dequeue_burst(&rx_queue[q], burst,
+            budget < ETHERNET_RX_QUANTUM ? budget : ETHERNET_RX_QUANTUM);
+        idle = m ? 0 : idle + 1;
+        budget -= m;
+        for(size_t i = 0; i < m; i++) {
+            ethernet_in((buf_t *)burst[i]);
+            buf_pool_free((buf_t *)burst[i]);
+        }
+    }
+}
+
+/**
+ * @brief 把一批数据帧交给驱动发送
+ *        pcap驱动没有原生的批量接口，这里循环调用driver_send()
+ * 
+ * @param bufs 要发送的数据帧
+ * @param n 帧数
+ */
+static void driver_send_batch(buf_t **bufs, int n)
+{
+    for(int i = 0; i < n; i++)
+        driver_send(bufs[i]);
+}
+
+/**
+ * @brief 把发送队列中积累的数据帧一次性发送出去，然后释放它们的引用
+ * 
+ */
+void ethernet_flush()
+{
+    if(tx_queue_len == 0) return;
+    driver_send_batch(tx_queue, tx_queue_len);
+    for(int i = 0; i < tx_queue_len; i++)
+        buf_pool_free(tx_queue[i]);
+    tx_queue_len = 0;
+}
+
 /**
  * @brief 处理一个收到的数据包
  * 
@@ -33,13 +267,44 @@ void ethernet_in(buf_t *buf)
 void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
 {
     // TO-DO
+    // Step0 ：从缓冲池分配一个缓冲，把数据拷贝进去，之后只修改这个副本，
+    // 调用者的buf（通常是txbuf）在函数返回后即可重用。缓冲池用完时先把发送队列整体发送，还不够就丢弃。
+    buf_t *frame = buf_pool_alloc(buf->len);
+    if(frame == NULL) {
+        ethernet_flush();
+        frame = buf_pool_alloc(buf->len);
+    }
+    if(frame == NULL) {
+        tx_queue_drops++;
+        return;
+    }
+    memcpy(frame->data, buf->data, buf->len);
+    ethernet_out_pool(frame, mac, protocol);
+}
+
+/**
+ * @brief 把缓冲池中的数据包封装成数据帧放进发送队列，不拷贝。
+ *        发送队列取走调用者的引用，封装时直接修改buf，调用者之后不能再使用它
+ * 
+ * @param buf 由buf_pool_alloc()分配的数据包
+ * @param mac 目标MAC地址
+ * @param protocol 上层协议
+ */
+void ethernet_out_pool(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
+{
+    // 队列满时先整体发送
+    if(tx_queue_len == ETHERNET_TX_QUEUE_LEN)
+        ethernet_flush();
+    buf_t *frame = buf;
+    tx_queue[tx_queue_len++] = frame;
+
     // Step1 ：首先判断数据长度，如果不足46则显式填充0，填充可以调用buf_add_padding()函数来实现。
-    if(buf->len < ETHERNET_MIN_TRANSPORT_UNIT)
-        buf_add_padding(buf, 46 - buf->len);
+    if(frame->len < ETHERNET_MIN_TRANSPORT_UNIT)
+        buf_add_padding(frame, ETHERNET_MIN_TRANSPORT_UNIT - frame->len);
     
     // Step2 ：调用buf_add_header()函数添加以太网包头。
-    buf_add_header(buf, sizeof(ether_hdr_t));
-    ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
+    buf_add_header(frame, sizeof(ether_hdr_t));
+    ether_hdr_t *hdr = (ether_hdr_t *)frame->data;
 
     // Step3 ：填写目的MAC地址。
     memcpy(hdr->dst, mac, NET_MAC_LEN);
@@ -50,9 +315,7 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
     // Step5 ：填写协议类型 protocol。（大小端转换）
     hdr->protocol16 = swap16(protocol);
 
-    // Step6 ：调用驱动层封装好的driver_send()发送函数，将添加了以太网包头的数据帧发送到驱动层。
-    driver_send(buf);
-
+    // Step6 ：数据帧留在发送队列中，在本次轮询结束或队列满时由ethernet_flush()成批发送到驱动层。
 }
 /**
  * @brief 初始化以太网协议
@@ -60,15 +323,40 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
  */
 void ethernet_init()
 {
-    buf_init(&rxbuf, ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+    for(int i = 0; i < ETHERNET_RETA_SIZE; i++)
+        rss_reta[i] = i % ETHERNET_RX_QUEUES;
+    uint8_t input[8] = {0};
+    for(int i = 0; i < 8; i++) {
+        for(int v = 0; v < 256; v++) {
+            input[i] = v;
+            rss_table[i][v] = rss_hash(input, 8);
+        }
+        input[i] = 0;
+    }
+    for(int q = 0; q < ETHERNET_RX_QUEUES; q++)
+        spsc_ring_init(&rx_queue[q], rx_queue_slot[q], ETHERNET_RX_QUEUE_LEN);
+    buf_pool_init();
 }
 
 /**
  * @brief 一次以太网轮询
+ *        先从驱动收取最多ETHERNET_RX_BURST个数据帧，按流哈希放进各个接收队列，
+ *        再轮流从各队列取出最多ETHERNET_RX_BUDGET个交给ethernet_in()处理，同一条流的数据帧保持原来的顺序，
+ *        没处理完的留到下一次轮询。
+ *        然后进行arp和tcp的定时处理，最后把处理过程中和定时器产生的数据帧一起发送出去
  * 
  */
 void ethernet_poll()
 {
-    if (driver_recv(&rxbuf) > 0)
-        ethernet_in(&rxbuf);
+    // 有队列超过高水位时先不从驱动收取，等协议处理侧追上
+    int pressure = 0;
+    for(int q = 0; q < ETHERNET_RX_QUEUES; q++)
+        pressure |= spsc_ring_pressure(&rx_queue[q]);
+    if(!pressure)
+        ethernet_rx();
+
+    ethernet_rx_drain();
+    arp_poll();
+    tcp_poll();
+    ethernet_flush();
 }
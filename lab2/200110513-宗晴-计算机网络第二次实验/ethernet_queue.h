@@ -0,0 +1,9 @@
+#ifndef ETHERNET_QUEUE_H
+#define ETHERNET_QUEUE_H
+
+#include "net.h"
+
+// 把缓冲池中的数据包不拷贝地放进发送队列，定义在ethernet.c，发送队列取走调用者的引用
+void ethernet_out_pool(buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef RING_H
+#define RING_H
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * @brief 无锁环形队列，队列中存放的是指针（如buf_t *），不拷贝数据包本身。
+ *        spsc_ring_t用于单生产者单消费者，mpmc_ring_t用于多生产者多消费者。
+ *        槽位数组由调用者提供，容量必须是2的幂。
+ *        生产者和消费者使用的下标放在不同的缓存行中，避免伪共享
+ * 
+ */
+
+#ifndef RING_CACHE_LINE
+#define RING_CACHE_LINE 64
+#endif
+
+#define RING_ALIGNED _Alignas(RING_CACHE_LINE)
+
+/**
+ * @brief 多生产者（消费者）之间按预留顺序推进下标时，最多忙等这么多次就让出CPU，
+ *        否则先预留的线程被抢占时，后面的线程会空转整个时间片（线程数多于CPU核数时很明显）
+ * 
+ */
+#ifndef RING_PAUSE_REP_COUNT
+#define RING_PAUSE_REP_COUNT 64
+#endif
+
+static inline void ring_cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * @brief 等待下标idx变为expect，即比自己先预留的线程都已经完成。
+ *        必须用acquire：之后自己用release推进下标时，前面线程对槽位的读写也要一起对另一端可见
+ * 
+ */
+static inline void ring_wait_turn(_Atomic size_t *idx, size_t expect)
+{
+    unsigned rep = 0;
+    while(atomic_load_explicit(idx, memory_order_acquire) != expect) {
+        ring_cpu_relax();
+        if(++rep == RING_PAUSE_REP_COUNT) {
+            rep = 0;
+            sched_yield();
+        }
+    }
+}
+
+typedef struct spsc_ring {
+    RING_ALIGNED _Atomic size_t head;   // 消费者写
+    size_t cached_tail;                 // 消费者看到的tail
+    RING_ALIGNED _Atomic size_t tail;   // 生产者写
+    size_t cached_head;                 // 生产者看到的head
+    RING_ALIGNED size_t mask;
+    size_t high_water;                  // 超过该数量时认为有背压
+    void **slot;
+} spsc_ring_t;
+
+typedef struct mpmc_ring_index {
+    RING_ALIGNED _Atomic size_t head;
+    _Atomic size_t tail;
+} mpmc_ring_index_t;
+
+typedef struct mpmc_ring {
+    mpmc_ring_index_t prod;
+    mpmc_ring_index_t cons;
+    RING_ALIGNED size_t mask;
+    size_t high_water;
+    void **slot;
+} mpmc_ring_t;
+
+/**
+ * @brief 初始化单生产者单消费者队列
+ * 
+ * @param r 队列
+ * @param slot 槽位数组
+ * @param size 槽位个数，必须是2的幂
+ * @return int 成功为0，size不合法为-1
+ */
+static inline int spsc_ring_init(spsc_ring_t *r, void **slot, size_t size)
+{
+    if(size == 0 || (size & (size - 1))) return -1;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    r->cached_head = r->cached_tail = 0;
+    r->mask = size - 1;
+    r->high_water = size - size / 4;
+    r->slot = slot;
+    return 0;
+}
+
+/**
+ * @brief 批量入队，只能由生产者调用
+ * 
+ * @param r 队列
+ * @param obj 要入队的指针
+ * @param n 个数
+ * @return size_t 实际入队的个数，小于n说明队列已满
+ */
+static inline size_t spsc_ring_enqueue_burst(spsc_ring_t *r, void *const *obj, size_t n)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t size = r->mask + 1;
+    if(size - (tail - r->cached_head) < n)
+        r->cached_head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t space = size - (tail - r->cached_head);
+    if(n > space) n = space;
+    for(size_t i = 0; i < n; i++)
+        r->slot[(tail + i) & r->mask] = obj[i];
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+    return n;
+}
+
+/**
+ * @brief 批量出队，只能由消费者调用
+ * 
+ * @param r 队列
+ * @param obj 出队的指针存放在这里
+ * @param n 最多出队的个数
+ * @return size_t 实际出队的个数
+ */
+static inline size_t spsc_ring_dequeue_burst(spsc_ring_t *r, void **obj, size_t n)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if(r->cached_tail - head < n)
+        r->cached_tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    size_t avail = r->cached_tail - head;
+    if(n > avail) n = avail;
+    for(size_t i = 0; i < n; i++)
+        obj[i] = r->slot[(head + i) & r->mask];
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+    return n;
+}
+
+static inline int spsc_ring_enqueue(spsc_ring_t *r, void *obj)
+{
+    return spsc_ring_enqueue_burst(r, &obj, 1) == 1 ? 0 : -1;
+}
+
+static inline void *spsc_ring_dequeue(spsc_ring_t *r)
+{
+    void *obj;
+    return spsc_ring_dequeue_burst(r, &obj, 1) == 1 ? obj : NULL;
+}
+
+static inline size_t spsc_ring_count(spsc_ring_t *r)
+{
+    return atomic_load_explicit(&r->tail, memory_order_acquire) -
+    atomic_load_explicit(&r->head, memory_order_acquire);
+}
+
+/**
+ * @brief 背压信号：队列中的元素超过高水位（容量的3/4）时返回1，
+ *        生产者应暂停从下层收取新的数据包，让消费者追上
+ * 
+ */
+static inline int spsc_ring_pressure(spsc_ring_t *r)
+{
+    return spsc_ring_count(r) >= r->high_water;
+}
+
+/**
+ * @brief 初始化多生产者多消费者队列
+ * 
+ * @param r 队列
+ * @param slot 槽位数组
+ * @param size 槽位个数，必须是2的幂
+ * @return int 成功为0，size不合法为-1
+ */
+static inline int mpmc_ring_init(mpmc_ring_t *r, void **slot, size_t size)
+{
+    if(size == 0 || (size & (size - 1))) return -1;
+    atomic_init(&r->prod.head, 0);
+    atomic_init(&r->prod.tail, 0);
+    atomic_init(&r->cons.head, 0);
+    atomic_init(&r->cons.tail, 0);
+    r->mask = size - 1;
+    r->high_water = size - size / 4;
+    r->slot = slot;
+    return 0;
+}
+
+/**
+ * @brief 批量入队。先用CAS在prod.head上预留n个槽位，写入后
+ *        按预留的先后顺序推进prod.tail，消费者只能看到prod.tail之前的元素
+ * 
+ * @param r 队列
+ * @param obj 要入队的指针
+ * @param n 个数
+ * @return size_t 实际入队的个数，小于n说明队列已满
+ */
+static inline size_t mpmc_ring_enqueue_burst(mpmc_ring_t *r, void *const *obj, size_t n)
+{
+    size_t size = r->mask + 1;
+    size_t head = atomic_load_explicit(&r->prod.head, memory_order_relaxed);
+    size_t next, m;
+    do {
+        size_t cons_tail = atomic_load_explicit(&r->cons.tail, memory_order_acquire);
+        size_t space = size - (head - cons_tail);
+        m = n > space ? space : n;
+        if(m == 0) return 0;
+        next = head + m;
+    } while(!atomic_compare_exchange_weak_explicit(&r->prod.head, &head, next,
+    memory_order_relaxed, memory_order_relaxed));
+
+    for(size_t i = 0; i < m; i++)
+        r->slot[(head + i) & r->mask] = obj[i];
+    // 等待比自己先预留的生产者完成
+    ring_wait_turn(&r->prod.tail, head);
+    atomic_store_explicit(&r->prod.tail, next, memory_order_release);
+    return m;
+}
+
+/**
+ * @brief 批量出队，与入队对称
+ * 
+ * @param r 队列
+ * @param obj 出队的指针存放在这里
+ * @param n 最多出队的个数
+ * @return size_t 实际出队的个数
+ */
+static inline size_t mpmc_ring_dequeue_burst(mpmc_ring_t *r, void **obj, size_t n)
+{
+    size_t head = atomic_load_explicit(&r->cons.head, memory_order_relaxed);
+    size_t next, m;
+    do {
+        size_t prod_tail = atomic_load_explicit(&r->prod.tail, memory_order_acquire);
+        size_t avail = prod_tail - head;
+        m = n > avail ? avail : n;
+        if(m == 0) return 0;
+        next = head + m;
+    } while(!atomic_compare_exchange_weak_explicit(&r->cons.head, &head, next,
+    memory_order_relaxed, memory_order_relaxed));
+
+    for(size_t i = 0; i < m; i++)
+        obj[i] = r->slot[(head + i) & r->mask];
+    ring_wait_turn(&r->cons.tail, head);
+    atomic_store_explicit(&r->cons.tail, next, memory_order_release);
+    return m;
+}
+
+static inline int mpmc_ring_enqueue(mpmc_ring_t *r, void *obj)
+{
+    return mpmc_ring_enqueue_burst(r, &obj, 1) == 1 ? 0 : -1;
+}
+
+static inline void *mpmc_ring_dequeue(mpmc_ring_t *r)
+{
+    void *obj;
+    return mpmc_ring_dequeue_burst(r, &obj, 1) == 1 ? obj : NULL;
+}
+
+static inline size_t mpmc_ring_count(mpmc_ring_t *r)
+{
+    return atomic_load_explicit(&r->prod.tail, memory_order_acquire) -
+    atomic_load_explicit(&r->cons.tail, memory_order_acquire);
+}
+
+static inline int mpmc_ring_pressure(mpmc_ring_t *r)
+{
+    return mpmc_ring_count(r) >= r->high_water;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "map.h"
+#include "../arp.c"
+
+// arp缓存的正确性检查和查找速度对比：
+// 直接包含arp.c以调用其中的静态函数，在同样的ip序列上比较arp_cache_get()和
+// 原来用map_t实现的arp表（map_get()）的每秒查找次数。
+//
+// 编译：和实验框架src目录下除arp.c、main.c之外的源文件一起编译，例如
+//   gcc -std=gnu11 -O2 -I<实验框架的include目录> -I.. arp_bench.c <其他源文件> -lpcap -o arp_bench
+// 用法：arp_bench [每种情况的查找次数，默认10000000]
+
+#define SEQ_LEN 4096
+
+static uint8_t bench_ip[ARP_CACHE_SIZE][NET_IP_LEN];
+static uint8_t bench_mac[ARP_CACHE_SIZE][NET_MAC_LEN];
+static uint16_t bench_seq[SEQ_LEN];
+static map_t bench_map;
+
+static void bench_addr(size_t i, uint8_t *ip, uint8_t *mac)
+{
+    ip[0] = 10;
+    ip[1] = i >> 16;
+    ip[2] = i >> 8;
+    ip[3] = i;
+    for(int k = 0; k < NET_MAC_LEN; k++)
+        mac[k] = i * 7 + k;
+}
+
+/**
+ * @brief 清空两张表，各插入n个表项
+ * 
+ */
+static void bench_fill(size_t n)
+{
+    arp_cache_clear();
+    arp_wheel_now = time(NULL);
+    map_init(&bench_map, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
+    for(size_t i = 0; i < n; i++) {
+        bench_addr(i, bench_ip[i], bench_mac[i]);
+        arp_cache_set(bench_ip[i], bench_mac[i]);
+        map_set(&bench_map, bench_ip[i], bench_mac[i]);
+    }
+}
+
+/**
+ * @brief 插入的表项都能查到正确的mac，没有插入的查不到
+ * 
+ */
+static int bench_check(size_t n)
+{
+    int failed = 0;
+    for(size_t i = 0; i < n; i++) {
+        uint8_t *mac = arp_cache_get(bench_ip[i]);
+        if(mac == NULL || memcmp(mac, bench_mac[i], NET_MAC_LEN) != 0)
+            failed++;
+    }
+    for(size_t i = n; i < n + 1000; i++) {
+        uint8_t ip[NET_IP_LEN], mac[NET_MAC_LEN];
+        bench_addr(i, ip, mac);
+        if(arp_cache_get(ip) != NULL)
+            failed++;
+    }
+    if(failed)
+        printf("%zu entries: %d lookups wrong\n", n, failed);
+    return failed;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 按bench_seq的顺序查找，返回每秒查找次数
+ * 
+ */
+static double bench_run(int use_map, size_t lookups)
+{
+    volatile uint8_t sink = 0;
+    double start = now_sec();
+    for(size_t i = 0; i < lookups; i++) {
+        uint8_t *ip = bench_ip[bench_seq[i & (SEQ_LEN - 1)]];
+        uint8_t *mac = use_map ? map_get(&bench_map, ip) : arp_cache_get(ip);
+        sink += mac[0];
+    }
+    return lookups / (now_sec() - start);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = {1, 16, 256, 768};
+    size_t lookups = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    srand(1);
+    int failed = 0;
+    printf("%8s %8s %16s %16s\n", "entries", "pattern", "map_t lookups/s", "cache lookups/s");
+    for(size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        size_t n = sizes[k];
+        bench_fill(n);
+        failed += bench_check(n);
+        // same：连续发往同一个目的地址，random：在所有表项中随机选择
+        for(int pattern = 0; pattern < 2; pattern++) {
+            for(size_t i = 0; i < SEQ_LEN; i++)
+                bench_seq[i] = pattern == 0 ? n - 1 : (size_t)rand() % n;
+            // map_get()是线性查找，表项多时减少查找次数
+            size_t map_lookups = lookups / (n > 16 ? n / 16 : 1);
+            double map_rate = bench_run(1, map_lookups);
+            double cache_rate = bench_run(0, lookups);
+            printf("%8zu %8s %16.3g %16.3g\n", n, pattern == 0 ? "same" : "random", map_rate, cache_rate);
+        }
+    }
+    printf("correctness: %s\n", failed ? "FAILED" : "ok");
+    return failed != 0;
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "utils.h"
+#include "pool.h"
+
+// arp等待队列的测试：向还没有解析的ip发送一个最大的IP数据报的全部分片
+// （65535字节按1500字节分片，44个满分片加一个415字节的最后分片），
+// 检查只发出一个ARP请求，收到响应后45个分片按顺序全部发送出去。
+// 再有三个目的ip同时等待时，前两个都能放下，第三个超过总字节数上限，多出的分片被丢弃。
+// 缓存的分片放在缓冲池中，发送之后全部还给缓冲池。
+//
+// 用一个内存中的驱动代替pcap，driver_send()记下发出的帧。
+// 编译：和实验框架src目录下除driver.c、main.c之外的源文件一起编译，例如
+//   gcc -std=gnu11 -O2 -I<实验框架的include目录> -I.. arp_pending_test.c <其他源文件> -o arp_pending_test
+
+#define FRAGMENTS 45
+#define LAST_LEN (65535 - 44 * 1480)
+#define MAX_SENT 256
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while(0)
+
+/**
+ * @brief 发出的帧：协议、长度和负载的第一个字节（分片编号）
+ *
+ */
+static struct {
+    uint16_t protocol;
+    size_t len;
+    uint8_t tag;
+    uint8_t dst[NET_MAC_LEN];
+} sent[MAX_SENT];
+static int sent_count;
+
+int driver_open()
+{
+    return 0;
+}
+
+int driver_recv(buf_t *buf)
+{
+    return 0;
+}
+
+int driver_send(buf_t *buf)
+{
+    CHECK(sent_count < MAX_SENT);
+    ether_hdr_t *eth = (ether_hdr_t *)buf->data;
+    sent[sent_count].protocol = swap16(eth->protocol16);
+    sent[sent_count].len = buf->len - sizeof(ether_hdr_t);
+    sent[sent_count].tag = buf->data[sizeof(ether_hdr_t)];
+    memcpy(sent[sent_count].dst, eth->dst, NET_MAC_LEN);
+    sent_count++;
+    return buf->len;
+}
+
+void driver_close()
+{
+}
+
+static int count(uint16_t protocol)
+{
+    int n = 0;
+    for(int i = 0; i < sent_count; i++)
+        n += sent[i].protocol == protocol;
+    return n;
+}
+
+/**
+ * @brief 对端发来的ARP响应
+ *
+ */
+static void learn(uint8_t *ip, uint8_t *mac)
+{
+    static buf_t buf;
+    buf_init(&buf, sizeof(arp_pkt_t));
+    arp_pkt_t *pkt = (arp_pkt_t *)buf.data;
+    memset(pkt, 0, sizeof(arp_pkt_t));
+    pkt->hw_type16 = swap16(ARP_HW_ETHER);
+    pkt->pro_type16 = swap16(NET_PROTOCOL_IP);
+    pkt->hw_len = NET_MAC_LEN;
+    pkt->pro_len = NET_IP_LEN;
+    pkt->opcode16 = swap16(ARP_REPLY);
+    memcpy(pkt->sender_ip, ip, NET_IP_LEN);
+    memcpy(pkt->sender_mac, mac, NET_MAC_LEN);
+    memcpy(pkt->target_ip, net_if_ip, NET_IP_LEN);
+    memcpy(pkt->target_mac, net_if_mac, NET_MAC_LEN);
+    arp_in(&buf, mac);
+}
+
+/**
+ * @brief 把一个最大的IP数据报的全部分片交给arp_out()，每个分片的第一个字节是它的编号。
+ *        和ip_out()一样都用txbuf
+ *
+ */
+static void send_datagram(uint8_t *ip)
+{
+    for(int i = 0; i < FRAGMENTS; i++) {
+        buf_init(&txbuf, i + 1 < FRAGMENTS ? ETHERNET_MAX_TRANSPORT_UNIT : LAST_LEN);
+        memset(txbuf.data, i, txbuf.len);
+        arp_out(&txbuf, ip);
+    }
+}
+
+/**
+ * @brief 检查sent中从first开始是发往mac的完整数据报
+ *
+ */
+static void check_datagram(int first, uint8_t *mac)
+{
+    for(int i = 0; i < FRAGMENTS; i++) {
+        CHECK(sent[first + i].protocol == NET_PROTOCOL_IP && sent[first + i].tag == i);
+        CHECK(sent[first + i].len == (i + 1 < FRAGMENTS ? ETHERNET_MAX_TRANSPORT_UNIT : LAST_LEN));
+        CHECK(memcmp(sent[first + i].dst, mac, NET_MAC_LEN) == 0);
+    }
+}
+
+int main()
+{
+    uint8_t ip[4][NET_IP_LEN] = {{10, 0, 0, 1}, {10, 0, 0, 2}, {10, 0, 0, 3}, {10, 0, 0, 4}};
+    uint8_t mac[4][NET_MAC_LEN] = {{2, 0, 0, 0, 0, 1}, {2, 0, 0, 0, 0, 2}, {2, 0, 0, 0, 0, 3}, {2, 0, 0, 0, 0, 4}};
+    driver_open();
+    ethernet_init();
+    arp_init();
+    ethernet_flush();
+    sent_count = 0;
+    size_t pool_free = buf_pool_available();
+
+    // 一个目的ip：整个数据报都缓存下来，只发一个ARP请求
+    send_datagram(ip[0]);
+    ethernet_flush();
+    CHECK(sent_count == 1 && count(NET_PROTOCOL_ARP) == 1);
+    sent_count = 0;
+    learn(ip[0], mac[0]);
+    ethernet_flush();
+    CHECK(sent_count == FRAGMENTS);
+    check_datagram(0, mac[0]);
+    printf("one destination: %d fragments flushed in order\n", FRAGMENTS);
+
+    // 再有三个目的ip同时等待：前两个都能放下，第三个超过总字节数上限
+    sent_count = 0;
+    for(int d = 1; d < 4; d++)
+        send_datagram(ip[d]);
+    ethernet_flush();
+    CHECK(count(NET_PROTOCOL_ARP) == 3 && count(NET_PROTOCOL_IP) == 0);
+    sent_count = 0;
+    for(int d = 1; d < 4; d++)
+        learn(ip[d], mac[d]);
+    ethernet_flush();
+    CHECK(sent_count > 2 * FRAGMENTS && sent_count < 3 * FRAGMENTS);
+    check_datagram(0, mac[1]);
+    check_datagram(FRAGMENTS, mac[2]);
+    printf("three destinations: %d + %d + %d fragments flushed\n", FRAGMENTS, FRAGMENTS, sent_count - 2 * FRAGMENTS);
+    arp_buf_print();
+    CHECK(buf_pool_available() == pool_free);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,242 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ring.h"
+
+// ring.h的压力测试和吞吐量对比：
+// 多个线程同时入队、出队，检查每个元素恰好出队一次、同一个生产者的元素按顺序出队，
+// 并和一个用互斥锁保护的同样大小的队列比较吞吐量。
+//
+// 队列满或空时让出CPU而不是忙等，在CPU核数比线程少的机器上也能跑完。
+//
+// 编译：gcc -std=gnu11 -O2 -pthread -I.. ring_test.c -o ring_test
+// 用法：ring_test [每个生产者入队的元素个数，默认2000000] [MPMC的生产者、消费者线程数，默认2]
+
+#define RING_SIZE 1024
+#define BURST 32
+#define MAX_THREADS 16
+
+/**
+ * @brief 元素编码为 (生产者编号 << 40) | 序号，序号从1开始，不会是NULL
+ * 
+ */
+#define ITEM(producer, seq) ((void *)(((uintptr_t)(producer) << 40) | (seq)))
+#define ITEM_PRODUCER(item) ((uintptr_t)(item) >> 40)
+#define ITEM_SEQ(item) ((uintptr_t)(item) & (((uintptr_t)1 << 40) - 1))
+
+/**
+ * @brief 用互斥锁保护的队列，作为对比的基准
+ * 
+ */
+typedef struct mutex_queue {
+    pthread_mutex_t lock;
+    size_t head, tail, mask;
+    void **slot;
+} mutex_queue_t;
+
+static void mutex_queue_init(mutex_queue_t *q, void **slot, size_t size)
+{
+    pthread_mutex_init(&q->lock, NULL);
+    q->head = q->tail = 0;
+    q->mask = size - 1;
+    q->slot = slot;
+}
+
+static size_t mutex_queue_enqueue_burst(mutex_queue_t *q, void *const *obj, size_t n)
+{
+    pthread_mutex_lock(&q->lock);
+    size_t space = q->mask + 1 - (q->tail - q->head);
+    if(n > space) n = space;
+    for(size_t i = 0; i < n; i++)
+        q->slot[(q->tail + i) & q->mask] = obj[i];
+    q->tail += n;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+static size_t mutex_queue_dequeue_burst(mutex_queue_t *q, void **obj, size_t n)
+{
+    pthread_mutex_lock(&q->lock);
+    size_t avail = q->tail - q->head;
+    if(n > avail) n = avail;
+    for(size_t i = 0; i < n; i++)
+        obj[i] = q->slot[(q->head + i) & q->mask];
+    q->head += n;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+/**
+ * @brief 三种队列统一的接口
+ * 
+ */
+typedef enum queue_kind {
+    QUEUE_SPSC,
+    QUEUE_MPMC,
+    QUEUE_MUTEX,
+} queue_kind_t;
+
+static const char *queue_name[] = {"spsc", "mpmc", "mutex"};
+
+typedef struct queue {
+    queue_kind_t kind;
+    spsc_ring_t spsc;
+    mpmc_ring_t mpmc;
+    mutex_queue_t mutex;
+    void *slot[RING_SIZE];
+} queue_t;
+
+static size_t queue_enqueue_burst(queue_t *q, void *const *obj, size_t n)
+{
+    switch(q->kind) {
+        case QUEUE_SPSC: return spsc_ring_enqueue_burst(&q->spsc, obj, n);
+        case QUEUE_MPMC: return mpmc_ring_enqueue_burst(&q->mpmc, obj, n);
+        default: return mutex_queue_enqueue_burst(&q->mutex, obj, n);
+    }
+}
+
+static size_t queue_dequeue_burst(queue_t *q, void **obj, size_t n)
+{
+    switch(q->kind) {
+        case QUEUE_SPSC: return spsc_ring_dequeue_burst(&q->spsc, obj, n);
+        case QUEUE_MPMC: return mpmc_ring_dequeue_burst(&q->mpmc, obj, n);
+        default: return mutex_queue_dequeue_burst(&q->mutex, obj, n);
+    }
+}
+
+/**
+ * @brief 一次测试的参数和结果
+ * 
+ */
+typedef struct run {
+    queue_t *queue;
+    size_t per_producer;
+    int producers, consumers;
+    size_t burst;
+    _Atomic size_t received;
+    _Atomic int errors;
+    uint64_t sum[MAX_THREADS];      // 每个消费者收到的序号之和
+} run_t;
+
+typedef struct worker {
+    run_t *run;
+    int id;
+} worker_t;
+
+static void *producer_main(void *arg)
+{
+    worker_t *w = arg;
+    run_t *run = w->run;
+    void *obj[BURST];
+    size_t seq = 1;
+    while(seq <= run->per_producer) {
+        size_t n = 0;
+        while(n < run->burst && seq + n <= run->per_producer) {
+            obj[n] = ITEM(w->id, seq + n);
+            n++;
+        }
+        size_t done = 0;
+        while(done < n) {
+            size_t m = queue_enqueue_burst(run->queue, obj + done, n - done);
+            if(m == 0) sched_yield();
+            done += m;
+        }
+        seq += n;
+    }
+    return NULL;
+}
+
+static void *consumer_main(void *arg)
+{
+    worker_t *w = arg;
+    run_t *run = w->run;
+    size_t total = run->per_producer * run->producers;
+    size_t last[MAX_THREADS] = {0};
+    void *obj[BURST];
+    uint64_t sum = 0;
+    while(atomic_load(&run->received) < total) {
+        size_t n = queue_dequeue_burst(run->queue, obj, run->burst);
+        if(n == 0) {
+            sched_yield();
+            continue;
+        }
+        for(size_t i = 0; i < n; i++) {
+            size_t p = ITEM_PRODUCER(obj[i]), seq = ITEM_SEQ(obj[i]);
+            // 同一个生产者的元素在队列中按顺序排列，每个消费者看到的序号必须递增
+            if(p >= (size_t)run->producers || seq <= last[p] || seq > run->per_producer)
+                atomic_fetch_add(&run->errors, 1);
+            else
+                last[p] = seq;
+            sum += seq;
+        }
+        atomic_fetch_add(&run->received, n);
+    }
+    run->sum[w->id] = sum;
+    return NULL;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 运行一次测试，检查结果并打印吞吐量
+ * 
+ * @return int 通过为0
+ */
+static int run_one(queue_kind_t kind, int producers, int consumers, size_t per_producer, size_t burst)
+{
+    static queue_t queue;
+    queue.kind = kind;
+    spsc_ring_init(&queue.spsc, queue.slot, RING_SIZE);
+    mpmc_ring_init(&queue.mpmc, queue.slot, RING_SIZE);
+    mutex_queue_init(&queue.mutex, queue.slot, RING_SIZE);
+
+    run_t run = {.queue = &queue, .per_producer = per_producer,
+        .producers = producers, .consumers = consumers, .burst = burst};
+    pthread_t tid[2 * MAX_THREADS];
+    worker_t worker[2 * MAX_THREADS];
+    double start = now_sec();
+    for(int i = 0; i < consumers; i++) {
+        worker[i] = (worker_t){&run, i};
+        pthread_create(&tid[i], NULL, consumer_main, &worker[i]);
+    }
+    for(int i = 0; i < producers; i++) {
+        worker[consumers + i] = (worker_t){&run, i};
+        pthread_create(&tid[consumers + i], NULL, producer_main, &worker[consumers + i]);
+    }
+    for(int i = 0; i < producers + consumers; i++)
+        pthread_join(tid[i], NULL);
+    double elapsed = now_sec() - start;
+
+    uint64_t sum = 0;
+    for(int i = 0; i < consumers; i++)
+        sum += run.sum[i];
+    uint64_t expect = (uint64_t)producers * per_producer * (per_producer + 1) / 2;
+    size_t total = per_producer * producers;
+    int ok = atomic_load(&run.errors) == 0 && atomic_load(&run.received) == total && sum == expect;
+    printf("%-5s %dP%dC burst %2zu: %6.1f Mops/s %s\n", queue_name[kind], producers, consumers, burst,
+        total / elapsed / 1e6, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 2;
+    if(threads < 1 || threads > MAX_THREADS) threads = 2;
+    int failed = 0;
+    for(size_t burst = 1; burst <= BURST; burst *= BURST) {
+        failed |= run_one(QUEUE_SPSC, 1, 1, n, burst);
+        failed |= run_one(QUEUE_MUTEX, 1, 1, n, burst);
+        failed |= run_one(QUEUE_MPMC, threads, threads, n / threads, burst);
+        failed |= run_one(QUEUE_MUTEX, threads, threads, n / threads, burst);
+    }
+    return failed;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../ethernet.c"
+
+// RSS流哈希的正确性检查和开销测试：
+// 直接包含ethernet.c以调用其中的静态函数。检查逐位计算的rss_hash()和查表计算的ethernet_flow_hash()
+// 都和RSS规范中IPv4的验证向量一致、TCP/UDP/ICMP和分片都只按地址对哈希（同一条流总在同一个队列）、
+// 大量随机流在各接收队列间分布均匀，最后测量每个数据帧计算流哈希的时间。
+//
+// 编译：和实验框架src目录下除ethernet.c、main.c之外的源文件一起编译，例如
+//   gcc -std=gnu11 -O2 -I<实验框架的include目录> -I.. rss_test.c <其他源文件> -lpcap -o rss_test
+// 用法：rss_test [测量开销时计算哈希的次数，默认10000000]
+
+#define FLOWS 100000
+
+/**
+ * @brief RSS规范中的IPv4验证向量：源地址、目的地址、源端口、目的端口，
+ *        以及包含端口和只有地址时的哈希值
+ * 
+ */
+static const struct {
+    uint8_t src_ip[NET_IP_LEN], dst_ip[NET_IP_LEN];
+    uint16_t src_port, dst_port;
+    uint32_t hash_tcp, hash_ip;
+} vectors[] = {
+    {{66, 9, 149, 187}, {161, 142, 100, 80}, 2794, 1766, 0x51ccc178, 0x323e8fc2},
+    {{199, 92, 111, 2}, {65, 69, 140, 83}, 14230, 4739, 0xc626b0ea, 0xd718262a},
+    {{24, 19, 198, 95}, {12, 22, 207, 184}, 12898, 38024, 0x5c2b394a, 0xd2d0a5de},
+    {{38, 27, 205, 30}, {209, 142, 163, 6}, 48228, 2217, 0xafc7327f, 0x82989176},
+    {{153, 39, 163, 191}, {202, 188, 127, 2}, 44251, 1303, 0x10e828a2, 0x5d1809c5},
+};
+
+/**
+ * @brief 构造一个带以太网头部的IPv4数据帧，只填流哈希用到的字段
+ * 
+ * @param frag_off 分片字段（标志和偏移），主机字节序
+ */
+static void build_frame(buf_t *buf, const uint8_t *src_ip, const uint8_t *dst_ip,
+    uint16_t src_port, uint16_t dst_port, uint8_t protocol, uint16_t frag_off)
+{
+    buf_init(buf, sizeof(ether_hdr_t) + 20 + 8);
+    memset(buf->data, 0, buf->len);
+    ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
+    hdr->protocol16 = swap16(NET_PROTOCOL_IP);
+    uint8_t *ip = buf->data + sizeof(ether_hdr_t);
+    ip[0] = 0x45;
+    ip[6] = frag_off >> 8;
+    ip[7] = frag_off;
+    ip[9] = protocol;
+    memcpy(ip + 12, src_ip, NET_IP_LEN);
+    memcpy(ip + 16, dst_ip, NET_IP_LEN);
+    uint8_t *l4 = ip + 20;
+    l4[0] = src_port >> 8;
+    l4[1] = src_port;
+    l4[2] = dst_port >> 8;
+    l4[3] = dst_port;
+}
+
+static int check_vectors()
+{
+    int failed = 0;
+    buf_t buf;
+    for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        const uint8_t *s = vectors[i].src_ip, *d = vectors[i].dst_ip;
+        uint16_t sp = vectors[i].src_port, dp = vectors[i].dst_port;
+        uint8_t input[12];
+        memcpy(input, s, NET_IP_LEN);
+        memcpy(input + 4, d, NET_IP_LEN);
+        input[8] = sp >> 8;
+        input[9] = sp;
+        input[10] = dp >> 8;
+        input[11] = dp;
+        if(rss_hash(input, 12) != vectors[i].hash_tcp || rss_hash(input, 8) != vectors[i].hash_ip) {
+            printf("vector %zu: rss_hash %08x %08x, expect %08x %08x\n", i, rss_hash(input, 12),
+                rss_hash(input, 8), vectors[i].hash_tcp, vectors[i].hash_ip);
+            failed++;
+        }
+
+        uint32_t hash[4];
+        build_frame(&buf, s, d, sp, dp, NET_PROTOCOL_TCP, 0);
+        hash[0] = ethernet_flow_hash(&buf);
+        build_frame(&buf, s, d, sp, dp, NET_PROTOCOL_UDP, 0);
+        hash[1] = ethernet_flow_hash(&buf);
+        build_frame(&buf, s, d, sp, dp, NET_PROTOCOL_ICMP, 0);
+        hash[2] = ethernet_flow_hash(&buf);
+        build_frame(&buf, s, d, sp, dp, NET_PROTOCOL_TCP, 0x2000);     // MF，第一个分片
+        hash[3] = ethernet_flow_hash(&buf);
+        if(hash[0] != vectors[i].hash_ip || hash[1] != vectors[i].hash_ip ||
+        hash[2] != vectors[i].hash_ip || hash[3] != vectors[i].hash_ip) {
+            printf("vector %zu: %08x %08x %08x %08x, expect %08x\n", i, hash[0], hash[1], hash[2], hash[3],
+                vectors[i].hash_ip);
+            failed++;
+        }
+    }
+    // ARP等非IP数据帧哈希为0
+    build_frame(&buf, vectors[0].src_ip, vectors[0].dst_ip, 1, 2, NET_PROTOCOL_TCP, 0);
+    ((ether_hdr_t *)buf.data)->protocol16 = swap16(NET_PROTOCOL_ARP);
+    if(ethernet_flow_hash(&buf) != 0) failed++;
+    return failed;
+}
+
+static uint32_t rand32()
+{
+    return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+/**
+ * @brief 大量随机客户端到同一服务器的TCP流经间接表分到各个队列，每个队列的流数和平均值相差不超过5%
+ * 
+ */
+static int check_spread()
+{
+    size_t count[ETHERNET_RX_QUEUES] = {0};
+    buf_t buf;
+    uint8_t client[NET_IP_LEN], server[NET_IP_LEN] = {192, 168, 163, 103};
+    for(size_t i = 0; i < FLOWS; i++) {
+        uint32_t a = rand32();
+        memcpy(client, &a, NET_IP_LEN);
+        build_frame(&buf, client, server, 1024 + rand() % 60000, 80, NET_PROTOCOL_TCP, 0);
+        count[rss_reta[ethernet_flow_hash(&buf) % ETHERNET_RETA_SIZE]]++;
+    }
+    int failed = 0;
+    size_t mean = FLOWS / ETHERNET_RX_QUEUES;
+    for(int q = 0; q < ETHERNET_RX_QUEUES; q++) {
+        printf("queue %d: %zu flows\n", q, count[q]);
+        if(count[q] < mean * 95 / 100 || count[q] > mean * 105 / 100) failed++;
+    }
+    return failed;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(size_t n)
+{
+    static buf_t frames[64];
+    for(size_t i = 0; i < 64; i++) {
+        uint8_t s[NET_IP_LEN], d[NET_IP_LEN];
+        uint32_t a = rand32(), b = rand32();
+        memcpy(s, &a, NET_IP_LEN);
+        memcpy(d, &b, NET_IP_LEN);
+        build_frame(&frames[i], s, d, rand(), rand(), i % 2 ? NET_PROTOCOL_TCP : NET_PROTOCOL_ICMP, 0);
+    }
+    volatile uint32_t sink = 0;
+    double start = now_sec();
+    for(size_t i = 0; i < n; i++)
+        sink += ethernet_flow_hash(&frames[i & 63]);
+    printf("flow hash: %.1f ns/frame\n", (now_sec() - start) / n * 1e9);
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    srand(1);
+    ethernet_init();
+    int failed = check_vectors() + check_spread();
+    bench(n);
+    printf("correctness: %s\n", failed ? "FAILED" : "ok");
+    return failed != 0;
+}
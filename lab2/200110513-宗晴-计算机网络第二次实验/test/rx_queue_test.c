@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../ethernet.c"
+
+// 接收队列的测试：直接包含ethernet.c以查看接收队列和丢弃计数。
+// 用一个内存中的驱动代替pcap，数据帧先排在驱动中，ethernet_poll()每次最多收取ETHERNET_RX_BURST个，
+// 最多处理ETHERNET_RX_BUDGET个，IP数据帧交给测试注册的处理函数，检查每条流的数据帧按顺序、内容完整地到达。
+//   （1）一次突发超过接收预算：没处理完的数据帧留在接收队列中，之后的轮询按顺序处理，不丢弃
+//   （2）一条流持续以超过处理能力的速率到达，同时有一条轻载的流在另一个队列：
+//        重载流的队列满，出现背压（某次轮询不从驱动收取）和丢弃；轻载流一帧不丢
+// 最后检查所有缓冲都还给了缓冲池。
+//
+// 编译：和实验框架src目录下除ethernet.c、driver.c、main.c之外的源文件一起编译，例如
+//   gcc -std=gnu11 -O2 -I<实验框架的include目录> -I.. rx_queue_test.c <其他源文件> -o rx_queue_test
+
+#define DRIVER_LEN 8192
+#define PAYLOAD_LEN 64
+#define FLOOD_POLLS 200
+#define FLOOD_RATE 24           // 每次轮询到达的重载流数据帧数，超过接收预算
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while(0)
+
+/**
+ * @brief 一条流：源ip和源端口，以及发出和收到的数据帧数
+ *
+ */
+typedef struct flow {
+    uint8_t ip[NET_IP_LEN];
+    uint16_t port;
+    uint32_t sent, received, last;
+} flow_t;
+
+static flow_t flows[2];
+
+/**
+ * @brief 排在驱动中的数据帧，只记下流和序号，driver_recv()时再构造
+ *
+ */
+static struct {
+    uint8_t flow;
+    uint32_t seq;
+} driver_fifo[DRIVER_LEN];
+static size_t driver_head, driver_tail;
+static size_t driver_calls;
+
+/**
+ * @brief 构造一个发往本机的UDP数据帧，负载是流号、序号和由它们生成的填充
+ *
+ */
+static void make_frame(buf_t *buf, int f, uint32_t seq)
+{
+    static const uint8_t peer_mac[NET_MAC_LEN] = {2, 0, 0, 0, 0, 1};
+    buf->len = sizeof(ether_hdr_t) + 20 + 8 + PAYLOAD_LEN;
+    memset(buf->data, 0, buf->len);
+    ether_hdr_t *eth = (ether_hdr_t *)buf->data;
+    memcpy(eth->dst, net_if_mac, NET_MAC_LEN);
+    memcpy(eth->src, peer_mac, NET_MAC_LEN);
+    eth->protocol16 = swap16(NET_PROTOCOL_IP);
+
+    uint8_t *ip = buf->data + sizeof(ether_hdr_t);
+    ip[0] = 0x45;
+    ip[2] = (20 + 8 + PAYLOAD_LEN) >> 8;
+    ip[3] = (20 + 8 + PAYLOAD_LEN) & 0xFF;
+    ip[8] = 64;
+    ip[9] = NET_PROTOCOL_UDP;
+    memcpy(ip + 12, flows[f].ip, NET_IP_LEN);
+    memcpy(ip + 16, net_if_ip, NET_IP_LEN);
+
+    uint8_t *udp = ip + 20;
+    udp[0] = flows[f].port >> 8;
+    udp[1] = flows[f].port & 0xFF;
+    udp[2] = 9000 >> 8;
+    udp[3] = 9000 & 0xFF;
+    udp[5] = 8 + PAYLOAD_LEN;
+
+    uint8_t *payload = udp + 8;
+    payload[0] = f;
+    memcpy(payload + 1, &seq, 4);
+    for(int i = 5; i < PAYLOAD_LEN; i++)
+        payload[i] = seq * 7 + i;
+}
+
+static void arrive(int f)
+{
+    CHECK(driver_tail - driver_head < DRIVER_LEN);
+    driver_fifo[driver_tail % DRIVER_LEN].flow = f;
+    driver_fifo[driver_tail % DRIVER_LEN].seq = flows[f].sent++;
+    driver_tail++;
+}
+
+int driver_open()
+{
+    return 0;
+}
+
+int driver_recv(buf_t *buf)
+{
+    driver_calls++;
+    if(driver_head == driver_tail) return 0;
+    make_frame(buf, driver_fifo[driver_head % DRIVER_LEN].flow, driver_fifo[driver_head % DRIVER_LEN].seq);
+    driver_head++;
+    return buf->len;
+}
+
+int driver_send(buf_t *buf)
+{
+    return buf->len;
+}
+
+void driver_close()
+{
+}
+
+/**
+ * @brief 收到的IP数据包：同一条流的序号只能增加，填充要和序号对得上
+ *
+ */
+static void deliver(buf_t *buf, uint8_t *src)
+{
+    CHECK(buf->len == 20 + 8 + PAYLOAD_LEN);
+    uint8_t *payload = buf->data + 20 + 8;
+    int f = payload[0];
+    uint32_t seq;
+    memcpy(&seq, payload + 1, 4);
+    CHECK(f < 2 && seq < flows[f].sent);
+    CHECK(flows[f].received == 0 || seq > flows[f].last);
+    for(int i = 5; i < PAYLOAD_LEN; i++)
+        CHECK(payload[i] == (uint8_t)(seq * 7 + i));
+    flows[f].received++;
+    flows[f].last = seq;
+}
+
+static int queue_of(int f)
+{
+    buf_t buf;
+    buf_init(&buf, ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+    make_frame(&buf, f, 0);
+    return rss_reta[ethernet_flow_hash(&buf) % ETHERNET_RETA_SIZE];
+}
+
+static size_t queued()
+{
+    size_t n = 0;
+    for(int q = 0; q < ETHERNET_RX_QUEUES; q++)
+        n += spsc_ring_count(&rx_queue[q]);
+    return n;
+}
+
+/**
+ * @brief 一直轮询，直到驱动和接收队列都空了
+ *
+ */
+static void settle()
+{
+    while(driver_head != driver_tail || queued() > 0)
+        ethernet_poll();
+}
+
+int main()
+{
+    driver_open();
+    ethernet_init();
+    arp_init();
+    net_add_protocol(NET_PROTOCOL_IP, deliver);
+    ethernet_flush();
+    size_t pool_free = buf_pool_available();
+
+    // 重载流固定，轻载流换源ip直到落在另一个队列
+    flows[0] = (flow_t){{10, 0, 1, 1}, 1000};
+    flows[1] = (flow_t){{10, 0, 2, 1}, 2000};
+    while(queue_of(1) == queue_of(0))
+        flows[1].ip[3]++;
+
+    // （1）突发：一次轮询只处理接收预算个，其余的留到之后的轮询
+    for(int i = 0; i < ETHERNET_RX_BURST; i++)
+        arrive(i % 2);
+    ethernet_poll();
+    CHECK(flows[0].received + flows[1].received == ETHERNET_RX_BUDGET);
+    CHECK(queued() == ETHERNET_RX_BURST - ETHERNET_RX_BUDGET);
+    settle();
+    CHECK(flows[0].received == flows[0].sent && flows[1].received == flows[1].sent && rx_queue_drops == 0);
+    printf("burst: %d frames over several polls, none dropped\n", ETHERNET_RX_BURST);
+
+    // （2）重载流每次轮询到达FLOOD_RATE个，轻载流1个
+    for(int f = 0; f < 2; f++)
+        flows[f].sent = flows[f].received = 0;
+    size_t paused = 0;
+    for(int poll = 0; poll < FLOOD_POLLS; poll++) {
+        arrive(1);
+        for(int i = 0; i < FLOOD_RATE; i++)
+            arrive(0);
+        size_t calls = driver_calls;
+        ethernet_poll();
+        paused += driver_calls == calls;
+    }
+    settle();
+    printf("flood: heavy %u sent, %u received, %zu dropped; light %u sent, %u received; %zu polls paused\n",
+        flows[0].sent, flows[0].received, rx_queue_drops, flows[1].sent, flows[1].received, paused);
+    CHECK(rx_queue_drops > 0 && paused > 0);
+    CHECK(flows[0].received + rx_queue_drops == flows[0].sent);
+    CHECK(flows[1].received == flows[1].sent);
+    CHECK(buf_pool_available() == pool_free);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+
+// 增量更新16位校验和（RFC 1624），定义在utils.c，checksum16在框架的utils.h中
+uint16_t checksum16_update(uint16_t checksum, uint16_t old_word, uint16_t new_word);
+uint16_t checksum16_update32(uint16_t checksum, uint32_t old_dword, uint32_t new_dword);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef FORWARD_H
+#define FORWARD_H
+
+#include "net.h"
+
+// 转发开关，定义在ip.c
+void ip_set_forwarding(int enable);
+// 转发出口的MTU，定义在ip.c
+void ip_set_forward_mtu(uint16_t mtu);
+// 转发时TTL减为0，回复icmp超时报文，定义在icmp.c，由ip.c的ip_forward调用
+void icmp_time_exceeded(buf_t *recv_buf, uint8_t *src_ip);
+// 转发时超过出口MTU且设置了DF，回复icmp“需要分片”报文，定义在icmp.c，由ip.c的ip_forward调用
+void icmp_frag_needed_out(buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu);
+
+#endif
@@ -1,6 +1,35 @@
 #include "net.h"
 #include "icmp.h"
 #include "ip.h"
+#include "pmtu.h"
+#include "forward.h"
+
+/**
+ * @brief 目的不可达报文中的“需要分片但设置了DF”代码
+ * 
+ */
+#define ICMP_CODE_FRAG_NEEDED 4
+
+/**
+ * @brief ip首部中的DF标志
+ * 
+ */
+#ifndef IP_DONT_FRAGMENT
+#define IP_DONT_FRAGMENT (1 << 14)
+#endif
+
+/**
+ * @brief 超时报文的类型和“传输中TTL为0”代码
+ * 
+ */
+#define ICMP_TYPE_TIME_EXCEEDED 11
+#define ICMP_CODE_TTL_EXCEEDED 0
+
+/**
+ * @brief 路由器不填下一跳MTU时（RFC 1191之前的实现）保守使用的路径MTU
+ * 
+ */
+#define ICMP_FRAG_NEEDED_DEFAULT_MTU 576
 
 /**
  * @brief 发送icmp响应
@@ -32,6 +61,43 @@ static void icmp_resp(buf_t *req_buf, uint8_t *src_ip)
     ip_out(buf, src_ip, NET_PROTOCOL_ICMP);
 }
 
+/**
+ * @brief 处理“需要分片”的目的不可达报文，更新路径MTU缓存
+ * 
+ * @param buf 收到的icmp报文
+ */
+static void icmp_frag_needed(buf_t *buf)
+{
+    // Step1 ：报文中需要带有原数据报的ip头部和前8个字节，并且校验和正确
+    if(buf->len < sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8) return;
+    if(checksum16((uint16_t *)buf->data, buf->len) != 0) return;
+
+    // Step2 ：原数据报必须是本机发出的：源地址是本机，目的地址是单播的其他主机
+    icmp_hdr_t *icmp_head = (icmp_hdr_t *)buf->data;
+    ip_hdr_t *orig_head = (ip_hdr_t *)(buf->data + sizeof(icmp_hdr_t));
+    size_t orig_hdr_len = orig_head->hdr_len * 4;
+    if(orig_head->version != IP_VERSION_4 || orig_hdr_len < sizeof(ip_hdr_t) ||
+    buf->len < sizeof(icmp_hdr_t) + orig_hdr_len + 8) return;
+    if(memcmp(orig_head->src_ip, net_if_ip, NET_IP_LEN) != 0) return;
+    if(memcmp(orig_head->dst_ip, net_if_ip, NET_IP_LEN) == 0 || orig_head->dst_ip[0] == 0 ||
+    orig_head->dst_ip[0] >= 224) return;
+
+    // Step3 ：本机只给不分片的TCP报文段置DF，其他数据报路由器会直接分片，不会回复这种报文。
+    // 引用的端口和序号还必须属于一个存在的连接，防止伪造的报文把路径MTU压低
+    uint8_t *orig_tcp = (uint8_t *)orig_head + orig_hdr_len;
+    if(orig_head->protocol != NET_PROTOCOL_TCP || !(swap16(orig_head->flags_fragment16) & IP_DONT_FRAGMENT)) return;
+    uint16_t port[2];
+    uint32_t seq;
+    memcpy(port, orig_tcp, sizeof(port));
+    memcpy(&seq, orig_tcp + 4, sizeof(seq));
+    if(!tcp_pmtu_match(orig_head->dst_ip, swap16(port[0]), swap16(port[1]), swap32(seq))) return;
+
+    // Step4 ：下一跳MTU在首部的后16位（即seq16字段），低于下限的由ip_pmtu_update()抬高到IP_PMTU_MIN
+    uint16_t mtu = swap16(icmp_head->seq16);
+    if(mtu == 0) mtu = ICMP_FRAG_NEEDED_DEFAULT_MTU;
+    ip_pmtu_update(orig_head->dst_ip, mtu);
+}
+
 /**
  * @brief 处理一个收到的数据包
  * 
@@ -50,26 +116,31 @@ void icmp_in(buf_t *buf, uint8_t *src_ip)
         // Step3 ：如果是，则调用icmp_resp()函数回送一个回显应答（ping 应答）。
         icmp_resp(buf, src_ip);
     }
+    // Step4 ：如果是“需要分片”的目的不可达报文，则更新路径MTU。
+    else if(icmp_head->type == ICMP_TYPE_UNREACH && icmp_head->code == ICMP_CODE_FRAG_NEEDED) {
+        icmp_frag_needed(buf);
+    }
 }
 
 /**
- * @brief 发送icmp不可达
+ * @brief 发送icmp差错报文，数据部分是原数据报的ip首部和前8个字节
  * 
  * @param recv_buf 收到的ip数据包
  * @param src_ip 源ip地址
- * @param code icmp code，协议不可达或端口不可达
+ * @param type icmp类型
+ * @param code icmp code
+ * @param mtu “需要分片”报文中的下一跳MTU，其他报文为0
  */
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+static void icmp_error(buf_t *recv_buf, uint8_t *src_ip, uint8_t type, uint8_t code, uint16_t mtu)
 {
-    // TO-DO
     // Step1 ：首先调用buf_init()来初始化txbuf，填写ICMP报头首部。
     buf_t *buf = &txbuf;
     buf_init(buf, sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8);
     icmp_hdr_t *icmp_head = (icmp_hdr_t *)buf->data;
-    icmp_head->type = ICMP_TYPE_UNREACH;
+    icmp_head->type = type;
     icmp_head->code = code;
     icmp_head->id16 = 0;
-    icmp_head->seq16 = 0;
+    icmp_head->seq16 = swap16(mtu);
     icmp_head->checksum16 = 0;
 
     // Step2 ：接着，填写ICMP数据部分，
@@ -79,7 +150,41 @@ void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
 
     // Step3 ：调用ip_out()函数将数据报发送出去。
     ip_out(buf, src_ip, NET_PROTOCOL_ICMP);
-    return;
+}
+
+/**
+ * @brief 发送icmp不可达
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param code icmp code，协议不可达或端口不可达
+ */
+void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_UNREACH, code, 0);
+}
+
+/**
+ * @brief 发送icmp超时（转发时TTL减为0）
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ */
+void icmp_time_exceeded(buf_t *recv_buf, uint8_t *src_ip)
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0);
+}
+
+/**
+ * @brief 发送icmp“需要分片”（转发时超过出口MTU且设置了DF），按RFC 1191带上下一跳MTU
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param mtu 出口MTU
+ */
+void icmp_frag_needed_out(buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu)
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_UNREACH, ICMP_CODE_FRAG_NEEDED, mtu);
 }
 
 /**
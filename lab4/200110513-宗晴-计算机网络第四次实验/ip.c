@@ -3,6 +3,520 @@
 #include "ethernet.h"
 #include "arp.h"
 #include "icmp.h"
+#include "route.h"
+#include "forward.h"
+#include "pmtu.h"
+#include "checksum.h"
+
+#ifndef IP_MORE_FRAGMENT
+#define IP_MORE_FRAGMENT (1 << 13)
+#endif
+#ifndef IP_DONT_FRAGMENT
+#define IP_DONT_FRAGMENT (1 << 14)
+#endif
+#ifndef IP_FRAGMENT_OFFSET_MASK
+#define IP_FRAGMENT_OFFSET_MASK 0x1FFF
+#endif
+
+/**
+ * @brief 路径MTU缓存表项的老化时间，超时后回到接口MTU重新探测（RFC 1191建议10分钟）
+ * 
+ */
+#ifndef IP_PMTU_TIMEOUT_SEC
+#define IP_PMTU_TIMEOUT_SEC (60 * 10)
+#endif
+
+/**
+ * @brief 路径MTU的下限。RFC 791只要求68字节，但实际链路的MTU都不小于576，
+ *        更小的值多半来自伪造的“需要分片”报文，目的是让TCP连接只发很小的报文段；和Linux的min_pmtu一样取552
+ * 
+ */
+#ifndef IP_PMTU_MIN
+#define IP_PMTU_MIN 552
+#endif
+
+/**
+ * @brief 是否默认打开转发（作为软件路由器使用），可以用ip_set_forwarding()修改
+ * 
+ */
+#ifndef IP_FORWARDING
+#define IP_FORWARDING 0
+#endif
+
+/**
+ * @brief 转发出口（下一跳所在链路）的MTU，默认和入口一样是以太网，可以用ip_set_forward_mtu()修改
+ * 
+ */
+#ifndef IP_FORWARD_MTU
+#define IP_FORWARD_MTU ETHERNET_MAX_TRANSPORT_UNIT
+#endif
+
+/**
+ * @brief RFC 791要求每条链路都能传送的最小数据报长度
+ * 
+ */
+#define IP_MIN_MTU 68
+
+/**
+ * @brief 同时进行重组的数据包个数上限
+ * 
+ */
+#ifndef IP_REASM_MAX_DATAGRAMS
+#define IP_REASM_MAX_DATAGRAMS 8
+#endif
+
+/**
+ * @brief 所有重组中的数据包占用的字节数上限，超过时按LRU淘汰
+ * 
+ */
+#ifndef IP_REASM_MAX_BYTES
+#define IP_REASM_MAX_BYTES (256 * 1024)
+#endif
+
+/**
+ * @brief 从收到第一个分片开始计算的重组超时时间
+ * 
+ */
+#ifndef IP_REASM_TIMEOUT_SEC
+#define IP_REASM_TIMEOUT_SEC 30
+#endif
+
+/**
+ * @brief 一个数据包最多记录的空洞数，超过时放弃该数据包
+ * 
+ */
+#ifndef IP_REASM_MAX_HOLES
+#define IP_REASM_MAX_HOLES 16
+#endif
+
+/**
+ * @brief 空洞的last初始值，表示还不知道数据包的总长度
+ * 
+ */
+#define IP_REASM_INFINITY UINT32_MAX
+
+/**
+ * @brief 重组表的key，(src, dst, id, protocol)唯一确定一个数据包
+ * 
+ */
+typedef struct ip_reasm_key {
+    uint8_t src_ip[NET_IP_LEN];
+    uint8_t dst_ip[NET_IP_LEN];
+    uint16_t id16;
+    uint8_t protocol;
+    uint8_t reserved;
+} ip_reasm_key_t;
+
+/**
+ * @brief 空洞描述符（RFC 815），[first, last]是数据部分中还没有收到的字节
+ * 
+ */
+typedef struct ip_reasm_hole {
+    uint32_t first;
+    uint32_t last;
+} ip_reasm_hole_t;
+
+/**
+ * @brief 一个正在重组的数据包，分片数据直接写到buf中对应的位置
+ * 
+ */
+typedef struct ip_reasm {
+    int used;
+    ip_reasm_key_t key;
+    uint32_t lru;                              // 最近一次收到分片时的时钟
+    size_t bytes;                              // 已收到的分片末尾的最大值，即占用的字节数
+    size_t total_len;                          // 数据部分总长度，收到最后一个分片之前为0
+    int hole_count;
+    ip_reasm_hole_t holes[IP_REASM_MAX_HOLES];
+    ip_hdr_t hdr;                              // 偏移为0的分片的首部
+    buf_t buf;
+} ip_reasm_t;
+
+/**
+ * @brief 重组用的缓冲区
+ * 
+ */
+static ip_reasm_t reasm_slots[IP_REASM_MAX_DATAGRAMS];
+
+/**
+ * @brief 重组表，<ip_reasm_key_t, 缓冲区下标>的容器，
+ *        利用map_t的时间戳判断重组是否超时
+ * 
+ */
+static map_t reasm_table;
+
+/**
+ * @brief 每收到一个分片加一，用于LRU淘汰
+ * 
+ */
+static uint32_t reasm_clock;
+
+/**
+ * @brief 路径MTU缓存，<目的ip, uint16_t mtu>的容器，由ICMP“需要分片”报文更新
+ * 
+ */
+static map_t pmtu_table;
+
+/**
+ * @brief 查询到目的ip的路径MTU
+ * 
+ * @param ip 目的ip地址
+ * @return uint16_t 路径MTU，没有缓存时为接口MTU
+ */
+uint16_t ip_pmtu_get(uint8_t *ip)
+{
+    uint16_t *mtu = map_get(&pmtu_table, ip);
+    return mtu ? *mtu : ETHERNET_MAX_TRANSPORT_UNIT;
+}
+
+/**
+ * @brief 根据ICMP“需要分片”报文更新到目的ip的路径MTU，只会变小
+ * 
+ * @param ip 目的ip地址
+ * @param mtu 下一跳MTU
+ */
+void ip_pmtu_update(uint8_t *ip, uint16_t mtu)
+{
+    if(mtu < IP_PMTU_MIN) mtu = IP_PMTU_MIN;
+    if(mtu >= ip_pmtu_get(ip)) return;
+    map_set(&pmtu_table, ip, &mtu);
+}
+
+/**
+ * @brief 是否转发目的地址不是本机的数据包
+ * 
+ */
+static int ip_forwarding = IP_FORWARDING;
+
+/**
+ * @brief 打开或关闭转发
+ * 
+ * @param enable 非0为打开
+ */
+void ip_set_forwarding(int enable)
+{
+    ip_forwarding = enable;
+}
+
+/**
+ * @brief 转发出口的MTU
+ * 
+ */
+static uint16_t ip_forward_mtu = IP_FORWARD_MTU;
+
+/**
+ * @brief 设置转发出口的MTU，不小于IP_MIN_MTU
+ * 
+ * @param mtu 出口链路的MTU
+ */
+void ip_set_forward_mtu(uint16_t mtu)
+{
+    ip_forward_mtu = mtu < IP_MIN_MTU ? IP_MIN_MTU : mtu;
+}
+
+/**
+ * @brief 重组统计
+ * 
+ */
+static struct {
+    size_t completed;   // 重组完成的数据包数
+    size_t expired;     // 超时丢弃的数据包数
+    size_t overlapped;  // 因分片重叠而丢弃的数据包数
+    size_t evicted;     // 因内存上限被淘汰的数据包数
+} reasm_stats;
+
+/**
+ * @brief 打印重组统计
+ * 
+ */
+void ip_reasm_print()
+{
+    printf("===IP REASSEMBLY===\n");
+    printf("completed: %zu | expired: %zu | overlapped: %zu | evicted: %zu\n",
+    reasm_stats.completed, reasm_stats.expired, reasm_stats.overlapped, reasm_stats.evicted);
+}
+
+/**
+ * @brief 释放一个重组缓冲区
+ * 
+ * @param slot 要释放的缓冲区
+ */
+static void ip_reasm_free(ip_reasm_t *slot)
+{
+    map_delete(&reasm_table, &slot->key);
+    slot->used = 0;
+}
+
+/**
+ * @brief 清理超时的数据包：map_t中的表项超时后map_get()返回NULL
+ * 
+ */
+static void ip_reasm_expire()
+{
+    for(int i = 0; i < IP_REASM_MAX_DATAGRAMS; i++) {
+        ip_reasm_t *slot = &reasm_slots[i];
+        if(slot->used && map_get(&reasm_table, &slot->key) == NULL) {
+            slot->used = 0;
+            reasm_stats.expired++;
+        }
+    }
+}
+
+/**
+ * @brief 统计所有重组中的数据包占用的字节数
+ * 
+ * @return size_t 字节数
+ */
+static size_t ip_reasm_bytes()
+{
+    size_t bytes = 0;
+    for(int i = 0; i < IP_REASM_MAX_DATAGRAMS; i++)
+        if(reasm_slots[i].used) bytes += reasm_slots[i].bytes;
+    return bytes;
+}
+
+/**
+ * @brief 找到最久没有收到分片的数据包
+ * 
+ * @param except 不参与淘汰的缓冲区，可以为NULL
+ * @return ip_reasm_t* 没有可淘汰的返回NULL
+ */
+static ip_reasm_t *ip_reasm_lru(ip_reasm_t *except)
+{
+    ip_reasm_t *victim = NULL;
+    for(int i = 0; i < IP_REASM_MAX_DATAGRAMS; i++) {
+        ip_reasm_t *slot = &reasm_slots[i];
+        if(!slot->used || slot == except) continue;
+        if(victim == NULL || (int32_t)(slot->lru - victim->lru) < 0) victim = slot;
+    }
+    return victim;
+}
+
+/**
+ * @brief 找到key对应的重组缓冲区，没有则分配一个新的，缓冲区用完时淘汰最久没有使用的
+ * 
+ * @param key 数据包的key
+ * @return ip_reasm_t* 重组缓冲区
+ */
+static ip_reasm_t *ip_reasm_get(ip_reasm_key_t *key)
+{
+    int *index = map_get(&reasm_table, key);
+    if(index) return &reasm_slots[*index];
+
+    int free_index = -1;
+    for(int i = 0; i < IP_REASM_MAX_DATAGRAMS && free_index < 0; i++)
+        if(!reasm_slots[i].used) free_index = i;
+    if(free_index < 0) {
+        ip_reasm_t *victim = ip_reasm_lru(NULL);
+        ip_reasm_free(victim);
+        reasm_stats.evicted++;
+        free_index = victim - reasm_slots;
+    }
+
+    ip_reasm_t *slot = &reasm_slots[free_index];
+    slot->used = 1;
+    slot->key = *key;
+    slot->bytes = 0;
+    slot->total_len = 0;
+    slot->hole_count = 1;
+    slot->holes[0].first = 0;
+    slot->holes[0].last = IP_REASM_INFINITY;
+    buf_init(&slot->buf, 0);
+    map_set(&reasm_table, key, &free_index);
+    return slot;
+}
+
+/**
+ * @brief 处理一个收到的ip分片，把数据写到重组缓冲区中
+ * 
+ * @param buf 收到的分片，已去除填充，包含ip头部
+ * @return buf_t* 重组完成时返回完整的数据包（包含ip头部），否则返回NULL
+ */
+static buf_t *ip_reasm_in(buf_t *buf)
+{
+    ip_hdr_t *ip_head = (ip_hdr_t *)buf->data;
+    uint16_t flags_fragment = swap16(ip_head->flags_fragment16);
+    int mf = (flags_fragment & IP_MORE_FRAGMENT) != 0;
+    uint32_t first = (uint32_t)(flags_fragment & IP_FRAGMENT_OFFSET_MASK) * 8;
+    uint32_t len = buf->len - sizeof(ip_hdr_t);
+    uint32_t last = first + len - 1;
+
+    // Step1 ：长度检查，分片不能为空，不是最后一个分片时长度必须是8的倍数，
+    // 分片末尾不能超出数据包的最大长度（RFC 791，总长度字段只有16位）
+    if(len == 0 || (mf && len % 8 != 0)) return NULL;
+    if(last + 1 + sizeof(ip_hdr_t) > UINT16_MAX) return NULL;
+
+    ip_reasm_expire();
+
+    ip_reasm_key_t key;
+    memset(&key, 0, sizeof(key));
+    memcpy(key.src_ip, ip_head->src_ip, NET_IP_LEN);
+    memcpy(key.dst_ip, ip_head->dst_ip, NET_IP_LEN);
+    key.id16 = ip_head->id16;
+    key.protocol = ip_head->protocol;
+    ip_reasm_t *slot = ip_reasm_get(&key);
+    slot->lru = ++reasm_clock;
+
+    // 分片末尾也不能超出重组缓冲区中data之后的空间
+    if(last + 1 > (size_t)(slot->buf.payload + BUF_MAX_LEN - slot->buf.data)) goto drop;
+
+    // Step2 ：检查与已知的总长度是否矛盾
+    if((!mf && (slot->bytes > last + 1 || (slot->total_len && slot->total_len != last + 1))) ||
+    (mf && slot->total_len && last >= slot->total_len))
+        goto drop;
+
+    // Step3 ：分片必须完整地落在一个空洞里，否则就是重叠（包括重复）的分片，丢弃整个数据包
+    int h = 0;
+    while(h < slot->hole_count && !(slot->holes[h].first <= first && last <= slot->holes[h].last))
+        h++;
+    if(h == slot->hole_count) {
+        reasm_stats.overlapped++;
+        goto drop;
+    }
+
+    // Step4 ：更新空洞，去掉原来的空洞，在分片前后可能各留下一个新空洞
+    ip_reasm_hole_t hole = slot->holes[h];
+    slot->holes[h] = slot->holes[--slot->hole_count];
+    if(hole.first < first) {
+        if(slot->hole_count == IP_REASM_MAX_HOLES) goto drop;
+        slot->holes[slot->hole_count++] = (ip_reasm_hole_t){hole.first, first - 1};
+    }
+    if(last < hole.last && mf) {
+        if(slot->hole_count == IP_REASM_MAX_HOLES) goto drop;
+        slot->holes[slot->hole_count++] = (ip_reasm_hole_t){last + 1, hole.last};
+    }
+    if(!mf) {
+        slot->total_len = last + 1;
+        // 最后一个分片之后不会再有数据
+        for(int i = 0; i < slot->hole_count; i++)
+            if(slot->holes[i].last > last) slot->holes[i].last = last;
+    }
+
+    // Step5 ：检查内存上限，超过时淘汰其他最久没有使用的数据包
+    if(last + 1 > slot->bytes) {
+        size_t grow = last + 1 - slot->bytes;
+        while(ip_reasm_bytes() + grow > IP_REASM_MAX_BYTES) {
+            ip_reasm_t *victim = ip_reasm_lru(slot);
+            if(victim == NULL) goto drop;
+            ip_reasm_free(victim);
+            reasm_stats.evicted++;
+        }
+        slot->bytes = last + 1;
+    }
+
+    // Step6 ：把数据直接写到重组缓冲区中对应的位置
+    memcpy(slot->buf.data + first, buf->data + sizeof(ip_hdr_t), len);
+    if(first == 0) slot->hdr = *ip_head;
+    if(slot->hole_count > 0) return NULL;
+
+    // Step7 ：没有空洞了，重组完成，在数据前面加上第一个分片的ip头部，修改总长度和分片字段
+    slot->buf.len = slot->total_len;
+    buf_add_header(&slot->buf, sizeof(ip_hdr_t));
+    ip_hdr_t *hdr = (ip_hdr_t *)slot->buf.data;
+    *hdr = slot->hdr;
+    hdr->total_len16 = swap16((uint16_t)slot->buf.len);
+    hdr->flags_fragment16 = 0;
+    hdr->hdr_checksum16 = 0;
+    hdr->hdr_checksum16 = checksum16((uint16_t *)hdr, sizeof(ip_hdr_t));
+    ip_reasm_free(slot);
+    reasm_stats.completed++;
+    return &slot->buf;
+
+drop:
+    ip_reasm_free(slot);
+    return NULL;
+}
+
+/**
+ * @brief 把转发的数据包按出口MTU分片发给下一跳。和ip_out()一样不拷贝数据，
+ *        依次把buf的窗口移到每个分片上，首部写在分片数据前面。
+ *        每个分片的首部由原首部得到：TTL减一，偏移加上分片在原数据包中的位置，
+ *        除最后一个分片外置MF，最后一个分片保留原来的MF（原数据包本身可能就是分片）。
+ *        分片不带ip选项
+ * 
+ * @param buf 要转发的数据包，TTL还没有减一
+ * @param next_hop 下一跳ip地址
+ * @param mtu 出口MTU
+ */
+static void ip_forward_fragment(buf_t *buf, uint8_t *next_hop, uint16_t mtu)
+{
+    ip_hdr_t head = *(ip_hdr_t *)buf->data;
+    uint16_t flags_fragment = swap16(head.flags_fragment16);
+    uint16_t offset = flags_fragment & IP_FRAGMENT_OFFSET_MASK;
+    uint16_t flags = flags_fragment & ~(IP_MORE_FRAGMENT | IP_FRAGMENT_OFFSET_MASK);
+    int mf = (flags_fragment & IP_MORE_FRAGMENT) != 0;
+    head.hdr_len = sizeof(ip_hdr_t) / 4;
+    head.ttl--;
+
+    size_t hdr_len = ((ip_hdr_t *)buf->data)->hdr_len * 4;
+    if(hdr_len < sizeof(ip_hdr_t) || hdr_len >= buf->len) return;
+    buf_remove_header(buf, hdr_len);
+    uint8_t *data = buf->data;
+    size_t len = buf->len;
+    size_t max_data_len = (mtu - sizeof(ip_hdr_t)) / 8 * 8;
+    for(size_t done = 0; done < len; done += max_data_len) {
+        buf->data = data + done;
+        buf->len = len - done < max_data_len ? len - done : max_data_len;
+        int more = mf || done + buf->len < len;
+        buf_add_header(buf, sizeof(ip_hdr_t));
+        ip_hdr_t *ip_head = (ip_hdr_t *)buf->data;
+        *ip_head = head;
+        ip_head->total_len16 = swap16((uint16_t)buf->len);
+        ip_head->flags_fragment16 = swap16(flags | (more ? IP_MORE_FRAGMENT : 0) | (offset + done / 8));
+        ip_head->hdr_checksum16 = 0;
+        ip_head->hdr_checksum16 = checksum16((uint16_t *)ip_head, sizeof(ip_hdr_t));
+        arp_out(buf, next_hop);
+    }
+}
+
+/**
+ * @brief 转发一个目的地址不是本机的数据包，不修改负载，
+ *        只把TTL减一并增量更新首部校验和。超过出口MTU时分片，设置了DF时回送“需要分片”报文
+ * 
+ * @param buf 收到的数据包，首部已经检查过
+ */
+static void ip_forward(buf_t *buf)
+{
+    ip_hdr_t *ip_head = (ip_hdr_t *)buf->data;
+
+    // Step1 ：广播和组播不转发
+    if(ip_head->dst_ip[0] >= 224) return;
+
+    // Step2 ：去除以太网填充
+    uint16_t total_len16 = swap16(ip_head->total_len16);
+    if(buf->len > total_len16)
+        buf_remove_padding(buf, buf->len - total_len16);
+
+    // Step3 ：TTL用完时回送ICMP超时报文
+    if(ip_head->ttl <= 1) {
+        icmp_time_exceeded(buf, ip_head->src_ip);
+        return;
+    }
+
+    // Step4 ：查路由表得到下一跳，没有路由则丢弃
+    uint8_t next_hop[NET_IP_LEN];
+    if(route_lookup(ip_head->dst_ip, next_hop) != 0) return;
+
+    // Step5 ：超过出口MTU时，设置了DF的回送带有出口MTU的“需要分片”报文（引用的是TTL减一之前的首部），
+    // 否则分片转发
+    if(total_len16 > ip_forward_mtu) {
+        if(swap16(ip_head->flags_fragment16) & IP_DONT_FRAGMENT)
+            icmp_frag_needed_out(buf, ip_head->src_ip, ip_forward_mtu);
+        else
+            ip_forward_fragment(buf, next_hop, ip_forward_mtu);
+        return;
+    }
+
+    // Step6 ：TTL减一，TTL和协议号组成首部中的一个16位字，据此增量更新校验和
+    uint16_t old_word, new_word;
+    memcpy(&old_word, &ip_head->ttl, sizeof(uint16_t));
+    ip_head->ttl--;
+    memcpy(&new_word, &ip_head->ttl, sizeof(uint16_t));
+    ip_head->hdr_checksum16 = checksum16_update(ip_head->hdr_checksum16, old_word, new_word);
+
+    // Step7 ：发给下一跳
+    arp_out(buf, next_hop);
+}
 
 /**
  * @brief 处理一个收到的数据包
@@ -24,24 +538,30 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
     uint16_t total_len16 = swap16(ip_head->total_len16);
     if(total_len16 > buf->len) return;
 
-    // Step3 ：先把IP头部的头部校验和字段用其他变量保存起来，
-    // 接着将该头部校验和字段置0，然后调用checksum16函数来计算头部校验和，
-    // 如果与IP头部的首部校验和字段不一致，丢弃不处理，
-    // 如果一致，则再将该头部校验和字段恢复成原来的值。
-    uint16_t old_checksum16 = ip_head->hdr_checksum16;
-    ip_head->hdr_checksum16 = 0;
-    uint16_t new_checksum16 = checksum16((uint16_t *)ip_head, sizeof(ip_hdr_t));
-    if(new_checksum16 != old_checksum16) return;
-    ip_head->hdr_checksum16 = old_checksum16;
+    // Step3 ：连同首部校验和字段一起计算校验和，首部正确时结果为0，
+    // 不为0则丢弃不处理。这样不需要先把校验和字段置0再恢复。
+    if(checksum16((uint16_t *)ip_head, sizeof(ip_hdr_t)) != 0) return;
 
-    // Step4 ：对比目的IP地址是否为本机的IP地址，如果不是，则丢弃不处理。
-    if(memcmp(ip_head->dst_ip,net_if_ip,4) != 0) return;
+    // Step4 ：对比目的IP地址是否为本机的IP地址，如果不是，打开转发时转发出去，否则丢弃不处理。
+    if(memcmp(ip_head->dst_ip,net_if_ip,4) != 0) {
+        if(ip_forwarding) ip_forward(buf);
+        return;
+    }
 
     // Step5 ：如果接收到的数据包的长度大于IP头部的总长度字段，则说明该数据包有填充字段，
     // 可调用buf_remove_padding()函数去除填充字段。
     if(buf->len > total_len16)
         buf_remove_padding(buf, buf->len - total_len16);
 
+    // Step5.5 ：如果是分片（MF为1或偏移不为0），交给重组模块，
+    // 数据包还不完整时直接返回，完整时换成重组好的数据包继续处理。
+    uint16_t flags_fragment = swap16(ip_head->flags_fragment16);
+    if((flags_fragment & IP_MORE_FRAGMENT) || (flags_fragment & IP_FRAGMENT_OFFSET_MASK)) {
+        buf = ip_reasm_in(buf);
+        if(buf == NULL) return;
+        ip_head = (ip_hdr_t *)buf->data;
+    }
+
     // Step6 ：调用buf_remove_header()函数去掉IP报头。
     buf_remove_header(buf, sizeof(ip_hdr_t));
 
@@ -55,6 +575,14 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
     return;
 }
 
+/**
+ * @brief 上一个发送的分片的首部，同一个数据包的后续分片只有
+ *        total_len16和flags_fragment16不同，校验和可以增量更新
+ * 
+ */
+static ip_hdr_t last_fragment_hdr;
+static int last_fragment_valid = 0;
+
 /**
  * @brief 处理一个要发送的ip分片
  * 
@@ -78,24 +606,42 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     ip_head->tos = 0;
     ip_head->total_len16 = swap16((uint16_t)buf->len);
     ip_head->id16 = swap16((uint16_t)id);
-    ip_head->flags_fragment16 = swap16(((uint16_t)mf << 13) | offset);
+    // TCP按路径MTU决定报文段大小，不依赖IP分片，不分片时置DF以便进行路径MTU发现
+    uint16_t df = (protocol == NET_PROTOCOL_TCP && !mf && offset == 0) ? IP_DONT_FRAGMENT : 0;
+    ip_head->flags_fragment16 = swap16(df | ((uint16_t)mf << 13) | offset);
     ip_head->ttl = 64;
     ip_head->protocol = protocol;
     memcpy(ip_head->dst_ip, ip, NET_IP_LEN);
     memcpy(ip_head->src_ip, net_if_ip, NET_IP_LEN);
 
-    // Step3 ：先把IP头部的首部校验和字段填0，
-    // 再调用checksum16函数计算校验和，然后把计算出来的校验和填入首部校验和字段。
-    ip_head->hdr_checksum16 = 0;
-    ip_head->hdr_checksum16 = checksum16((uint16_t*)ip_head, sizeof(ip_hdr_t));
+    // Step3 ：如果和上一个分片属于同一个数据包，只需用checksum16_update()
+    // 根据total_len16和flags_fragment16的变化增量更新校验和；
+    // 否则先把IP头部的首部校验和字段填0，再调用checksum16函数计算校验和。
+    ip_hdr_t *last = &last_fragment_hdr;
+    if(last_fragment_valid && last->id16 == ip_head->id16 && last->protocol == ip_head->protocol &&
+    memcmp(last->dst_ip, ip_head->dst_ip, NET_IP_LEN) == 0) {
+        uint16_t checksum = checksum16_update(last->hdr_checksum16, last->total_len16, ip_head->total_len16);
+        ip_head->hdr_checksum16 = checksum16_update(checksum, last->flags_fragment16, ip_head->flags_fragment16);
+    } else {
+        ip_head->hdr_checksum16 = 0;
+        ip_head->hdr_checksum16 = checksum16((uint16_t*)ip_head, sizeof(ip_hdr_t));
+    }
+    *last = *ip_head;
+    last_fragment_valid = 1;
 
-    // Step4 ：调用arp_out函数()将封装后的IP头部和数据发送出去。
-    arp_out(buf, ip);
+    // Step4 ：查路由表得到下一跳，调用arp_out函数()将封装后的IP头部和数据发给下一跳。
+    // 没有路由时丢弃。
+    uint8_t next_hop[NET_IP_LEN];
+    if(route_lookup(ip, next_hop) != 0) return;
+    arp_out(buf, next_hop);
     return;
 }
 
 /**
  * @brief 处理一个要发送的ip数据包
+ *        分片时不拷贝数据：依次把buf的窗口移到每个分片上，ip头部直接写在分片数据前面，
+ *        覆盖的是前一个分片末尾已经交给下层（ethernet_out()会拷贝到发送队列）的数据，
+ *        因此发送后buf原来的内容会无效。
  * 
  * @param buf 要处理的包
  * @param ip 目标ip地址
@@ -106,10 +652,12 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
 {
     // TO-DO
     // Step1 ：首先检查从上层传递下来的数据报包长是否大于
-    // IP协议最大负载包长（1500字节（MTU） 减去IP首部长度）。
-    int max_data_len = (ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t)) / 8 * 8;
-    int offset_unit = max_data_len / 8;
-    if(buf->len > max_data_len){
+    // IP协议最大负载包长（到目的地址的路径MTU 减去IP首部长度）。
+    // 分片偏移以8字节为单位，除最后一个之外的分片长度要向下取到8的倍数，但放得下的数据报不必分片
+    size_t max_len = ip_pmtu_get(ip) - sizeof(ip_hdr_t);
+    size_t max_data_len = max_len / 8 * 8;
+    size_t offset_unit = max_data_len / 8;
+    if(buf->len > max_len){
         // Step2 ：如果超过IP协议最大负载包长，则需要分片发送。
         // 计算分片数量（向上取整）
         size_t n = (buf->len - 1) / max_data_len + 1;
@@ -117,20 +665,17 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
         size_t last_data_len = buf->len % max_data_len;
         if(last_data_len == 0) last_data_len = max_data_len;
 
-        buf_t ip_buf;
-        for(int i = 0; i < n - 1; i++){
-            // 首先调用buf_init()初始化一个ip_buf,将数据报包长截断
-            buf_init(&ip_buf, max_data_len);
-            memcpy(ip_buf.data, buf->data + i * max_data_len, max_data_len);
-            // 调用ip_fragment_out()函数发送出去
-            ip_fragment_out(&ip_buf, ip, protocol, id, i * offset_unit, 1);
+        uint8_t *data = buf->data;
+        for(size_t i = 0; i < n - 1; i++){
+            // 把buf的窗口移到第i个分片上，调用ip_fragment_out()函数发送出去
+            buf->data = data + i * max_data_len;
+            buf->len = max_data_len;
+            ip_fragment_out(buf, ip, protocol, id, i * offset_unit, 1);
         }
-        // 最后一个分片
-        // 调用buf_init()初始化一个ip_buf，大小等于该分片大小
-        buf_init(&ip_buf, last_data_len);
-        memcpy(ip_buf.data, buf->data + (n - 1) * max_data_len, last_data_len);
-        // 调用ip_fragment_out()函数发送出去，最后一个分片的MF = 0
-        ip_fragment_out(&ip_buf, ip, protocol, id, (n - 1) * offset_unit, 0);
+        // 最后一个分片，MF = 0
+        buf->data = data + (n - 1) * max_data_len;
+        buf->len = last_data_len;
+        ip_fragment_out(buf, ip, protocol, id, (n - 1) * offset_unit, 0);
     }
     
     // Step3 ：如果没有超过IP协议最大负载包长，则直接调用ip_fragment_out()函数发送出去。
@@ -148,5 +693,8 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
  */
 void ip_init()
 {
+    route_init();
+    map_init(&pmtu_table, NET_IP_LEN, sizeof(uint16_t), 0, IP_PMTU_TIMEOUT_SEC, NULL);
+    map_init(&reasm_table, sizeof(ip_reasm_key_t), sizeof(int), IP_REASM_MAX_DATAGRAMS, IP_REASM_TIMEOUT_SEC, NULL);
     net_add_protocol(NET_PROTOCOL_IP, ip_in);
 }
\ No newline at end of file
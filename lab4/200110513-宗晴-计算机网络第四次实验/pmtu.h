@@ -0,0 +1,14 @@
+#ifndef PMTU_H
+#define PMTU_H
+
+#include "net.h"
+
+// 路径MTU缓存，定义在ip.c，由icmp.c在收到“需要分片”报文时更新，ip_out和tcp按它决定分片和MSS
+uint16_t ip_pmtu_get(uint8_t *ip);
+void ip_pmtu_update(uint8_t *ip, uint16_t mtu);
+
+// 定义在tcp.c，icmp.c更新路径MTU之前用它确认“需要分片”报文引用的是本机一个连接发出的报文段：
+// 发往ip的remote_port、来自local_port的连接存在，并且seq在已发送未确认的范围内
+int tcp_pmtu_match(uint8_t *ip, uint16_t local_port, uint16_t remote_port, uint32_t seq);
+
+#endif
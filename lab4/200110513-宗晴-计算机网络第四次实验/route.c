@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "route.h"
+
+/**
+ * @brief 路由树的节点，路径压缩的二叉前缀树（Patricia树）
+ *        只有一个孩子且没有路由的中间节点不会出现
+ * 
+ */
+typedef struct route_node {
+    uint8_t prefix[NET_IP_LEN];     // 前缀，长度之外的位为0
+    uint8_t len;                    // 前缀长度
+    uint8_t has_route;              // 这个前缀上是否有路由
+    uint8_t next_hop[NET_IP_LEN];   // 下一跳，全0表示直接交付
+    struct route_node *child[2];
+} route_node_t;
+
+/**
+ * @brief 路由树的根
+ * 
+ */
+static route_node_t *route_root;
+
+/**
+ * @brief 路由条数
+ * 
+ */
+static size_t route_count;
+
+/**
+ * @brief 取ip的第i位（从最高位开始数）
+ * 
+ * @param ip ip地址
+ * @param i 位序号
+ * @return int 0或1
+ */
+static inline int route_bit(const uint8_t *ip, int i)
+{
+    return (ip[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/**
+ * @brief 把ip在len位之后的部分清零
+ * 
+ * @param dst 结果
+ * @param ip ip地址
+ * @param len 前缀长度
+ */
+static void route_mask(uint8_t *dst, const uint8_t *ip, int len)
+{
+    for(int i = 0; i < NET_IP_LEN; i++) {
+        int bits = len - i * 8;
+        if(bits >= 8) dst[i] = ip[i];
+        else if(bits <= 0) dst[i] = 0;
+        else dst[i] = ip[i] & (uint8_t)(0xFF << (8 - bits));
+    }
+}
+
+/**
+ * @brief 新建一个节点
+ * 
+ * @param prefix 前缀
+ * @param len 前缀长度
+ * @return route_node_t* 新节点，分配失败返回NULL
+ */
+static route_node_t *route_node_new(const uint8_t *prefix, int len)
+{
+    route_node_t *node = calloc(1, sizeof(route_node_t));
+    if(node == NULL) return NULL;
+    route_mask(node->prefix, prefix, len);
+    node->len = len;
+    return node;
+}
+
+/**
+ * @brief 设置节点上的路由
+ * 
+ * @param node 节点
+ * @param next_hop 下一跳，NULL表示直接交付
+ */
+static void route_node_set(route_node_t *node, const uint8_t *next_hop)
+{
+    if(!node->has_route) route_count++;
+    node->has_route = 1;
+    if(next_hop) memcpy(node->next_hop, next_hop, NET_IP_LEN);
+    else memset(node->next_hop, 0, NET_IP_LEN);
+}
+
+/**
+ * @brief 添加或修改一条路由
+ * 
+ * @param prefix 目的网络
+ * @param len 前缀长度
+ * @param next_hop 下一跳，NULL或全0表示目的网络直接相连
+ * @return int 成功为0，失败为-1
+ */
+int route_add(uint8_t *prefix, uint8_t len, uint8_t *next_hop)
+{
+    if(len > 32) return -1;
+    uint8_t key[NET_IP_LEN];
+    route_mask(key, prefix, len);
+
+    route_node_t **link = &route_root;
+    while(*link) {
+        route_node_t *node = *link;
+        int common = ip_prefix_match(node->prefix, key);
+        if(common > node->len) common = node->len;
+        if(common > len) common = len;
+
+        // node的前缀不是key的前缀，在公共前缀处分裂出一个中间节点。
+        // 需要的节点都分配成功之后再接入树中，否则分配失败时会留下没有路由的中间节点
+        if(common < node->len) {
+            route_node_t *mid = route_node_new(key, common);
+            if(mid == NULL) return -1;
+            route_node_t *leaf = mid;
+            if(common < len) {
+                leaf = route_node_new(key, len);
+                if(leaf == NULL) {
+                    free(mid);
+                    return -1;
+                }
+                mid->child[route_bit(key, common)] = leaf;
+            }
+            route_node_set(leaf, next_hop);
+            mid->child[route_bit(node->prefix, common)] = node;
+            *link = mid;
+            return 0;
+        }
+        if(node->len == len) {
+            route_node_set(node, next_hop);
+            return 0;
+        }
+        link = &node->child[route_bit(key, node->len)];
+    }
+
+    route_node_t *leaf = route_node_new(key, len);
+    if(leaf == NULL) return -1;
+    route_node_set(leaf, next_hop);
+    *link = leaf;
+    return 0;
+}
+
+/**
+ * @brief 删除一条路由，并合并删除后多余的节点
+ * 
+ * @param link 指向当前节点的指针
+ * @param key 目的网络
+ * @param len 前缀长度
+ * @return int 成功为0，没有这条路由为-1
+ */
+static int route_delete_at(route_node_t **link, const uint8_t *key, int len)
+{
+    route_node_t *node = *link;
+    if(node == NULL || node->len > len || ip_prefix_match(node->prefix, (uint8_t *)key) < node->len)
+        return -1;
+    if(node->len < len) {
+        if(route_delete_at(&node->child[route_bit(key, node->len)], key, len) != 0) return -1;
+    } else {
+        if(!node->has_route) return -1;
+        node->has_route = 0;
+        route_count--;
+    }
+    // 没有路由的节点最多只能有一个孩子时，用孩子代替它
+    if(!node->has_route && (node->child[0] == NULL || node->child[1] == NULL)) {
+        *link = node->child[0] ? node->child[0] : node->child[1];
+        free(node);
+    }
+    return 0;
+}
+
+/**
+ * @brief 删除一条路由
+ * 
+ * @param prefix 目的网络
+ * @param len 前缀长度
+ * @return int 成功为0，没有这条路由为-1
+ */
+int route_delete(uint8_t *prefix, uint8_t len)
+{
+    if(len > 32) return -1;
+    uint8_t key[NET_IP_LEN];
+    route_mask(key, prefix, len);
+    return route_delete_at(&route_root, key, len);
+}
+
+/**
+ * @brief 最长前缀匹配，找到发往dst_ip的数据包的下一跳
+ * 
+ * @param dst_ip 目的ip地址
+ * @param next_hop 下一跳，直接相连时就是dst_ip
+ * @return int 成功为0，没有路由为-1
+ */
+int route_lookup(uint8_t *dst_ip, uint8_t *next_hop)
+{
+    route_node_t *best = NULL;
+    route_node_t *node = route_root;
+    while(node && ip_prefix_match(node->prefix, dst_ip) >= node->len) {
+        if(node->has_route) best = node;
+        if(node->len == 32) break;
+        node = node->child[route_bit(dst_ip, node->len)];
+    }
+    if(best == NULL) return -1;
+
+    static const uint8_t on_link[NET_IP_LEN] = {0};
+    if(memcmp(best->next_hop, on_link, NET_IP_LEN) == 0) memcpy(next_hop, dst_ip, NET_IP_LEN);
+    else memcpy(next_hop, best->next_hop, NET_IP_LEN);
+    return 0;
+}
+
+/**
+ * @brief 设置默认网关，即0.0.0.0/0的下一跳
+ * 
+ * @param gateway 网关ip地址，NULL表示所有地址都直接交付
+ */
+void route_set_default(uint8_t *gateway)
+{
+    uint8_t any[NET_IP_LEN] = {0};
+    route_add(any, 0, gateway);
+}
+
+/**
+ * @brief 打印一个节点及其子树上的路由
+ * 
+ * @param node 节点
+ */
+static void route_print_node(route_node_t *node)
+{
+    if(node == NULL) return;
+    if(node->has_route) {
+        printf("%s/%d | ", iptos(node->prefix), node->len);
+        printf("%s\n", iptos(node->next_hop));
+    }
+    route_print_node(node->child[0]);
+    route_print_node(node->child[1]);
+}
+
+/**
+ * @brief 打印整个路由表
+ * 
+ */
+void route_print()
+{
+    printf("===ROUTE TABLE BEGIN=== (%zu)\n", route_count);
+    route_print_node(route_root);
+    printf("===ROUTE TABLE  END ===\n");
+}
+
+/**
+ * @brief 初始化路由表：本机所在子网直接交付，
+ *        没有配置网关（NET_IF_GATEWAY）时所有地址都按直接相连处理
+ * 
+ */
+void route_init()
+{
+    route_add(net_if_ip, NET_IF_PREFIX_LEN, NULL);
+#ifdef NET_IF_GATEWAY
+    uint8_t gateway[NET_IP_LEN] = NET_IF_GATEWAY;
+    route_set_default(gateway);
+#else
+    route_set_default(NULL);
+#endif
+}
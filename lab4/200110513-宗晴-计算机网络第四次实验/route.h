@@ -0,0 +1,18 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include "net.h"
+
+// 本机所在子网的前缀长度
+#ifndef NET_IF_PREFIX_LEN
+#define NET_IF_PREFIX_LEN 24
+#endif
+
+void route_init();
+int route_add(uint8_t *prefix, uint8_t len, uint8_t *next_hop);
+int route_delete(uint8_t *prefix, uint8_t len);
+int route_lookup(uint8_t *dst_ip, uint8_t *next_hop);
+void route_set_default(uint8_t *gateway);
+void route_print();
+
+#endif
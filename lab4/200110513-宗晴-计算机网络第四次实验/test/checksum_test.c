@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "utils.h"
+#include "checksum.h"
+
+// checksum16()的正确性测试和性能对比：
+// 和原来逐个16位字累加的实现比较，覆盖0到70000字节的所有长度（奇数长度检查最后一个字节）
+// 和0到31字节的所有起始偏移，再检查checksum16_update、checksum16_update32与重新计算的结果一致。
+// 最后按20B到64KB的报文长度比较两种实现的速度。
+//
+// 编译：gcc -std=gnu11 -O2 -I<实验框架的include目录> -I.. checksum_test.c ../utils.c -o checksum_test
+// 用法：checksum_test [性能测试时每种长度处理的总字节数，默认1GB]
+
+#define MAX_LEN 70000
+#define MAX_OFFSET 32
+
+/**
+ * @brief 原来的实现：逐个16位字累加，末尾的奇数字节作为高8位（网络字节序），最后折叠进位
+ * 
+ */
+static uint16_t checksum16_reference(uint16_t *data, size_t len)
+{
+    uint32_t checksum = 0;
+    size_t i;
+    for(i = 0; i + 1 < len; i += 2) {
+        uint16_t word;
+        memcpy(&word, (uint8_t *)data + i, sizeof(word));     // 测试不对齐的起始偏移
+        checksum += word;
+    }
+    if(len % 2)
+        checksum += ((uint8_t *)data)[len - 1];
+    while(checksum >> 16)
+        checksum = (checksum >> 16) + (checksum & 0xFFFF);
+    return ~checksum;
+}
+
+/**
+ * @brief 原来的实现用32位累加器，长度超过128KB时才可能溢出，测试的长度都在这以内
+ * 
+ */
+static int check_all()
+{
+    static uint8_t buf[MAX_LEN + MAX_OFFSET + 2];
+    for(size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = rand();
+    int failed = 0;
+    for(size_t offset = 0; offset < MAX_OFFSET; offset++) {
+        for(size_t len = 0; len <= MAX_LEN; len += len < 2048 ? 1 : 1 + rand() % 61) {
+            uint16_t *data = (uint16_t *)(buf + offset);
+            uint16_t expect = checksum16_reference(data, len);
+            uint16_t got = checksum16(data, len);
+            if(got != expect) {
+                if(failed++ < 10)
+                    printf("checksum16 len %zu offset %zu: got %04x expect %04x\n", len, offset, got, expect);
+            }
+        }
+    }
+    // 全0xFF的数据累加时进位最多
+    memset(buf, 0xFF, sizeof(buf));
+    for(size_t len = 0; len <= MAX_LEN; len += 997)
+        if(checksum16((uint16_t *)buf, len) != checksum16_reference((uint16_t *)buf, len))
+            failed++;
+    return failed;
+}
+
+/**
+ * @brief 随机修改一个16位字或32位字后，增量更新的校验和和重新计算的一致
+ * 
+ */
+static int check_update()
+{
+    static uint16_t words[750];
+    int failed = 0;
+    for(int round = 0; round < 100000; round++) {
+        size_t n = 1 + rand() % 750;
+        for(size_t i = 0; i < n; i++)
+            words[i] = rand();
+        uint16_t checksum = checksum16(words, n * 2);
+        size_t i = rand() % n;
+        if(round % 2 == 0 || i + 1 == n) {
+            uint16_t old_word = words[i];
+            words[i] = round % 7 == 0 ? 0 : rand();
+            checksum = checksum16_update(checksum, old_word, words[i]);
+        } else {
+            uint32_t old_dword, new_dword = rand();
+            memcpy(&old_dword, words + i, sizeof(old_dword));
+            memcpy(words + i, &new_dword, sizeof(new_dword));
+            checksum = checksum16_update32(checksum, old_dword, new_dword);
+        }
+        uint16_t expect = checksum16(words, n * 2);
+        // 0x0000和0xFFFF在反码中都表示0，增量更新和重新计算可能得到其中不同的一个
+        if(checksum != expect && !(checksum == 0xFFFF && expect == 0) && !(checksum == 0 && expect == 0xFFFF)) {
+            if(failed++ < 10)
+                printf("checksum16_update round %d: got %04x expect %04x\n", round, checksum, expect);
+        }
+    }
+    return failed;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(size_t total)
+{
+    static const size_t lens[] = {20, 64, 576, 1500, 9000, 65535};
+    static uint8_t buf[65536];
+    for(size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = rand();
+    printf("%8s %14s %14s %8s\n", "len", "old ns/call", "new ns/call", "speedup");
+    for(size_t k = 0; k < sizeof(lens) / sizeof(lens[0]); k++) {
+        size_t len = lens[k], calls = total / len;
+        volatile uint16_t sink = 0;
+        double start = now_sec();
+        for(size_t i = 0; i < calls; i++)
+            sink += checksum16_reference((uint16_t *)buf, len);
+        double old_ns = (now_sec() - start) / calls * 1e9;
+        start = now_sec();
+        for(size_t i = 0; i < calls; i++)
+            sink += checksum16((uint16_t *)buf, len);
+        double new_ns = (now_sec() - start) / calls * 1e9;
+        printf("%8zu %14.1f %14.1f %7.1fx\n", len, old_ns, new_ns, old_ns / new_ns);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t total = argc > 1 ? strtoul(argv[1], NULL, 10) : (size_t)1 << 30;
+    srand(1);
+    int failed = check_all() + check_update();
+    printf("correctness: %s\n", failed ? "FAILED" : "ok");
+    if(total)
+        bench(total);
+    return failed != 0;
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "utils.h"
+#include "forward.h"
+
+// 转发路径的正确性检查和吞吐量测试：
+// 用一个内存中的驱动代替pcap，driver_recv()不断返回同一个要转发的帧，
+// 经ethernet_poll()、ip_in()、ip_forward()、arp_out()后由driver_send()收下，
+// 检查转发出去的帧（目的mac、TTL、首部校验和、负载），并统计每秒转发的包数。
+// 关闭转发时的结果是同样的帧在ip_in()中被丢弃的速度，作为接收路径本身的开销。
+//
+// 编译：和实验框架src目录下除driver.c、main.c之外的源文件以及lab2中的协议实现一起编译，例如
+//   gcc -std=gnu11 -O2 -I<实验框架的include目录> -I.. forward_bench.c <其他源文件> -o forward_bench
+// 用法：forward_bench [每种帧长转发的包数，默认2000000]
+
+#define TTL 64
+
+static uint8_t peer_ip[NET_IP_LEN] = {192, 168, 163, 1};
+static uint8_t peer_mac[NET_MAC_LEN] = {0x02, 0, 0, 0, 0, 0x01};
+static uint8_t dst_ip[NET_IP_LEN] = {10, 0, 0, 2};
+static uint8_t dst_mac[NET_MAC_LEN] = {0x02, 0, 0, 0, 0, 0x02};
+
+/**
+ * @brief 驱动收到的帧和剩下的次数
+ * 
+ */
+static uint8_t bench_frame[ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t)];
+static uint16_t bench_frame_len;
+static size_t bench_remaining;
+
+/**
+ * @brief 驱动发出的帧数和检查出错的帧数
+ * 
+ */
+static size_t bench_sent;
+static size_t bench_bad;
+
+int driver_open()
+{
+    return 0;
+}
+
+int driver_recv(buf_t *buf)
+{
+    if(bench_remaining == 0) return 0;
+    bench_remaining--;
+    buf_init(buf, bench_frame_len);
+    memcpy(buf->data, bench_frame, bench_frame_len);
+    return bench_frame_len;
+}
+
+/**
+ * @brief 检查转发出去的帧：发给下一跳的mac，TTL减一，首部校验和正确，负载不变
+ * 
+ */
+int driver_send(buf_t *buf)
+{
+    bench_sent++;
+    ether_hdr_t *eth = (ether_hdr_t *)buf->data;
+    ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+    size_t ip_len = bench_frame_len - sizeof(ether_hdr_t);
+    if(buf->len < bench_frame_len || memcmp(eth->dst, dst_mac, NET_MAC_LEN) != 0 ||
+    memcmp(eth->src, net_if_mac, NET_MAC_LEN) != 0 || ip->ttl != TTL - 1 ||
+    checksum16((uint16_t *)ip, sizeof(ip_hdr_t)) != 0 ||
+    memcmp((uint8_t *)ip + sizeof(ip_hdr_t), bench_frame + sizeof(ether_hdr_t) + sizeof(ip_hdr_t),
+        ip_len - sizeof(ip_hdr_t)) != 0)
+        bench_bad++;
+    return buf->len;
+}
+
+void driver_close()
+{
+}
+
+/**
+ * @brief 对端发来的ARP响应，让协议栈学到它的mac
+ * 
+ */
+static void bench_learn(uint8_t *ip, uint8_t *mac)
+{
+    buf_t buf;
+    buf_init(&buf, sizeof(arp_pkt_t));
+    arp_pkt_t *pkt = (arp_pkt_t *)buf.data;
+    memset(pkt, 0, sizeof(arp_pkt_t));
+    pkt->hw_type16 = swap16(ARP_HW_ETHER);
+    pkt->pro_type16 = swap16(NET_PROTOCOL_IP);
+    pkt->hw_len = NET_MAC_LEN;
+    pkt->pro_len = NET_IP_LEN;
+    pkt->opcode16 = swap16(ARP_REPLY);
+    memcpy(pkt->sender_ip, ip, NET_IP_LEN);
+    memcpy(pkt->sender_mac, mac, NET_MAC_LEN);
+    memcpy(pkt->target_ip, net_if_ip, NET_IP_LEN);
+    memcpy(pkt->target_mac, net_if_mac, NET_MAC_LEN);
+    arp_in(&buf, mac);
+}
+
+/**
+ * @brief 构造对端发给dst_ip、经本机转发的UDP帧
+ * 
+ * @param len 以太网帧长（不含FCS）
+ */
+static void bench_build(size_t len)
+{
+    memset(bench_frame, 0, sizeof(bench_frame));
+    ether_hdr_t *eth = (ether_hdr_t *)bench_frame;
+    memcpy(eth->dst, net_if_mac, NET_MAC_LEN);
+    memcpy(eth->src, peer_mac, NET_MAC_LEN);
+    eth->protocol16 = swap16(NET_PROTOCOL_IP);
+    ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+    ip->version = IP_VERSION_4;
+    ip->hdr_len = sizeof(ip_hdr_t) / 4;
+    ip->total_len16 = swap16(len - sizeof(ether_hdr_t));
+    ip->ttl = TTL;
+    ip->protocol = NET_PROTOCOL_UDP;
+    memcpy(ip->src_ip, peer_ip, NET_IP_LEN);
+    memcpy(ip->dst_ip, dst_ip, NET_IP_LEN);
+    ip->hdr_checksum16 = checksum16((uint16_t *)ip, sizeof(ip_hdr_t));
+    for(size_t i = sizeof(ether_hdr_t) + sizeof(ip_hdr_t); i < len; i++)
+        bench_frame[i] = i * 13;
+    bench_frame_len = len;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 让驱动收到n个帧，处理完后返回每秒处理的帧数
+ * 
+ */
+static double bench_run(size_t n)
+{
+    bench_sent = bench_bad = 0;
+    bench_remaining = n;
+    double start = now_sec();
+    while(bench_remaining)
+        ethernet_poll();
+    ethernet_poll();
+    return n / (now_sec() - start);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t lens[] = {64, 576, 1514};
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+    driver_open();
+    ethernet_init();
+    arp_init();
+    ip_init();
+    icmp_init();
+    bench_learn(peer_ip, peer_mac);
+    bench_learn(dst_ip, dst_mac);
+    ethernet_flush();
+
+    int failed = 0;
+    printf("%6s %14s %14s %10s\n", "len", "off pkts/s", "fwd pkts/s", "fwd Mbit/s");
+    for(size_t k = 0; k < sizeof(lens) / sizeof(lens[0]); k++) {
+        bench_build(lens[k]);
+        ip_set_forwarding(0);
+        double off_rate = bench_run(n);
+        if(bench_sent != 0) failed++;
+        ip_set_forwarding(1);
+        double fwd_rate = bench_run(n);
+        if(bench_sent != n || bench_bad != 0) {
+            printf("len %zu: sent %zu of %zu, %zu bad\n", lens[k], bench_sent, n, bench_bad);
+            failed++;
+        }
+        printf("%6zu %14.3g %14.3g %10.0f\n", lens[k], off_rate, fwd_rate, fwd_rate * lens[k] * 8 / 1e6);
+    }
+    printf("correctness: %s\n", failed ? "FAILED" : "ok");
+    return failed != 0;
+}
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "utils.h"
+#include "forward.h"
+
+// 转发时出口MTU的测试：出口MTU设为1000字节，对端发来经本机转发的1400字节UDP数据报。
+//   （1）没有DF：分成976字节和404字节数据的两个分片发给下一跳，偏移、MF、TTL、校验和正确，拼起来和原负载一样
+//   （2）原数据报本身是一个中间分片：再分出的分片偏移接着原来的偏移，最后一个分片保留MF
+//   （3）设置了DF：不转发，给对端回送带有下一跳MTU的“需要分片”报文，引用的首部是TTL减一之前的
+//   （4）不超过出口MTU的数据报照常整个转发
+//
+// 用一个内存中的驱动代替pcap，driver_recv()返回对端发来的帧，driver_send()记下发出的帧。
+// 编译：和实验框架src目录下除driver.c、main.c之外的源文件以及lab2中的协议实现一起编译，例如
+//   gcc -std=gnu11 -O2 -I<实验框架的include目录> -I.. forward_mtu_test.c <其他源文件> -o forward_mtu_test
+
+#define TTL 64
+#define MTU 1000
+#define LEN 1400
+#define MAX_SENT 8
+#define ICMP_CODE_FRAG_NEEDED 4
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while(0)
+
+static uint8_t peer_ip[NET_IP_LEN] = {192, 168, 163, 1};
+static uint8_t peer_mac[NET_MAC_LEN] = {0x02, 0, 0, 0, 0, 0x01};
+static uint8_t dst_ip[NET_IP_LEN] = {10, 0, 0, 2};
+static uint8_t dst_mac[NET_MAC_LEN] = {0x02, 0, 0, 0, 0, 0x02};
+
+/**
+ * @brief 对端发来的帧，driver_recv()只返回一次
+ *
+ */
+static uint8_t frame[ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t)];
+static uint16_t frame_len;
+static int frame_pending;
+
+/**
+ * @brief 驱动发出的帧
+ *
+ */
+static uint8_t sent[MAX_SENT][ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t)];
+static size_t sent_len[MAX_SENT];
+static int sent_count;
+
+int driver_open()
+{
+    return 0;
+}
+
+int driver_recv(buf_t *buf)
+{
+    if(!frame_pending) return 0;
+    frame_pending = 0;
+    buf_init(buf, frame_len);
+    memcpy(buf->data, frame, frame_len);
+    return frame_len;
+}
+
+int driver_send(buf_t *buf)
+{
+    CHECK(sent_count < MAX_SENT && buf->len <= sizeof(sent[0]));
+    memcpy(sent[sent_count], buf->data, buf->len);
+    sent_len[sent_count] = buf->len;
+    sent_count++;
+    return buf->len;
+}
+
+void driver_close()
+{
+}
+
+/**
+ * @brief 对端发来的ARP响应，让协议栈学到它的mac
+ *
+ */
+static void learn(uint8_t *ip, uint8_t *mac)
+{
+    buf_t buf;
+    buf_init(&buf, sizeof(arp_pkt_t));
+    arp_pkt_t *pkt = (arp_pkt_t *)buf.data;
+    memset(pkt, 0, sizeof(arp_pkt_t));
+    pkt->hw_type16 = swap16(ARP_HW_ETHER);
+    pkt->pro_type16 = swap16(NET_PROTOCOL_IP);
+    pkt->hw_len = NET_MAC_LEN;
+    pkt->pro_len = NET_IP_LEN;
+    pkt->opcode16 = swap16(ARP_REPLY);
+    memcpy(pkt->sender_ip, ip, NET_IP_LEN);
+    memcpy(pkt->sender_mac, mac, NET_MAC_LEN);
+    memcpy(pkt->target_ip, net_if_ip, NET_IP_LEN);
+    memcpy(pkt->target_mac, net_if_mac, NET_MAC_LEN);
+    arp_in(&buf, mac);
+}
+
+static uint8_t payload_byte(size_t i)
+{
+    return i * 13 + 7;
+}
+
+/**
+ * @brief 对端发来一个经本机转发的UDP数据报，处理完之后sent中是本机发出的帧
+ *
+ * @param len ip数据报长度
+ * @param flags_fragment 首部中的标志和偏移
+ */
+static void forward(size_t len, uint16_t flags_fragment)
+{
+    memset(frame, 0, sizeof(frame));
+    ether_hdr_t *eth = (ether_hdr_t *)frame;
+    memcpy(eth->dst, net_if_mac, NET_MAC_LEN);
+    memcpy(eth->src, peer_mac, NET_MAC_LEN);
+    eth->protocol16 = swap16(NET_PROTOCOL_IP);
+    ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+    ip->version = IP_VERSION_4;
+    ip->hdr_len = sizeof(ip_hdr_t) / 4;
+    ip->total_len16 = swap16(len);
+    ip->id16 = swap16(0x1234);
+    ip->flags_fragment16 = swap16(flags_fragment);
+    ip->ttl = TTL;
+    ip->protocol = NET_PROTOCOL_UDP;
+    memcpy(ip->src_ip, peer_ip, NET_IP_LEN);
+    memcpy(ip->dst_ip, dst_ip, NET_IP_LEN);
+    ip->hdr_checksum16 = checksum16((uint16_t *)ip, sizeof(ip_hdr_t));
+    for(size_t i = 0; i < len - sizeof(ip_hdr_t); i++)
+        ((uint8_t *)(ip + 1))[i] = payload_byte(i);
+    frame_len = sizeof(ether_hdr_t) + len;
+    frame_pending = 1;
+    sent_count = 0;
+    ethernet_poll();
+    ethernet_flush();
+}
+
+/**
+ * @brief 检查sent中的分片：发给下一跳，不超过出口MTU，首部正确，负载拼起来和原数据报一样
+ *
+ * @param n 分片个数
+ * @param len 原数据报长度
+ * @param offset 原数据报的偏移（8字节为单位）
+ * @param mf 原数据报的MF
+ */
+static void check_fragments(int n, size_t len, uint16_t offset, int mf)
+{
+    CHECK(sent_count == n);
+    size_t done = 0;
+    for(int i = 0; i < n; i++) {
+        ether_hdr_t *eth = (ether_hdr_t *)sent[i];
+        ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+        size_t frag_len = swap16(ip->total_len16);
+        uint16_t flags_fragment = swap16(ip->flags_fragment16);
+        CHECK(memcmp(eth->dst, dst_mac, NET_MAC_LEN) == 0 && frag_len <= MTU);
+        CHECK(ip->ttl == TTL - 1 && swap16(ip->id16) == 0x1234 && ip->protocol == NET_PROTOCOL_UDP);
+        CHECK(memcmp(ip->src_ip, peer_ip, NET_IP_LEN) == 0 && memcmp(ip->dst_ip, dst_ip, NET_IP_LEN) == 0);
+        CHECK(checksum16((uint16_t *)ip, sizeof(ip_hdr_t)) == 0);
+        CHECK((flags_fragment & 0x1FFF) == offset + done / 8);
+        CHECK(!!(flags_fragment & (1 << 13)) == (i + 1 < n || mf));
+        for(size_t j = 0; j < frag_len - sizeof(ip_hdr_t); j++)
+            CHECK(((uint8_t *)(ip + 1))[j] == payload_byte(done + j));
+        done += frag_len - sizeof(ip_hdr_t);
+    }
+    CHECK(done == len - sizeof(ip_hdr_t));
+}
+
+int main()
+{
+    driver_open();
+    ethernet_init();
+    arp_init();
+    ip_init();
+    icmp_init();
+    learn(peer_ip, peer_mac);
+    learn(dst_ip, dst_mac);
+    ethernet_flush();
+    ip_set_forwarding(1);
+    ip_set_forward_mtu(MTU);
+
+    // （1）没有DF：分成两个分片
+    forward(LEN, 0);
+    check_fragments(2, LEN, 0, 0);
+    printf("no DF: %d bytes forwarded as 2 fragments\n", LEN);
+
+    // （2）原数据报是偏移100（800字节）的中间分片
+    forward(LEN, (1 << 13) | 100);
+    check_fragments(2, LEN, 100, 1);
+    printf("middle fragment: refragmented at offset 100, MF kept\n");
+
+    // （3）设置了DF：回送“需要分片”
+    forward(LEN, 1 << 14);
+    CHECK(sent_count == 1);
+    ether_hdr_t *eth = (ether_hdr_t *)sent[0];
+    ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+    icmp_hdr_t *icmp = (icmp_hdr_t *)(ip + 1);
+    CHECK(memcmp(eth->dst, peer_mac, NET_MAC_LEN) == 0 && ip->protocol == NET_PROTOCOL_ICMP);
+    CHECK(memcmp(ip->dst_ip, peer_ip, NET_IP_LEN) == 0);
+    CHECK(swap16(ip->total_len16) == sizeof(ip_hdr_t) + sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8);
+    CHECK(checksum16((uint16_t *)icmp, sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8) == 0);
+    CHECK(icmp->type == ICMP_TYPE_UNREACH && icmp->code == ICMP_CODE_FRAG_NEEDED && swap16(icmp->seq16) == MTU);
+    CHECK(memcmp(icmp + 1, frame + sizeof(ether_hdr_t), sizeof(ip_hdr_t) + 8) == 0);
+    printf("DF: frag needed with MTU %d sent back\n", MTU);
+
+    // （4）放得下的数据报整个转发
+    forward(MTU, 1 << 14);
+    check_fragments(1, MTU, 0, 0);
+    printf("fits: forwarded whole\n");
+    printf("ok\n");
+    return 0;
+}
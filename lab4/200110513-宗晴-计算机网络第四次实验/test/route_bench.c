@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "route.h"
+
+// 路由表的正确性检查和查找速度对比：
+// 随机添加、删除路由后，用逐条比较的线性表做最长前缀匹配，检查route_lookup()的结果，
+// 再在同样的目的地址序列上比较两者的每秒查找次数。
+//
+// 编译：和实验框架src目录下除main.c之外的源文件一起编译，例如
+//   gcc -std=gnu11 -O2 -I<实验框架的include目录> -I.. route_bench.c ../route.c ../utils.c <其他源文件> -lpcap -o route_bench
+// 用法：route_bench [每种情况的查找次数，默认10000000]
+
+#define MAX_ROUTES 16384
+#define SEQ_LEN 4096
+
+/**
+ * @brief 线性路由表的表项
+ * 
+ */
+typedef struct linear_route {
+    uint32_t prefix;    // 主机字节序
+    int len;
+    uint8_t next_hop[NET_IP_LEN];
+} linear_route_t;
+
+static linear_route_t linear[MAX_ROUTES];
+static size_t linear_count;
+static uint8_t bench_dst[SEQ_LEN][NET_IP_LEN];
+
+static uint32_t ip_load(const uint8_t *ip)
+{
+    return (uint32_t)ip[0] << 24 | ip[1] << 16 | ip[2] << 8 | ip[3];
+}
+
+static void ip_store(uint8_t *ip, uint32_t value)
+{
+    ip[0] = value >> 24;
+    ip[1] = value >> 16;
+    ip[2] = value >> 8;
+    ip[3] = value;
+}
+
+static uint32_t prefix_mask(int len)
+{
+    return len == 0 ? 0 : ~(uint32_t)0 << (32 - len);
+}
+
+static uint32_t rand32()
+{
+    return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+/**
+ * @brief 逐条比较的最长前缀匹配，直接交付的路由下一跳为全0，和route_lookup()一样返回dst_ip
+ * 
+ */
+static int linear_lookup(uint8_t *dst_ip, uint8_t *next_hop)
+{
+    uint32_t dst = ip_load(dst_ip);
+    linear_route_t *best = NULL;
+    for(size_t i = 0; i < linear_count; i++) {
+        linear_route_t *route = &linear[i];
+        if(((dst ^ route->prefix) & prefix_mask(route->len)) == 0 && (best == NULL || route->len > best->len))
+            best = route;
+    }
+    if(best == NULL) return -1;
+    if(ip_load(best->next_hop) == 0) memcpy(next_hop, dst_ip, NET_IP_LEN);
+    else memcpy(next_hop, best->next_hop, NET_IP_LEN);
+    return 0;
+}
+
+static void linear_delete(size_t i)
+{
+    linear[i] = linear[--linear_count];
+}
+
+/**
+ * @brief 生成n条不重复的路由，前缀长度集中在16到24位，和真实路由表类似；约四分之一直接交付
+ * 
+ */
+static void bench_fill(size_t n)
+{
+    for(size_t i = 0; i < linear_count; i++) {
+        uint8_t prefix[NET_IP_LEN];
+        ip_store(prefix, linear[i].prefix);
+        route_delete(prefix, linear[i].len);
+    }
+    linear_count = 0;
+    while(linear_count < n) {
+        static const int lens[] = {8, 12, 16, 16, 20, 22, 24, 24, 24, 28, 32};
+        linear_route_t route;
+        route.len = lens[rand() % (sizeof(lens) / sizeof(lens[0]))];
+        route.prefix = rand32() & 0x3FFFFFFF & prefix_mask(route.len);    // 集中在一部分地址空间，前缀之间有重叠
+        ip_store(route.next_hop, rand() % 4 == 0 ? 0 : rand32() | 1);
+        int dup = 0;
+        for(size_t i = 0; i < linear_count && !dup; i++)
+            dup = linear[i].len == route.len && linear[i].prefix == route.prefix;
+        if(dup) continue;
+        uint8_t prefix[NET_IP_LEN];
+        ip_store(prefix, route.prefix);
+        if(route_add(prefix, route.len, ip_load(route.next_hop) ? route.next_hop : NULL) != 0) {
+            printf("route_add failed\n");
+            exit(1);
+        }
+        linear[linear_count++] = route;
+    }
+}
+
+/**
+ * @brief 目的地址：一半落在某条路由的前缀里（主机位随机），一半完全随机
+ * 
+ */
+static void bench_dsts()
+{
+    for(size_t i = 0; i < SEQ_LEN; i++) {
+        uint32_t dst = rand32();
+        if(linear_count && i % 2 == 0) {
+            linear_route_t *route = &linear[rand() % linear_count];
+            dst = route->prefix | (dst & ~prefix_mask(route->len));
+        }
+        ip_store(bench_dst[i], dst);
+    }
+}
+
+static int bench_check()
+{
+    int failed = 0;
+    for(size_t i = 0; i < SEQ_LEN; i++) {
+        uint8_t expect[NET_IP_LEN], got[NET_IP_LEN];
+        int expect_ret = linear_lookup(bench_dst[i], expect);
+        int got_ret = route_lookup(bench_dst[i], got);
+        if(expect_ret != got_ret || (expect_ret == 0 && memcmp(expect, got, NET_IP_LEN) != 0)) {
+            if(failed++ < 10)
+                printf("lookup %s: got %d expect %d\n", iptos(bench_dst[i]), got_ret, expect_ret);
+        }
+    }
+    return failed;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_run(int use_linear, size_t lookups)
+{
+    volatile uint8_t sink = 0;
+    uint8_t next_hop[NET_IP_LEN];
+    double start = now_sec();
+    for(size_t i = 0; i < lookups; i++) {
+        uint8_t *dst = bench_dst[i & (SEQ_LEN - 1)];
+        if(use_linear) linear_lookup(dst, next_hop);
+        else route_lookup(dst, next_hop);
+        sink += next_hop[3];
+    }
+    return lookups / (now_sec() - start);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = {2, 64, 1024, MAX_ROUTES};
+    size_t lookups = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    srand(1);
+    int failed = 0;
+    printf("%8s %17s %17s\n", "routes", "linear lookups/s", "route lookups/s");
+    for(size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        size_t n = sizes[k];
+        bench_fill(n);
+        bench_dsts();
+        failed += bench_check();
+        // 删掉三分之一再检查一次，覆盖删除后合并节点的情况
+        for(size_t i = 0; i < linear_count; i++) {
+            if(rand() % 3) continue;
+            uint8_t prefix[NET_IP_LEN];
+            ip_store(prefix, linear[i].prefix);
+            if(route_delete(prefix, linear[i].len) != 0) failed++;
+            linear_delete(i--);
+        }
+        failed += bench_check();
+        bench_fill(n);
+        bench_dsts();
+        // 线性表逐条比较，路由多时减少查找次数
+        double linear_rate = bench_run(1, lookups / (n > 16 ? n / 16 : 1));
+        double route_rate = bench_run(0, lookups);
+        printf("%8zu %17.3g %17.3g\n", n, linear_rate, route_rate);
+    }
+    printf("correctness: %s\n", failed ? "FAILED" : "ok");
+    return failed != 0;
+}
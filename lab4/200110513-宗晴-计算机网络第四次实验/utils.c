@@ -1,6 +1,11 @@
 #include "utils.h"
+#include "checksum.h"
 #include <stdio.h>
 #include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM16_X86
+#endif
 /**
  * @brief ip转字符串
  * 
@@ -53,19 +58,127 @@ char *timetos(time_t timestamp)
  */
 uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb)
 {
-    uint8_t count = 0;
-    for (size_t i = 0; i < 4; i++)
-    {
-        uint8_t flag = ipa[i] ^ ipb[i];
-        for (size_t j = 0; j < 8; j++)
-        {
-            if (flag & (1 << 7))
-                return count;
-            else
-                count++, flag <<= 1;
-        }
+    // 把异或结果拼成一个32位数，最高位起连续的0的个数就是相同前缀的长度
+    uint32_t diff = ((uint32_t)(ipa[0] ^ ipb[0]) << 24) | ((uint32_t)(ipa[1] ^ ipb[1]) << 16) |
+    ((uint32_t)(ipa[2] ^ ipb[2]) << 8) | (uint32_t)(ipa[3] ^ ipb[3]);
+    return diff ? __builtin_clz(diff) : 32;
+}
+
+/**
+ * @brief 校验和累加函数，返回data的64位累加值（尚未折叠）
+ * 
+ */
+typedef uint64_t (*checksum16_sum_t)(const uint8_t *data, size_t len);
+
+/**
+ * @brief 标量累加，每次加一个32位字到64位累加器，最后剩下的不足4字节逐个处理
+ *        因为2^16 mod 0xFFFF = 1，按32位累加后再折叠，结果和按16位累加相同
+ * 
+ * @param data 要计算的数据
+ * @param len 数据长度
+ * @return uint64_t 累加值
+ */
+static uint64_t checksum16_sum_scalar(const uint8_t *data, size_t len)
+{
+    uint64_t sum = 0;
+    while(len >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        sum += word;
+        data += 4;
+        len -= 4;
+    }
+    if(len >= 2) {
+        uint16_t word;
+        memcpy(&word, data, 2);
+        sum += word;
+        data += 2;
+        len -= 2;
+    }
+    // 最后剩下一个字节时，把它当作高地址补0的16位字
+    if(len == 1) {
+        uint16_t word = 0;
+        memcpy(&word, data, 1);
+        sum += word;
+    }
+    return sum;
+}
+
+#ifdef CHECKSUM16_X86
+/**
+ * @brief SSE2累加，每次读16字节（不要求对齐），按32位拆开后加到两个64位通道上
+ * 
+ * @param data 要计算的数据
+ * @param len 数据长度
+ * @return uint64_t 累加值
+ */
+__attribute__((target("sse2")))
+static uint64_t checksum16_sum_sse2(const uint8_t *data, size_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    while(len >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)data);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+        data += 16;
+        len -= 16;
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    return lanes[0] + lanes[1] + checksum16_sum_scalar(data, len);
+}
+
+/**
+ * @brief AVX2累加，每次读64字节（不要求对齐），用两个累加器交替累加，剩余部分交给SSE2处理
+ * 
+ * @param data 要计算的数据
+ * @param len 数据长度
+ * @return uint64_t 累加值
+ */
+__attribute__((target("avx2")))
+static uint64_t checksum16_sum_avx2(const uint8_t *data, size_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    while(len >= 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)data);
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(data + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+        data += 64;
+        len -= 64;
     }
-    return count;
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + checksum16_sum_sse2(data, len);
+}
+#endif
+
+/**
+ * @brief 第一次调用时根据CPU支持的指令集选择累加函数，之后直接调用选中的函数
+ * 
+ * @param data 要计算的数据
+ * @param len 数据长度
+ * @return uint64_t 累加值
+ */
+static uint64_t checksum16_sum_dispatch(const uint8_t *data, size_t len);
+static checksum16_sum_t checksum16_sum = checksum16_sum_dispatch;
+
+static uint64_t checksum16_sum_dispatch(const uint8_t *data, size_t len)
+{
+    checksum16_sum = checksum16_sum_scalar;
+#ifdef CHECKSUM16_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        checksum16_sum = checksum16_sum_avx2;
+    else if(__builtin_cpu_supports("sse2"))
+        checksum16_sum = checksum16_sum_sse2;
+#endif
+    return checksum16_sum(data, len);
 }
 
 /**
@@ -78,22 +191,47 @@ uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb)
 uint16_t checksum16(uint16_t *data, size_t len)
 {
     // TO-DO
-    // Step1 ：把data看成是每16个bit（即2个字节）组成一个数，相加
-    uint32_t checksum = 0;
-    for(size_t i = 0; i < len / 2; i ++ ) 
-        checksum += (uint16_t)data[i];
+    // Step1 ：把data看成是每16个bit（即2个字节）组成一个数，相加。
+    // 累加器是64位的，由checksum16_sum按CPU支持的指令集（AVX2/SSE2/标量）完成，
+    // 如果最后还剩8个bit值，也会把这个字节加上。
+    uint64_t checksum = checksum16_sum((const uint8_t *)data, len);
 
-    // Step2 ：如果最后还剩8个bit值，也要相加这个8bit值。
-    if(len % 2 == 1) checksum += (uint8_t)data[len - 1];
+    // Step2 ：判断相加后结果值的高位是否为0，如果不为0，
+    // 则将高位和低16位相加，依次循环，直至高位为0为止。
+    while(checksum >> 16 != 0)
+        checksum = (checksum >> 16) + (checksum & 0xFFFF);
 
-    // Step3 ：判断相加后32bit结果值的高16位是否为0，如果不为0，
-    // 则将高16位和低16位相加，依次循环，直至高16位为0为止。
-    while(checksum >> 16 != 0) {
-        uint16_t high16 = checksum >> 16;
-        uint16_t low16 = (checksum << 16) >> 16;
-        checksum = high16 + low16;
-    }
-
-    // Step4 ：将上述的和（低16位）取反，即得到校验和。
+    // Step3 ：将上述的和（低16位）取反，即得到校验和。
     return ~(uint16_t) checksum;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 增量更新16位校验和（RFC 1624 式3：HC' = ~(~HC + ~m + m')），
+ *        用于首部中只有少数字段改变的情况，不需要重新计算整个首部
+ * 
+ * @param checksum 原校验和（报文中的原值）
+ * @param old_word 字段原值（与报文中的字节序相同）
+ * @param new_word 字段新值（与报文中的字节序相同）
+ * @return uint16_t 新校验和
+ */
+uint16_t checksum16_update(uint16_t checksum, uint16_t old_word, uint16_t new_word)
+{
+    uint32_t sum = (uint16_t)~checksum + (uint16_t)~old_word + (uint32_t)new_word;
+    while(sum >> 16 != 0)
+        sum = (sum >> 16) + (sum & 0xFFFF);
+    return ~(uint16_t) sum;
+}
+
+/**
+ * @brief 增量更新16位校验和，字段为32位（如TCP的seq、ack）
+ * 
+ * @param checksum 原校验和（报文中的原值）
+ * @param old_dword 字段原值（与报文中的字节序相同）
+ * @param new_dword 字段新值（与报文中的字节序相同）
+ * @return uint16_t 新校验和
+ */
+uint16_t checksum16_update32(uint16_t checksum, uint32_t old_dword, uint32_t new_dword)
+{
+    checksum = checksum16_update(checksum, (uint16_t)(old_dword >> 16), (uint16_t)(new_dword >> 16));
+    return checksum16_update(checksum, (uint16_t)old_dword, (uint16_t)new_dword);
+}